@@ -0,0 +1,292 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <async_logger.h>
+#include <cstdarg>
+#include <cstdio>
+
+using namespace std;
+
+/**
+ * Return the singleton asynchronous logger
+ *
+ * @return AsyncLogger*	The asynchronous logger
+ */
+AsyncLogger *AsyncLogger::getInstance()
+{
+	static AsyncLogger instance;
+	return &instance;
+}
+
+/**
+ * Constructor for the asynchronous logger. Each slot of the ring starts
+ * with a sequence number equal to its index, marking it as free.
+ */
+AsyncLogger::AsyncLogger() : m_tail(0), m_head(0), m_running(false), m_producers(0), m_dropped(0),
+	m_thread(NULL), m_written(0), m_suppressed(0)
+{
+	for (size_t i = 0; i < ASYNC_LOG_SLOTS; i++)
+		m_slots[i].m_sequence.store(i, memory_order_relaxed);
+}
+
+/**
+ * Destructor for the asynchronous logger
+ */
+AsyncLogger::~AsyncLogger()
+{
+	stop();
+}
+
+/**
+ * Thread entry point for the drain thread
+ *
+ * @param logger	The asynchronous logger to drain
+ */
+static void drainThread(AsyncLogger *logger)
+{
+	logger->run();
+}
+
+/**
+ * Start the thread that writes the queued messages
+ */
+void AsyncLogger::start()
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (m_thread)
+		return;
+	m_windowStart = chrono::steady_clock::now();
+	m_running = true;
+	m_thread = new thread(drainThread, this);
+}
+
+/**
+ * Stop the drain thread, any queued messages are written first. A thread
+ * that saw the logger running may still be queuing a message once the
+ * drain thread has exited, the final drain waits for these messages to be
+ * published.
+ */
+void AsyncLogger::stop()
+{
+	{
+		lock_guard<mutex> guard(m_mutex);
+		m_running = false;
+	}
+	m_cv.notify_all();
+	if (m_thread)
+	{
+		m_thread->join();
+		delete m_thread;
+		m_thread = NULL;
+		while (m_producers.load() != 0)
+			this_thread::yield();
+		// Write any messages queued while the thread was stopping
+		drain();
+		endWindow();
+	}
+}
+
+/**
+ * Log an informational message
+ */
+void AsyncLogger::info(const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	log(LevelInfo, fmt, args);
+	va_end(args);
+}
+
+/**
+ * Log a warning message
+ */
+void AsyncLogger::warn(const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	log(LevelWarn, fmt, args);
+	va_end(args);
+}
+
+/**
+ * Log an error message
+ */
+void AsyncLogger::error(const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	log(LevelError, fmt, args);
+	va_end(args);
+}
+
+/**
+ * Queue a message. A slot is claimed by advancing the tail of the ring,
+ * the message is formatted directly into the slot and the slot is then
+ * published by updating its sequence number. If the ring is full the
+ * message is dropped.
+ *
+ * @param level		The level of the message
+ * @param fmt		The printf format of the message
+ * @param args		The arguments of the message
+ */
+void AsyncLogger::log(Level level, const char *fmt, va_list args)
+{
+	// Registered before testing m_running so that stop() waits for the message
+	m_producers.fetch_add(1);
+	if (!m_running.load())
+	{
+		m_producers.fetch_sub(1);
+		char message[ASYNC_LOG_MESSAGE_SIZE];
+		vsnprintf(message, sizeof(message), fmt, args);
+		write(level, message);
+		return;
+	}
+
+	size_t pos = m_tail.load(memory_order_relaxed);
+	Slot *slot;
+	while (true)
+	{
+		slot = &m_slots[pos & (ASYNC_LOG_SLOTS - 1)];
+		size_t sequence = slot->m_sequence.load(memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff == 0)
+		{
+			if (m_tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			// The ring is full
+			m_dropped.fetch_add(1, memory_order_relaxed);
+			m_producers.fetch_sub(1, memory_order_release);
+			return;
+		}
+		else
+		{
+			pos = m_tail.load(memory_order_relaxed);
+		}
+	}
+	slot->m_level = level;
+	vsnprintf(slot->m_message, sizeof(slot->m_message), fmt, args);
+	slot->m_sequence.store(pos + 1, memory_order_release);
+	m_producers.fetch_sub(1, memory_order_release);
+}
+
+/**
+ * The drain thread, the ring is drained periodically rather than on
+ * each message so that the logging threads never need to signal it
+ */
+void AsyncLogger::run()
+{
+	unique_lock<mutex> lock(m_mutex);
+	while (m_running)
+	{
+		m_cv.wait_for(lock, chrono::milliseconds(ASYNC_LOG_DRAIN_INTERVAL));
+		lock.unlock();
+		drain();
+		lock.lock();
+	}
+	lock.unlock();
+	drain();
+	endWindow();
+}
+
+/**
+ * Write the messages in the ring to the Fledge logger, removing repeats
+ * and applying the rate limit
+ */
+void AsyncLogger::drain()
+{
+	while (true)
+	{
+		Slot *slot = &m_slots[m_head & (ASYNC_LOG_SLOTS - 1)];
+		if (slot->m_sequence.load(memory_order_acquire) != m_head + 1)
+			break;
+		Level level = slot->m_level;
+		string message(slot->m_message);
+		slot->m_sequence.store(m_head + ASYNC_LOG_SLOTS, memory_order_release);
+		m_head++;
+
+		if (chrono::steady_clock::now() - m_windowStart >= chrono::seconds(1))
+			endWindow();
+
+		string key = to_string(level) + message;
+		auto it = m_repeats.find(key);
+		if (it != m_repeats.end())
+		{
+			it->second++;
+			continue;
+		}
+		if (m_written >= ASYNC_LOG_RATE)
+		{
+			m_suppressed++;
+			continue;
+		}
+		m_written++;
+		write(level, message);
+		if (m_repeats.size() < ASYNC_LOG_DEDUP_ENTRIES)
+			m_repeats.insert(make_pair(key, 0L));
+	}
+	if (chrono::steady_clock::now() - m_windowStart >= chrono::seconds(1))
+		endWindow();
+}
+
+/**
+ * End the current one second window, report the messages that were
+ * repeated, suppressed or dropped during the window
+ */
+void AsyncLogger::endWindow()
+{
+	for (auto& repeat : m_repeats)
+	{
+		if (repeat.second)
+		{
+			Level level = (Level)(repeat.first[0] - '0');
+			write(level, "Last message repeated " + to_string(repeat.second) + " times: "
+					+ repeat.first.substr(1));
+		}
+	}
+	m_repeats.clear();
+	if (m_suppressed)
+	{
+		Logger::getLogger()->warn("%ld log messages were suppressed by the log rate limit", m_suppressed);
+	}
+	long dropped = m_dropped.exchange(0, memory_order_relaxed);
+	if (dropped)
+	{
+		Logger::getLogger()->warn("%ld log messages were dropped as the log buffer was full", dropped);
+	}
+	m_written = 0;
+	m_suppressed = 0;
+	m_windowStart = chrono::steady_clock::now();
+}
+
+/**
+ * Write a message to the Fledge logger
+ *
+ * @param level		The level of the message
+ * @param message	The message
+ */
+void AsyncLogger::write(Level level, const string& message)
+{
+	Logger *logger = Logger::getLogger();
+	switch (level)
+	{
+		case LevelInfo:
+			logger->info("%s", message.c_str());
+			break;
+		case LevelWarn:
+			logger->warn("%s", message.c_str());
+			break;
+		case LevelError:
+			logger->error("%s", message.c_str());
+			break;
+	}
+}
@@ -13,6 +13,8 @@
 #include <rapidjson/document.h>
 #include <rapidjson/error/en.h>
 #include <logger.h>
+#include <debug_log.h>
+#include <async_logger.h>
 
 using namespace std;
 
@@ -40,10 +42,11 @@ bool Script::execute(DispatcherService *service, const KVList& parameters)
 			return false;
 		}
 	}
-	Logger::getLogger()->debug("Execute script %s, Caller %s, type %s with parameters %s",
+	DEBUG_LOG(Logger::getLogger(), "Execute script %s, Caller %s, type %s, trace %s with parameters %s",
 				m_name.c_str(),
 				m_source_name.c_str(),
 				m_source_type.c_str(),
+				m_traceId.c_str(),
 				parameters.toString().c_str());
 
 	int stepNo = 0;
@@ -56,7 +59,7 @@ bool Script::execute(DispatcherService *service, const KVList& parameters)
 
 			if (!res)
 			{
-				Logger::getLogger()->info("Execute of %s failed at step %d",
+				AsyncLogger::getInstance()->info("Execute of %s failed at step %d",
 							m_name.c_str(),
 							stepNo);
 				return res;
@@ -64,7 +67,7 @@ bool Script::execute(DispatcherService *service, const KVList& parameters)
 		}
 		else
 		{
-			Logger::getLogger()->error("Script %s hsa an invalid step %d",
+			AsyncLogger::getInstance()->error("Script %s hsa an invalid step %d",
 						m_name.c_str(),
 						stepNo);
 			return false;
@@ -83,7 +86,7 @@ bool Script::load(DispatcherService *service)
 {
 	Logger *log = Logger::getLogger();
 
-	log->debug("Loading script '%s' for service '%s', "
+	DEBUG_LOG(log, "Loading script '%s' for service '%s', "
 			"caller name '%s', type '%s', URL '%s'",
 			m_name.c_str(),
 			service->getName().c_str(),
@@ -92,6 +95,12 @@ bool Script::load(DispatcherService *service)
 			m_request_url.c_str());
 
 	StorageClient *storage = service->getStorageClient();
+	if (!storage)
+	{
+		log->error("Unable to load control script '%s', there is no storage service connection",
+				m_name.c_str());
+		return false;
+	}
 
 	Where *where = new Where("name", Equals, m_name);
 	Query scriptQuery(where);
@@ -241,6 +250,7 @@ bool Script::load(DispatcherService *service)
 							s->setSourceName(m_source_name);
 							s->setSourceType(m_source_type);
 							s->setRequestURL(m_request_url);
+							s->setTraceId(m_traceId);
 
 							if (!addStep(order, s))
 							{
@@ -548,7 +558,8 @@ bool WriteScriptStep::execute(DispatcherService *service, const KVList& paramete
 				"/fledge/south/setpoint",
 				payload,
 				m_source_name,
-				m_source_type);
+				m_source_type,
+				m_traceId);
 }
 
 /**
@@ -582,7 +593,8 @@ bool OperationScriptStep::execute(DispatcherService *service, const KVList& para
 				"/fledge/south/operation",
 				payload,
 				m_source_name,
-				m_source_type);
+				m_source_type,
+				m_traceId);
 }
 
 /**
@@ -606,6 +618,7 @@ bool ScriptScriptStep::execute(DispatcherService *service, const KVList& paramet
 	script.setSourceName(m_source_name);
 	script.setSourceType(m_source_type);
 	script.setRequestURL(m_request_url);
+	script.setTraceId(m_traceId);
 
 	return script.execute(service, parameters);
 }
@@ -649,13 +662,13 @@ bool Script::validateACL(DispatcherService *service,
 		char *str = scriptAcl->getString();
 		if (strcmp(str, "") == 0)
 		{
-			log->debug("Script '%s' has no ACL set",
+			DEBUG_LOG(log, "Script '%s' has no ACL set",
 				m_name.c_str());
 			// No ACL to load
 			return true;
 		}
 
-		log->debug("Script '%s' has ACL '%s', loading it",
+		DEBUG_LOG(log, "Script '%s' has ACL '%s', loading it",
 			m_name.c_str(),
 			str);
 
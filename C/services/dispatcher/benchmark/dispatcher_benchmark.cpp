@@ -0,0 +1,465 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ * Microbenchmarks for the core primitives of the dispatcher service.
+ * The results are written to stdout as a JSON document so that runs
+ * can be compared over time.
+ *
+ * Usage: dispatcher_benchmark [--filter <substring>] [--min-time <seconds>]
+ */
+#include <kvlist.h>
+#include <pipeline_manager.h>
+#include <controlpipeline.h>
+#include <controlrequest.h>
+#include <request_queue.h>
+#include <logger.h>
+#include <debug_log.h>
+#include <lock_profiler.h>
+#include <request_journal.h>
+#include <rapidjson/document.h>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * Prevent the compiler optimising away the result of a benchmark
+ */
+template <class T> static void doNotOptimise(T const& value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * A benchmark is a function that executes a number of iterations of
+ * the operation being measured
+ */
+class Benchmark {
+	public:
+		Benchmark(const string& name, const function<void (long)>& fn) :
+			m_name(name), m_fn(fn) {};
+		string			m_name;
+		function<void (long)>	m_fn;
+};
+
+/**
+ * A control request that does nothing, used to exercise the request queue
+ */
+class NullRequest : public ControlRequest {
+	public:
+		void			execute(DispatcherService *) {};
+		PipelineEndpoint	getDestination() { return PipelineEndpoint(PipelineEndpoint::EndpointBroadcast); };
+		void			filter(ControlPipelineManager *, PipelineTrace *) {};
+		string			getPayload() { return ""; };
+		const char		*getRequestType() const { return "null"; };
+};
+
+static double minTime = 0.5;
+
+/**
+ * Run a benchmark, increasing the number of iterations until the run
+ * takes at least the minimum time.
+ *
+ * @param benchmark	The benchmark to run
+ * @param json		The JSON result to append to
+ */
+static void run(const Benchmark& benchmark, string& json)
+{
+	long iterations = 1;
+	double elapsed = 0;
+	while (true)
+	{
+		auto start = chrono::steady_clock::now();
+		benchmark.m_fn(iterations);
+		elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		if (elapsed >= minTime || iterations >= (1L << 40))
+			break;
+		// Aim for the minimum time, growing by at most 10x each round
+		double scale = elapsed > 0 ? (minTime * 1.2) / elapsed : 10.0;
+		if (scale > 10.0)
+			scale = 10.0;
+		if (scale < 2.0)
+			scale = 2.0;
+		iterations = (long)(iterations * scale);
+	}
+	double nsPerOp = (elapsed * 1e9) / iterations;
+	char buf[256];
+	snprintf(buf, sizeof(buf),
+		"    { \"name\" : \"%s\", \"iterations\" : %ld, \"ns_per_op\" : %.2f, \"ops_per_sec\" : %.0f }",
+		benchmark.m_name.c_str(), iterations, nsPerOp, iterations / elapsed);
+	if (!json.empty())
+		json += ",\n";
+	json += buf;
+	fprintf(stderr, "%-40s %12.2f ns/op\n", benchmark.m_name.c_str(), nsPerOp);
+}
+
+/**
+ * Create a key/value list with a number of keys
+ *
+ * @param count	The number of keys
+ * @return string	The JSON object
+ */
+static string makeObject(int count)
+{
+	string json = "{";
+	for (int i = 0; i < count; i++)
+	{
+		if (i)
+			json += ", ";
+		json += "\"key" + to_string(i) + "\" : \"" + to_string(i * 17) + "\"";
+	}
+	json += "}";
+	return json;
+}
+
+/**
+ * Create a pipeline manager populated with a number of pipelines
+ *
+ * @param count	The number of pipelines
+ * @return ControlPipelineManager*	The pipeline manager
+ */
+static ControlPipelineManager *makeManager(int count)
+{
+	ControlPipelineManager *manager = new ControlPipelineManager(NULL, NULL);
+	for (int i = 0; i < count; i++)
+	{
+		ControlPipeline *pipeline = new ControlPipeline(manager, "pipeline" + to_string(i));
+		pipeline->endpoints(PipelineEndpoint(PipelineEndpoint::EndpointService, "source" + to_string(i)),
+				PipelineEndpoint(PipelineEndpoint::EndpointService, "south" + to_string(i)));
+		manager->addPipeline(pipeline);
+	}
+	return manager;
+}
+
+/**
+ * Push and pop requests through a request queue with a number of
+ * producer and consumer threads
+ *
+ * @param producers	The number of producer threads
+ * @param consumers	The number of consumer threads
+ * @param iterations	The total number of requests
+ */
+static void queueContention(int producers, int consumers, long iterations)
+{
+	RequestQueue queue;
+	NullRequest request;
+	vector<thread> threads;
+	long perProducer = iterations / producers;
+	long total = perProducer * producers;
+	atomic<long> consumed(0);
+	for (int i = 0; i < consumers; i++)
+	{
+		threads.emplace_back([&queue, &consumed, total]() {
+			while (consumed.fetch_add(1) < total)
+				queue.pop();
+		});
+	}
+	for (int i = 0; i < producers; i++)
+	{
+		threads.emplace_back([&queue, &request, perProducer]() {
+			for (long j = 0; j < perProducer; j++)
+				queue.push(&request);
+		});
+	}
+	for (auto& t : threads)
+		t.join();
+}
+
+/**
+ * Journal and complete requests from a number of threads, the cost of
+ * journaling a request on intake
+ *
+ * @param journal	The request journal
+ * @param values	The values of the requests
+ * @param threads	The number of threads accepting requests
+ * @param iterations	The total number of requests
+ */
+static void journalIntake(RequestJournal *journal, KVList values, int threads, long iterations)
+{
+	vector<thread> workers;
+	long perThread = iterations / threads;
+	for (int i = 0; i < threads; i++)
+	{
+		workers.emplace_back([journal, &values, perThread]() {
+			for (long j = 0; j < perThread; j++)
+			{
+				ControlWriteServiceRequest request("south", values);
+				request.setTraceId("00000000000000000000000000000001");
+				journal->append(&request);
+				journal->complete(request.getJournalSequence());
+			}
+		});
+	}
+	for (auto& t : workers)
+		t.join();
+}
+
+int main(int argc, char *argv[])
+{
+	string filter;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+			minTime = atof(argv[++i]);
+		else
+		{
+			fprintf(stderr, "Usage: %s [--filter <substring>] [--min-time <seconds>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	Logger *logger = new Logger("dispatcher_benchmark");
+	DebugLog::setMinLevel(logger, "warning");
+
+	vector<Benchmark> benchmarks;
+
+	// KVList primitives for small and large requests
+	for (int size : { 4, 32 })
+	{
+		string suffix = "/" + to_string(size);
+		string object = makeObject(size);
+		auto doc = make_shared<Document>();
+		doc->Parse(object.c_str());
+		auto list = make_shared<KVList>(*doc);
+
+		benchmarks.push_back(Benchmark("kvlist_construct" + suffix, [doc](long n) {
+			for (long i = 0; i < n; i++)
+			{
+				KVList values(*doc);
+				doNotOptimise(values);
+			}
+		}));
+		benchmarks.push_back(Benchmark("kvlist_copy" + suffix, [list](long n) {
+			for (long i = 0; i < n; i++)
+			{
+				KVList values(*list);
+				doNotOptimise(values);
+			}
+		}));
+		string last = "key" + to_string(size - 1);
+		benchmarks.push_back(Benchmark("kvlist_getValue" + suffix, [list, last](long n) {
+			for (long i = 0; i < n; i++)
+				doNotOptimise(list->getValue(last));
+		}));
+		benchmarks.push_back(Benchmark("kvlist_toJSON" + suffix, [list](long n) {
+			for (long i = 0; i < n; i++)
+				doNotOptimise(list->toJSON());
+		}));
+		benchmarks.push_back(Benchmark("kvlist_toReading" + suffix, [list](long n) {
+			for (long i = 0; i < n; i++)
+				delete list->toReading("reading");
+		}));
+		auto reading = shared_ptr<Reading>(list->toReading("reading"));
+		benchmarks.push_back(Benchmark("kvlist_fromReading" + suffix, [reading](long n) {
+			for (long i = 0; i < n; i++)
+			{
+				KVList values;
+				values.fromReading(reading.get());
+				doNotOptimise(values);
+			}
+		}));
+
+		// Substitution includes the copy of the template list
+		auto templ = make_shared<KVList>();
+		for (int i = 0; i < size; i++)
+			templ->add("key" + to_string(i), "$param" + to_string(i % 4) + "$ units");
+		auto params = make_shared<KVList>();
+		for (int i = 0; i < 4; i++)
+			params->add("param" + to_string(i), to_string(i * 3));
+		benchmarks.push_back(Benchmark("kvlist_substitute" + suffix, [templ, params](long n) {
+			for (long i = 0; i < n; i++)
+			{
+				KVList values(*templ);
+				values.substitute(*params);
+				doNotOptimise(values);
+			}
+		}));
+	}
+
+	const char *types[] = { "integer", "float", "string" };
+	const char *samples[] = { "1234567", "1234.567", "open_valve" };
+	for (int i = 0; i < 3; i++)
+	{
+		string sample = samples[i];
+		benchmarks.push_back(Benchmark(string("kvlist_deduceType/") + types[i], [sample](long n) {
+			for (long j = 0; j < n; j++)
+				doNotOptimise(KVList::deduceType(sample));
+		}));
+	}
+
+	// Pipeline endpoint matching
+	PipelineEndpoint service(PipelineEndpoint::EndpointService, "south1");
+	PipelineEndpoint other(PipelineEndpoint::EndpointService, "south2");
+	PipelineEndpoint any(PipelineEndpoint::EndpointAny);
+	benchmarks.push_back(Benchmark("endpoint_match/hit", [service](long n) {
+		for (long i = 0; i < n; i++)
+			doNotOptimise(service.match(service));
+	}));
+	benchmarks.push_back(Benchmark("endpoint_match/miss", [service, other](long n) {
+		for (long i = 0; i < n; i++)
+			doNotOptimise(service.match(other));
+	}));
+	benchmarks.push_back(Benchmark("endpoint_match/any", [any, service](long n) {
+		for (long i = 0; i < n; i++)
+			doNotOptimise(any.match(service));
+	}));
+
+	// Pipeline lookup with increasing numbers of pipelines
+	for (int count : { 1, 10, 100, 1000 })
+	{
+		shared_ptr<ControlPipelineManager> manager(makeManager(count));
+		int middle = count / 2;
+		PipelineEndpoint source(PipelineEndpoint::EndpointService, "source" + to_string(middle));
+		PipelineEndpoint dest(PipelineEndpoint::EndpointService, "south" + to_string(middle));
+		PipelineEndpoint missing(PipelineEndpoint::EndpointService, "missing");
+		benchmarks.push_back(Benchmark("findPipeline/hit/" + to_string(count), [manager, source, dest](long n) {
+			for (long i = 0; i < n; i++)
+			{
+				ControlPipeline *pipeline = manager->findPipeline(source, dest);
+				doNotOptimise(pipeline);
+				pipeline->release();
+			}
+		}));
+		benchmarks.push_back(Benchmark("findPipeline/miss/" + to_string(count), [manager, missing](long n) {
+			for (long i = 0; i < n; i++)
+				doNotOptimise(manager->findPipeline(missing, missing));
+		}));
+	}
+
+	// Debug logging of a request at the default log level, the eager form
+	// builds the message arguments that the logger then discards
+	for (int size : { 4, 32 })
+	{
+		string suffix = "/" + to_string(size);
+		Document doc;
+		doc.Parse(makeObject(size).c_str());
+		KVList values(doc);
+		auto reading = shared_ptr<Reading>(values.toReading("reading"));
+		PipelineEndpoint source(PipelineEndpoint::EndpointAPI, "caller");
+		PipelineEndpoint dest(PipelineEndpoint::EndpointService, "south1");
+		benchmarks.push_back(Benchmark("debug_log/eager" + suffix, [logger, reading, source, dest](long n) {
+			for (long i = 0; i < n; i++)
+			{
+				logger->debug("Filtering %s", reading->toJSON().c_str());
+				logger->debug("Source %s to destination %s", source.toString().c_str(), dest.toString().c_str());
+			}
+		}));
+		benchmarks.push_back(Benchmark("debug_log/lazy" + suffix, [logger, reading, source, dest](long n) {
+			for (long i = 0; i < n; i++)
+			{
+				DEBUG_LOG(logger, "Filtering %s", reading->toJSON().c_str());
+				DEBUG_LOG(logger, "Source %s to destination %s", source.toString().c_str(), dest.toString().c_str());
+				doNotOptimise(i);
+			}
+		}));
+	}
+
+	// Uncontended lock and unlock of the mutexes used by the dispatcher,
+	// the profiled mutex with profiling disabled should match std::mutex
+	auto plainMutex = make_shared<mutex>();
+	auto profiledMutex = make_shared<ProfiledMutex>(LockRequestQueue);
+	benchmarks.push_back(Benchmark("lock/std_mutex", [plainMutex](long n) {
+		for (long i = 0; i < n; i++)
+		{
+			lock_guard<mutex> guard(*plainMutex);
+			doNotOptimise(i);
+		}
+	}));
+	benchmarks.push_back(Benchmark("lock/profiled_disabled", [profiledMutex](long n) {
+		for (long i = 0; i < n; i++)
+		{
+			lock_guard<ProfiledMutex> guard(*profiledMutex);
+			doNotOptimise(i);
+		}
+	}));
+	benchmarks.push_back(Benchmark("lock/profiled_enabled", [profiledMutex](long n) {
+		LockProfiler::getInstance()->enable(true);
+		for (long i = 0; i < n; i++)
+		{
+			lock_guard<ProfiledMutex> guard(*profiledMutex);
+			doNotOptimise(i);
+		}
+		LockProfiler::getInstance()->enable(false);
+	}));
+
+	// Request queue under contention
+	for (int threads : { 1, 2, 4, 8 })
+	{
+		benchmarks.push_back(Benchmark("queue_push_pop/" + to_string(threads) + "x" + to_string(threads),
+			[threads](long n) {
+				queueContention(threads, threads, n < threads ? threads : n);
+			}));
+	}
+
+	// Request journal intake at each durability level
+	Document journalDoc;
+	journalDoc.Parse(makeObject(4).c_str());
+	KVList journalValues(journalDoc);
+	vector<string> journalPaths;
+	vector<shared_ptr<RequestJournal> > journals;
+	const struct {
+		const char		*name;
+		JournalDurability	durability;
+	} levels[] = {
+		{ "off", JournalOff },
+		{ "buffered", JournalBuffered },
+		{ "group", JournalGroup },
+		{ "sync", JournalSync }
+	};
+	for (auto& level : levels)
+	{
+		string path = "/tmp/dispatcher_benchmark_" + to_string(getpid()) + "_" + level.name + ".journal";
+		shared_ptr<RequestJournal> journal(new RequestJournal(path, level.durability));
+		if (level.durability != JournalOff && !journal->open())
+			continue;
+		journalPaths.push_back(path);
+		journals.push_back(journal);
+		for (int threads : { 1, 4 })
+		{
+			benchmarks.push_back(Benchmark(string("journal_intake/") + level.name + "/" + to_string(threads),
+				[journal, journalValues, threads](long n) {
+					journalIntake(journal.get(), journalValues, threads, n < threads ? threads : n);
+				}));
+		}
+	}
+
+	string results;
+	for (auto& benchmark : benchmarks)
+	{
+		if (filter.empty() || benchmark.m_name.find(filter) != string::npos)
+			run(benchmark, results);
+	}
+
+	char host[128] = "unknown";
+	gethostname(host, sizeof(host) - 1);
+	char date[64];
+	time_t now = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	printf("{\n  \"context\" : { \"date\" : \"%s\", \"host\" : \"%s\", \"cpus\" : %u, \"min_time\" : %.2f },\n",
+			date, host, thread::hardware_concurrency(), minTime);
+	printf("  \"benchmarks\" : [\n%s\n  ]\n}\n", results.c_str());
+
+	journals.clear();
+	for (auto& path : journalPaths)
+		unlink(path.c_str());
+	return 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ * Benchmark of a control pipeline using the real filter plugins. The
+ * pipeline and the configuration of its filters are read from a local
+ * file rather than the Fledge core, the plugins are loaded from the
+ * Fledge installation given by FLEDGE_ROOT. Synthetic control requests
+ * are driven through the pipeline as fast as possible and the throughput
+ * and latency of each stage of the pipeline are written to stdout as a
+ * JSON document.
+ *
+ * The configuration file contains the ordered list of filters in the
+ * pipeline, the filter configuration and optionally the control request
+ * to send, e.g.
+ *
+ *   {
+ *     "pipeline" : [ "scale1", "#native:clamp {\"max\" : 100}" ],
+ *     "request" : { "speed" : "42" },
+ *     "filters" : { "scale1" : { "plugin" : "scale", "factor" : "2" } }
+ *   }
+ *
+ * If no request is given one with --values keys is generated.
+ *
+ * Usage: pipeline_benchmark --config <file> [--duration <seconds>]
+ *			[--values <count>] [--no-trace]
+ */
+#include <pipeline_execution.h>
+#include <pipeline_trace.h>
+#include <filter_config.h>
+#include <kvlist.h>
+#include <latency.h>
+#include <logger.h>
+#include <debug_log.h>
+#include <string_utils.h>
+#include <rapidjson/document.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * The latency of a stage of the pipeline
+ */
+class StageLatency {
+	public:
+		StageLatency(const string& name) : m_name(name), m_max(0) {};
+		string			m_name;
+		LatencyHistogram	m_histogram;	// Nanoseconds
+		uint64_t		m_max;
+};
+
+/**
+ * Record a latency against a stage
+ *
+ * @param stage		The stage
+ * @param duration	The latency in nanoseconds
+ */
+static void record(StageLatency& stage, uint64_t duration)
+{
+	stage.m_histogram.record(duration);
+	if (duration > stage.m_max)
+		stage.m_max = duration;
+}
+
+/**
+ * Return the JSON representation of the latency of a stage
+ *
+ * @param stage		The stage
+ * @return string	The JSON object
+ */
+static string toJSON(const StageLatency& stage)
+{
+	const LatencyHistogram& histogram = stage.m_histogram;
+	double mean = histogram.getCount() ? (double)histogram.getSum() / histogram.getCount() : 0.0;
+	char buf[256];
+	snprintf(buf, sizeof(buf),
+		"\"count\" : %lu, \"mean_ns\" : %.0f, \"p50_ns\" : %lu, \"p99_ns\" : %lu, \"p999_ns\" : %lu, \"max_ns\" : %lu",
+		(unsigned long)histogram.getCount(), mean,
+		(unsigned long)histogram.quantile(0.5),
+		(unsigned long)histogram.quantile(0.99),
+		(unsigned long)histogram.quantile(0.999),
+		(unsigned long)stage.m_max);
+	string name = stage.m_name;
+	StringEscapeQuotes(name);
+	return "{ \"stage\" : \"" + name + "\", " + buf + " }";
+}
+
+/**
+ * Create a control request with a number of keys
+ *
+ * @param count	The number of keys
+ * @return string	The JSON object
+ */
+static string makeRequest(int count)
+{
+	string json = "{";
+	for (int i = 0; i < count; i++)
+	{
+		if (i)
+			json += ", ";
+		json += "\"key" + to_string(i) + "\" : \"" + to_string(i * 17) + "\"";
+	}
+	json += "}";
+	return json;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s --config <file> [--duration <seconds>] [--values <count>] [--no-trace]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	string configFile;
+	double duration = 5.0;
+	int valueCount = 4;
+	bool tracing = true;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+			configFile = argv[++i];
+		else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc)
+			duration = atof(argv[++i]);
+		else if (strcmp(argv[i], "--values") == 0 && i + 1 < argc)
+			valueCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--no-trace") == 0)
+			tracing = false;
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (configFile.empty() || duration <= 0 || valueCount <= 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if (!getenv("FLEDGE_ROOT"))
+	{
+		fprintf(stderr, "FLEDGE_ROOT must be set to the Fledge installation that contains the filter plugins\n");
+		return 1;
+	}
+
+	Logger *logger = new Logger("pipeline_benchmark");
+	DebugLog::setMinLevel(logger, "warning");
+
+	FilterConfigProvider *provider;
+	try {
+		provider = new FileConfigProvider(configFile);
+	} catch (exception& e) {
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+
+	// Read the pipeline and the request from the configuration file
+	ifstream file(configFile);
+	stringstream content;
+	content << file.rdbuf();
+	Document config;
+	config.Parse(content.str().c_str());
+	if (!config.HasMember("pipeline") || !config["pipeline"].IsArray())
+	{
+		fprintf(stderr, "The configuration file %s does not contain a pipeline array\n", configFile.c_str());
+		return 1;
+	}
+	vector<string> pipeline;
+	for (auto& filter : config["pipeline"].GetArray())
+	{
+		if (filter.IsString())
+			pipeline.push_back(filter.GetString());
+	}
+	Document synthetic;
+	synthetic.Parse(makeRequest(valueCount).c_str());
+	bool haveRequest = config.HasMember("request") && config["request"].IsObject();
+	KVList values(haveRequest ? config["request"] : synthetic);
+
+	PipelineExecutionContext context(provider, "benchmark", pipeline);
+
+	// The first request loads and initialises the filter plugins
+	auto loadStart = chrono::steady_clock::now();
+	{
+		KVList first(values);
+		string name = "reading";
+		context.filter(first, name);
+	}
+	double loadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - loadStart).count();
+
+	StageLatency total("total");
+	vector<StageLatency *> stages;
+	long requests = 0, removed = 0;
+	auto start = chrono::steady_clock::now();
+	auto end = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(duration));
+	auto now = start;
+	while (now < end)
+	{
+		KVList copy(values);
+		string name = "reading";
+		PipelineTrace trace;
+		auto requestStart = chrono::steady_clock::now();
+		bool forward = context.filter(copy, name, tracing ? &trace : NULL);
+		now = chrono::steady_clock::now();
+		record(total, chrono::duration_cast<chrono::nanoseconds>(now - requestStart).count());
+		requests++;
+		if (!forward)
+			removed++;
+		for (size_t i = 0; i < trace.getStageCount(); i++)
+		{
+			const string& stageName = trace.getStageName(i);
+			StageLatency *stage = NULL;
+			for (auto s : stages)
+			{
+				if (s->m_name.compare(stageName) == 0)
+				{
+					stage = s;
+					break;
+				}
+			}
+			if (!stage)
+			{
+				stage = new StageLatency(stageName);
+				stages.push_back(stage);
+			}
+			record(*stage, trace.getStageDuration(i));
+		}
+	}
+	double elapsed = chrono::duration<double>(now - start).count();
+
+	char host[128] = "unknown";
+	gethostname(host, sizeof(host) - 1);
+	char date[64];
+	time_t t = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+
+	string filters;
+	for (auto& filter : pipeline)
+	{
+		string name = filter;
+		StringEscapeQuotes(name);
+		if (!filters.empty())
+			filters += ", ";
+		filters += "\"" + name + "\"";
+	}
+	printf("{\n  \"context\" : { \"date\" : \"%s\", \"host\" : \"%s\", \"cpus\" : %u, \"duration\" : %.2f, \"trace\" : %s },\n",
+			date, host, thread::hardware_concurrency(), elapsed, tracing ? "true" : "false");
+	printf("  \"pipeline\" : [ %s ],\n", filters.c_str());
+	printf("  \"load_ms\" : %.2f,\n", loadMs);
+	printf("  \"requests\" : %ld,\n  \"removed\" : %ld,\n  \"requests_per_sec\" : %.0f,\n",
+			requests, removed, requests / elapsed);
+	printf("  \"total\" : %s,\n", toJSON(total).c_str());
+	printf("  \"stages\" : [\n");
+	for (size_t i = 0; i < stages.size(); i++)
+	{
+		printf("    %s%s\n", toJSON(*stages[i]).c_str(), i + 1 < stages.size() ? "," : "");
+		fprintf(stderr, "%-40s %12.0f ns mean\n", stages[i]->m_name.c_str(),
+				stages[i]->m_histogram.getCount() ?
+				(double)stages[i]->m_histogram.getSum() / stages[i]->m_histogram.getCount() : 0.0);
+	}
+	printf("  ]\n}\n");
+	fprintf(stderr, "%-40s %12.0f requests/sec\n", "total", requests / elapsed);
+
+	for (auto stage : stages)
+		delete stage;
+	return 0;
+}
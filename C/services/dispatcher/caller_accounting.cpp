@@ -0,0 +1,164 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <caller_accounting.h>
+#include <controlrequest.h>
+#include <statistics.h>
+#include <latency.h>
+#include <metrics.h>
+#include <string_utils.h>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Return the singleton caller accounting
+ *
+ * @return CallerAccounting*	The caller accounting
+ */
+CallerAccounting *CallerAccounting::getInstance()
+{
+	static CallerAccounting instance;
+	return &instance;
+}
+
+/**
+ * Constructor for the caller accounting
+ */
+CallerAccounting::CallerAccounting() : m_statistics(NULL)
+{
+}
+
+/**
+ * Set the control statistics that hold the per-caller counts
+ *
+ * @param statistics	The control statistics or NULL if there are none
+ */
+void CallerAccounting::setStatistics(ControlStatistics *statistics)
+{
+	m_statistics.store(statistics);
+}
+
+/**
+ * Account for the resources consumed by a completed control request. The
+ * worker time is the time from the request being taken from the queue
+ * until it completed. The number of requests, deliveries and failures
+ * of the caller are counted by the control statistics as they occur.
+ *
+ * @param request	The completed control request
+ */
+void CallerAccounting::record(ControlRequest *request)
+{
+	ControlStatistics *statistics = m_statistics.load();
+	if (!statistics)
+		return;
+
+	const RequestTimings& timings = request->getTimings();
+	int64_t completed = RequestTimings::now();
+	uint64_t workerTime = 0, filterTime = 0, deliveryTime = 0;
+	if (timings.m_dequeued)
+		workerTime = (completed - timings.m_dequeued) / 1000;
+	int64_t duration = timings.duration(LatencyFilter, completed);
+	if (duration > 0)
+		filterTime = duration;
+	duration = timings.duration(LatencyDeliver, completed);
+	if (duration > 0)
+		deliveryTime = duration;
+	statistics->account(request->getCallerName(), workerTime, filterTime, deliveryTime);
+}
+
+/**
+ * Return the totals of each caller in the Prometheus text exposition format
+ *
+ * @return string	The caller metrics
+ */
+string CallerAccounting::toPrometheus()
+{
+	ControlStatistics *statistics = m_statistics.load();
+	if (!statistics)
+		return "";
+
+	static const struct {
+		const char	*name;
+		const char	*help;
+		int		statistic;	// The statistic or -1 for a time
+		uint64_t	CallerTotals::*time;
+	} counters[] = {
+		{ "dispatcher_caller_requests_total", "Control requests received per caller", StatisticReceived, NULL },
+		{ "dispatcher_caller_filtered_total", "Control requests removed by a control pipeline per caller", StatisticFiltered, NULL },
+		{ "dispatcher_caller_deliveries_total", "Successful deliveries of control requests per caller", StatisticDelivered, NULL },
+		{ "dispatcher_caller_failures_total", "Failed deliveries of control requests per caller", StatisticFailed, NULL },
+		{ "dispatcher_caller_worker_microseconds_total", "Worker time consumed by control requests per caller", -1, &CallerTotals::m_workerTime },
+		{ "dispatcher_caller_filter_microseconds_total", "Control pipeline time consumed by control requests per caller", -1, &CallerTotals::m_filterTime },
+		{ "dispatcher_caller_delivery_microseconds_total", "Delivery time consumed by control requests per caller", -1, &CallerTotals::m_deliveryTime }
+	};
+
+	vector<CallerTotals> callers = statistics->getCallers();
+	string result;
+	for (auto& counter : counters)
+	{
+		result += string("# HELP ") + counter.name + " " + counter.help + "\n";
+		result += string("# TYPE ") + counter.name + " counter\n";
+		for (auto& caller : callers)
+		{
+			uint64_t value = counter.statistic >= 0 ? caller.m_counts[counter.statistic]
+						: caller.*counter.time;
+			result += string(counter.name) + "{caller=\"" + DispatcherMetrics::escapeLabel(caller.m_caller)
+				+ "\"} " + to_string(value) + "\n";
+		}
+	}
+	return result;
+}
+
+/**
+ * Return the totals of each caller as a JSON document. The callers are
+ * ordered by the worker time they have consumed, the share of the total
+ * worker time consumed by each caller is included.
+ *
+ * @return string	The JSON document
+ */
+string CallerAccounting::toJSON()
+{
+	vector<CallerTotals> totals;
+	ControlStatistics *statistics = m_statistics.load();
+	if (statistics)
+		totals = statistics->getCallers();
+	uint64_t totalWorkerTime = 0;
+	for (auto& t : totals)
+		totalWorkerTime += t.m_workerTime;
+	sort(totals.begin(), totals.end(), [](const CallerTotals& a, const CallerTotals& b) {
+			return a.m_workerTime > b.m_workerTime;
+		});
+
+	string json = "{ \"worker_us\" : " + to_string(totalWorkerTime) + ", \"callers\" : [ ";
+	for (size_t i = 0; i < totals.size(); i++)
+	{
+		const CallerTotals& t = totals[i];
+		string name = t.m_caller;
+		StringEscapeQuotes(name);
+		char share[32];
+		snprintf(share, sizeof(share), "%.2f",
+			totalWorkerTime ? (100.0 * t.m_workerTime) / totalWorkerTime : 0.0);
+		if (i)
+			json += ", ";
+		json += "{ \"caller\" : \"" + name + "\"";
+		json += ", \"requests\" : " + to_string(t.m_counts[StatisticReceived]);
+		json += ", \"filtered\" : " + to_string(t.m_counts[StatisticFiltered]);
+		json += ", \"deliveries\" : " + to_string(t.m_counts[StatisticDelivered]);
+		json += ", \"failures\" : " + to_string(t.m_counts[StatisticFailed]);
+		json += ", \"worker_us\" : " + to_string(t.m_workerTime);
+		json += ", \"filter_us\" : " + to_string(t.m_filterTime);
+		json += ", \"delivery_us\" : " + to_string(t.m_deliveryTime);
+		json += ", \"worker_share\" : " + string(share) + " }";
+	}
+	json += " ] }";
+	return json;
+}
@@ -11,6 +11,8 @@
 #include <controlpipeline.h>
 #include <pipeline_manager.h>
 #include <pipeline_execution.h>
+#include <string_utils.h>
+#include <debug_log.h>
 #include <algorithm>
 
 using namespace std;
@@ -21,7 +23,8 @@ using namespace std;
  * @param name	The name of the control pipeline
  */
 ControlPipeline::ControlPipeline(ControlPipelineManager *manager, const string& name) : m_name(name),
-	m_enable(true), m_exclusive(false), m_sharedContext(NULL), m_manager(manager)
+	m_enable(true), m_exclusive(false), m_sharedContext(NULL), m_manager(manager),
+	m_references(1), m_contextMutex(LockPipelineContexts)
 {
 	m_logger = Logger::getLogger();
 }
@@ -32,12 +35,27 @@ ControlPipeline::ControlPipeline(ControlPipelineManager *manager, const string&
 ControlPipeline::~ControlPipeline()
 {
 	if (m_sharedContext)
-		delete m_sharedContext;
+		m_sharedContext->release();
 	m_sharedContext = NULL;
+	for (auto& ends : m_contexts)
+		delete ends;
+	m_contexts.clear();
+}
+
+/**
+ * Release a reference to the pipeline. The pipeline is deleted when the
+ * last reference is released.
+ */
+void ControlPipeline::release()
+{
+	if (m_references.fetch_sub(1) == 1)
+		delete this;
 }
 
 /**
- * Return an execution context that can be used to execute the pipeline
+ * Return an execution context that can be used to execute the pipeline.
+ * A reference is added to the context, the caller must release the context
+ * once the execution is complete.
  *
  * @param source	The pipeline endpoint source
  * @param dest		The pipeline endpoint destination
@@ -46,7 +64,7 @@ ControlPipeline::~ControlPipeline()
 PipelineExecutionContext *
 ControlPipeline::getExecutionContext(const PipelineEndpoint& source, const PipelineEndpoint& dest)
 {
-	lock_guard<mutex> guard(m_contextMutex);	// Stop the context beign handed out
+	lock_guard<ProfiledMutex> guard(m_contextMutex);	// Stop the context beign handed out
 	if (!m_exclusive)
 	{
 		if (!m_sharedContext)
@@ -54,30 +72,80 @@ ControlPipeline::getExecutionContext(const PipelineEndpoint& source, const Pipel
 			m_sharedContext = new PipelineExecutionContext(m_manager->getManagementClient(), m_name, m_pipeline);
 			m_sharedContext->setPipelineManager(m_manager);
 		}
-		m_logger->info("Using shared context for control pipeline '%s' from '%s' to '%s'",
+		DEBUG_LOG(m_logger, "Using shared context for control pipeline '%s' from '%s' to '%s'",
 				m_name.c_str(), source.toString().c_str(), dest.toString().c_str());
+		m_sharedContext->acquire();
 		return m_sharedContext;
 	}
 
 	// We need an exclusive context for this source/destination pair
-	ContextEndpoints ends(source, dest);
+	ContextEndpoints match(source, dest);
 	PipelineExecutionContext *context = NULL;
 	for (auto& it : m_contexts)
 	{
-		if (it == ends)
+		if (*it == match)
 		{
-			return it.getContext();
+			context = it->getContext();
+			context->acquire();
+			return context;
 		}
 	}
 	m_logger->info("Create new context to run pipeline '%s' between '%s' and '%s'",
 			m_name.c_str(), source.toString().c_str(), dest.toString().c_str());
 	context = new PipelineExecutionContext(m_manager->getManagementClient(), m_name, m_pipeline);
 	context->setPipelineManager(m_manager);
-	ends.setContext(context);
+	ContextEndpoints *ends = new ContextEndpoints(context, source, dest);
 	m_contexts.push_back(ends);
+	context->acquire();
 	return context;
 }
 
+/**
+ * Create a throwaway execution context in which to dry run the pipeline.
+ * The context is not shared with any other request, so the dry run does
+ * not change the state of the filters used by live requests. The caller
+ * must release the context.
+ *
+ * @return PipelineExecutionContext*	The context to dry run the pipeline within
+ */
+PipelineExecutionContext *ControlPipeline::createDryRunContext()
+{
+	lock_guard<ProfiledMutex> guard(m_contextMutex);
+	PipelineExecutionContext *context = new PipelineExecutionContext(m_manager->getManagementClient(), m_name, m_pipeline);
+	context->setPipelineManager(m_manager);
+	return context;
+}
+
+/**
+ * Determine if the pipeline should be applied to a control request. This
+ * tests the request against the predicate of the pipeline, if any. The
+ * predicate is read without taking the context mutex, which is held
+ * whilst filter plugins are loaded.
+ *
+ * @param values	The key/value list of the control request
+ * @param operation	The operation name or NULL for a write request
+ * @return bool		True if the pipeline should be applied to the request
+ */
+bool ControlPipeline::accepts(const KVList& values, const string *operation)
+{
+	shared_ptr<const PipelinePredicate> predicate = atomic_load(&m_predicate);
+	return !predicate || predicate->matches(values, operation);
+}
+
+/**
+ * Compile the predicate of the pipeline. The compiled predicate is never
+ * modified once it is published, requests that are testing the previous
+ * predicate continue to use it until they drop their reference.
+ *
+ * Must be called with the context mutex held.
+ */
+void ControlPipeline::compilePredicate()
+{
+	PipelinePredicate *predicate = new PipelinePredicate();
+	predicate->compile(m_pipeline);
+	atomic_store(&m_predicate, shared_ptr<const PipelinePredicate>(predicate));
+}
+
 /**
  * Add a new filter into an exisitng pipeline
  *
@@ -86,19 +154,23 @@ ControlPipeline::getExecutionContext(const PipelineEndpoint& source, const Pipel
  */
 void ControlPipeline::addFilter(const string& filter, int order)
 {
+	// Update the contexts that exist for the pipeline
+	lock_guard<ProfiledMutex> guard(m_contextMutex);	// Stop the context being handed out
 	// Add the filter into the pipeline vector
 	auto it = m_pipeline.begin();
 	it += (order - 1);
 	m_pipeline.insert(it, filter);
-	// Update the contexts that exist for the pipeline
-	lock_guard<mutex> guard(m_contextMutex);	// Stop the context being handed out
+	if (PipelinePredicate::isPredicate(filter))
+	{
+		compilePredicate();
+	}
 	if (m_sharedContext)
 	{
 		m_sharedContext->addFilter(filter, order);
 	}
 	for (auto &ends : m_contexts)
 	{
-		ends.getContext()->addFilter(filter, order);
+		ends->getContext()->addFilter(filter, order);
 	}
 }
 
@@ -109,13 +181,17 @@ void ControlPipeline::addFilter(const string& filter, int order)
  */
 void ControlPipeline::removeFilter(const string& filter)
 {
-	lock_guard<mutex> guard(m_contextMutex);
+	lock_guard<ProfiledMutex> guard(m_contextMutex);
 
 	auto it = std::find(m_pipeline.begin(), m_pipeline.end(), filter);
 	if(it != m_pipeline.end())
 	{
 		m_pipeline.erase(it);
 	}
+	if (PipelinePredicate::isPredicate(filter))
+	{
+		compilePredicate();
+	}
 
 	if (m_sharedContext)
 	{
@@ -123,7 +199,7 @@ void ControlPipeline::removeFilter(const string& filter)
 	}
 	for (auto &ends : m_contexts)
 	{
-		ends.getContext()->removeFilter(filter);
+		ends->getContext()->removeFilter(filter);
 	}
 }
 
@@ -145,7 +221,7 @@ void ControlPipeline::reorder(const string& filter, int order)
 	}
 
 	// An update is required
-	lock_guard<mutex> guard(m_contextMutex);
+	lock_guard<ProfiledMutex> guard(m_contextMutex);
 
 	for (int currentPosition = 0; currentPosition < m_pipeline.size(); currentPosition++)
 	{
@@ -160,7 +236,7 @@ void ControlPipeline::reorder(const string& filter, int order)
 			}
 			for (auto &ends : m_contexts)
 			{
-				ends.getContext()->reorder(filter, order);
+				ends->getContext()->reorder(filter, order);
 			}
 			return;
 		}
@@ -174,22 +250,110 @@ void ControlPipeline::reorder(const string& filter, int order)
  */
 void ControlPipeline::removeAllContexts()
 {
-	lock_guard<mutex> guard(m_contextMutex);
+	lock_guard<ProfiledMutex> guard(m_contextMutex);
 	if (m_sharedContext)
 	{
-		delete m_sharedContext;
+		m_sharedContext->release();
 	}
 	m_sharedContext = NULL;
+	for (auto& ends : m_contexts)
+		delete ends;
 	m_contexts.clear();
 }
 
+/**
+ * Quarantine an execution context of the pipeline. The context is
+ * removed from the pipeline such that subsequent requests will use a
+ * new context. The reference the pipeline holds on the context is
+ * released, the context is deleted once the worker thread that is still
+ * executing within the context releases its references.
+ *
+ * @param context	The execution context to quarantine
+ * @return bool		True if the context was removed from the pipeline
+ */
+bool ControlPipeline::quarantine(PipelineExecutionContext *context)
+{
+	lock_guard<ProfiledMutex> guard(m_contextMutex);
+	bool found = false;
+	if (m_sharedContext == context)
+	{
+		m_sharedContext = NULL;
+		found = true;
+	}
+	for (auto it = m_contexts.begin(); it != m_contexts.end() && !found; ++it)
+	{
+		if ((*it)->getContext() == context)
+		{
+			(*it)->releaseContext();
+			delete *it;
+			m_contexts.erase(it);
+			found = true;
+			break;
+		}
+	}
+	if (!found)
+	{
+		// The context has already been removed from the pipeline
+		return false;
+	}
+	context->release();
+	m_logger->warn("An execution context of control pipeline '%s' has been quarantined",
+			m_name.c_str());
+	return true;
+}
+
+/**
+ * Return a JSON description of the pipeline and the execution contexts
+ * that are currently loaded for it
+ *
+ * @return string	The JSON object describing the pipeline
+ */
+string ControlPipeline::toJSON()
+{
+	string name = m_name;
+	StringEscapeQuotes(name);
+	string json = "{ \"name\" : \"" + name + "\"";
+	json += ", \"enabled\" : ";
+	json += m_enable ? "true" : "false";
+	json += ", \"exclusive\" : ";
+	json += m_exclusive ? "true" : "false";
+
+	lock_guard<ProfiledMutex> guard(m_contextMutex);
+	json += ", \"filters\" : " + to_string(m_pipeline.size());
+	json += ", \"contexts\" : [ ";
+	bool first = true;
+	if (m_sharedContext)
+	{
+		json += "{ \"shared\" : true, \"context\" : " + m_sharedContext->toJSON() + " }";
+		first = false;
+	}
+	for (auto& ends : m_contexts)
+	{
+		if (!ends->getContext())
+			continue;
+		string source = ends->getSource().toString();
+		string destination = ends->getDestination().toString();
+		StringEscapeQuotes(source);
+		StringEscapeQuotes(destination);
+		if (!first)
+			json += ", ";
+		first = false;
+		json += "{ \"shared\" : false, \"source\" : \"" + source + "\"";
+		json += ", \"destination\" : \"" + destination + "\"";
+		json += ", \"context\" : " + ends->getContext()->toJSON() + " }";
+	}
+	json += " ] }";
+	return json;
+}
+
 /*
- * Destructor for the pipeline execution context endpoints
+ * Destructor for the pipeline execution context endpoints. The context is
+ * only deleted once any requests executing in the context have completed.
  */
 ContextEndpoints::~ContextEndpoints()
 {
 	if (m_context)
-		delete m_context;
+		m_context->release();
 }
 
 /**
@@ -200,7 +364,7 @@ ContextEndpoints::~ContextEndpoints()
 void ContextEndpoints::setContext(PipelineExecutionContext *context)
 {
 	if (m_context)
-		delete m_context;
+		m_context->release();
 	m_context = context;
 }
 
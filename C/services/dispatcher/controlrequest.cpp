@@ -14,6 +14,11 @@
 #include <asset_tracking.h>
 #include <pipeline_execution.h>
 #include <controlpipeline.h>
+#include <watchdog.h>
+#include <metrics.h>
+#include <debug_log.h>
+#include <async_logger.h>
+#include <dispatcher_probes.h>
 
 using namespace std;
 
@@ -26,18 +31,17 @@ using namespace std;
 void ControlWriteServiceRequest::execute(DispatcherService *service)
 {
 	filter(service->getPipelineManager());
-	string payload = "{ \"values\" : ";
-	payload += m_values.toJSON();
-	payload += " }";
+	string payload = getPayload();
 
-	Logger::getLogger()->debug("Send payload to service '%s'", payload.c_str());
+	DEBUG_LOG(Logger::getLogger(), "Send payload to service '%s'", payload.c_str());
 
 	// Pass m_source_name & m_source_type to south service
 	service->sendToService(m_service,
 				"/fledge/south/setpoint",
 				payload,
 				m_source_name,
-				m_source_type);
+				m_source_type,
+				m_traceId);
 }
 
 /**
@@ -51,9 +55,7 @@ void ControlWriteBroadcastRequest::execute(DispatcherService *service)
 	vector<ServiceRecord *> services;
 	service->getMgmtClient()->getServices(services, "Southbound");
 
-	string payload = "{ \"values\" : ";
-	payload += m_values.toJSON();
-	payload += " }";
+	string payload = getPayload();
 	
 	for (auto& record : services)
 	{
@@ -63,9 +65,10 @@ void ControlWriteBroadcastRequest::execute(DispatcherService *service)
 						"/fledge/south/setpoint",
 						payload,
 						m_source_name,
-						m_source_type);
+						m_source_type,
+						m_traceId);
 		} catch (...) {
-			Logger::getLogger()->info("Service '%s' does not support write operation", record->getName().c_str());
+			AsyncLogger::getInstance()->info("Service '%s' does not support write operation", record->getName().c_str());
 		}
 	}
 }
@@ -84,6 +87,7 @@ void ControlWriteScriptRequest::execute(DispatcherService *service)
 	script.setSourceName(m_source_name);
 	script.setSourceType(m_source_type);
 	script.setRequestURL(m_request_url);
+	script.setTraceId(m_traceId);
 
 	script.execute(service, m_values);
 }
@@ -101,18 +105,17 @@ void ControlWriteAssetRequest::execute(DispatcherService *service)
 	AssetTracker *tracker = AssetTracker::getAssetTracker();
 	try {
 		string ingestService = tracker->getIngestService(m_asset);
-		string payload = "{ \"values\" : ";
-		payload += m_values.toJSON();
-		payload += " }";
+		string payload = getPayload();
 
 		// Pass m_source_name & m_source_type to south service
 		service->sendToService(ingestService,
 				"/fledge/south/setpoint",
 				payload,
 				m_source_name,
-				m_source_type);
+				m_source_type,
+				m_traceId);
 	} catch (...) {
-		Logger::getLogger()->error("Unable to fetch service that ingests asset %s",
+		AsyncLogger::getInstance()->error("Unable to fetch service that ingests asset %s",
 				m_asset.c_str());
 	}
 }
@@ -125,22 +128,15 @@ void ControlWriteAssetRequest::execute(DispatcherService *service)
 void ControlOperationServiceRequest::execute(DispatcherService *service)
 {
 	filter(service->getPipelineManager());
-	string payload = "{ \"operation\" : \"";
-	payload += m_operation;
-	payload += "\"";
-	if (m_parameters.size() > 0)
-	{
-		payload += ", \"parameters\" : ";
-		payload += m_parameters.toJSON();
-	}
-	payload += " }";
+	string payload = getPayload();
 
 	// Pass m_source_name & m_source_type to south service
 	service->sendToService(m_service,
 				"/fledge/south/operation",
 				payload,
 				m_source_name,
-				m_source_type);
+				m_source_type,
+				m_traceId);
 }
 
 /**
@@ -155,24 +151,17 @@ void ControlOperationAssetRequest::execute(DispatcherService *service)
 	AssetTracker *tracker = AssetTracker::getAssetTracker();
 	try {
 		string ingestService = tracker->getIngestService(m_asset);
-		string payload = "{ \"operation\" : \"";
-		payload += m_operation;
-		payload += "\"";
-		if (m_parameters.size() > 0)
-		{
-			payload += ", \"parameters\" : ";
-			payload += m_parameters.toJSON();
-		}
-		payload += " }";
+		string payload = getPayload();
 
 		// Pass m_source_name & m_source_type to south service
 		service->sendToService(ingestService,
 					"/fledge/south/operation",
 					payload,
 					m_source_name,
-					m_source_type);
+					m_source_type,
+					m_traceId);
 	} catch (...) {
-		Logger::getLogger()->error("Unable to fetch service that ingests asset %s",
+		AsyncLogger::getInstance()->error("Unable to fetch service that ingests asset %s",
 				m_asset.c_str());
 	}
 }
@@ -188,15 +177,7 @@ void ControlOperationBroadcastRequest::execute(DispatcherService *service)
 	vector<ServiceRecord *> services;
 	service->getMgmtClient()->getServices(services, "Southbound");
 
-	string payload = "{ \"operation\" : \"";
-	payload += m_operation;
-	payload += "\"";
-	if (m_parameters.size() > 0)
-	{
-		payload += ", \"parameters\" : ";
-		payload += m_parameters.toJSON();
-	}
-	payload += " }";
+	string payload = getPayload();
 	
 	for (auto& record : services)
 	{
@@ -205,7 +186,8 @@ void ControlOperationBroadcastRequest::execute(DispatcherService *service)
 					"/fledge/south/operation",
 					payload,
 					m_source_name,
-					m_source_type);
+					m_source_type,
+					m_traceId);
 	}
 }
 
@@ -216,47 +198,163 @@ void ControlOperationBroadcastRequest::execute(DispatcherService *service)
  * This method will look for a best match pipeline for the control request
  * based on the source of the request and the destination of the request.
  *
- * If a pipeline is found then it will fetch an execution context for the
- * pipeline and then the write request will be transformed into
- * a reading. That reading will be passed to the pipeline and the result
- * of that pipeline execution turned back into a control request and the
+ * If a pipeline is found and the request satisfies the predicate of the
+ * pipeline then it will fetch an execution context for the
+ * pipeline and the request will be passed through the stages of that
+ * pipeline. Native stages operate directly on the request, for filter
+ * plugins the request is transformed into a reading and the result
+ * of that pipeline execution turned back into a control request. The
  * request will then proceed as previously.
  *
  * @param manager	The control pipeline manager
+ * @param trace		An optional trace of the pipeline execution
  */
-void WriteControlRequest::filter(ControlPipelineManager *manager)
+void WriteControlRequest::filter(ControlPipelineManager *manager, PipelineTrace *trace)
 {
-	Logger::getLogger()->debug("Filtering the write request");
+	DEBUG_LOG(Logger::getLogger(), "Filtering the write request");
 	PipelineEndpoint destination = getDestination();
 	PipelineEndpoint source = getSource();
 	ControlPipeline *pipeline = manager->findPipeline(source, destination);
+	ControlPipelineReference reference(pipeline);
+	DISPATCHER_PROBE3(pipeline_match, m_traceId.c_str(), destination.toString().c_str(),
+			pipeline ? pipeline->getName().c_str() : "");
 	if (!pipeline)
 	{
+		if (!m_dryRun)
+			DispatcherMetrics::getInstance()->increment(MetricPipelineMisses);
 		// Nothing to do
-		Logger::getLogger()->warn("No pipeline found to filter control request");
+		AsyncLogger::getInstance()->warn("No pipeline found to filter control request");
 		return;
 	}
 	if (!pipeline->isEnabled())
 	{
-		Logger::getLogger()->debug("Pipeline %s will be ignored as it is not enabled",
+		DEBUG_LOG(Logger::getLogger(), "Pipeline %s will be ignored as it is not enabled",
 				pipeline->getName().c_str());
 		return;
 	}
-	PipelineExecutionContext *context = pipeline->getExecutionContext(source, destination);
+	if (!pipeline->accepts(m_values, NULL))
+	{
+		if (!m_dryRun)
+			DispatcherMetrics::getInstance()->increment(MetricPipelineSkipped, pipeline->getName());
+		DEBUG_LOG(Logger::getLogger(), "Write request does not satisfy the predicate of pipeline %s",
+				pipeline->getName().c_str());
+		if (trace)
+		{
+			trace->setPipeline(pipeline->getName());
+			trace->setSkipped(true);
+		}
+		return;
+	}
+	// A dry run must not change the state of the filters used by live requests
+	PipelineExecutionContext *context = m_dryRun ? pipeline->createDryRunContext()
+				: pipeline->getExecutionContext(source, destination);
 	if (!context)
 	{
-		Logger::getLogger()->error("Unable to allocate an execution context for the control pipeline '%s'",
-				pipeline->getName());
+		AsyncLogger::getInstance()->error("Unable to allocate an execution context for the control pipeline '%s'",
+				pipeline->getName().c_str());
 		return;
 	}
-	Reading *reading = m_values.toReading("reading");
-	// Filter the reading
-	reading = context->filter(reading);
-	m_values.fromReading(reading);
-	if (reading)
+	if (trace)
+		trace->setPipeline(pipeline->getName());
+	m_pipeline = pipeline->getName();
+	WorkerState *state = WorkerState::current();
+	if (state)
+		state->filtering(pipeline, context);
+	bool forward;
+	{
+		WorkerStageScope scope(state);
+		string name = "reading";
+		// Filter the request
+		DISPATCHER_PROBE3(filter_start, m_traceId.c_str(), pipeline->getName().c_str(), m_values.size());
+		m_timings.m_filterStart = RequestTimings::now();
+		forward = context->filter(m_values, name, trace);
+		m_timings.m_filterEnd = RequestTimings::now();
+	}
+	context->release();
+	DISPATCHER_PROBE4(filter_end, m_traceId.c_str(), pipeline->getName().c_str(), m_values.size(), forward);
+	if (!m_dryRun)
+	{
+		DispatcherMetrics *metrics = DispatcherMetrics::getInstance();
+		metrics->increment(MetricPipelineHits, pipeline->getName());
+		if (!forward)
+			metrics->increment(MetricPipelineRemoved, pipeline->getName());
+	}
+	m_filteredOut = !forward;
+	if (trace)
+		trace->setRemoved(!forward);
+}
+
+/**
+ * Return the payload of a write request
+ *
+ * @return string	The JSON payload sent to the destination
+ */
+string WriteControlRequest::getPayload()
+{
+	string payload = "{ \"values\" : ";
+	payload += m_values.toJSON();
+	payload += " }";
+	return payload;
+}
+
+/**
+ * Create a write request for the given destination. Used by the API and
+ * when requests are replayed from the request journal.
+ *
+ * @param destination	The type of the destination
+ * @param name		The name of the destination
+ * @param values	The values to write
+ * @return ControlRequest*	The write request or NULL if the destination is not supported
+ */
+ControlRequest *ControlRequest::createWrite(const string& destination,
+					const string& name, KVList& values)
+{
+	if (destination.compare("service") == 0)
+	{
+		return new ControlWriteServiceRequest(name, values);
+	}
+	else if (destination.compare("asset") == 0)
+	{
+		return new ControlWriteAssetRequest(name, values);
+	}
+	else if (destination.compare("script") == 0)
 	{
-		delete reading;
+		return new ControlWriteScriptRequest(name, values);
 	}
+	else if (destination.compare("broadcast") == 0)
+	{
+		return new ControlWriteBroadcastRequest(values);
+	}
+	return NULL;
+}
+
+/**
+ * Create an operation request for the given destination. Used by the API
+ * and when requests are replayed from the request journal.
+ *
+ * @param destination	The type of the destination
+ * @param name		The name of the destination
+ * @param operation	The name of the operation
+ * @param parameters	The parameters of the operation
+ * @return ControlRequest*	The operation request or NULL if the destination is not supported
+ */
+ControlRequest *ControlRequest::createOperation(const string& destination,
+					const string& name, const string& operation,
+					KVList& parameters)
+{
+	if (destination.compare("service") == 0)
+	{
+		return new ControlOperationServiceRequest(operation, name, parameters);
+	}
+	else if (destination.compare("asset") == 0)
+	{
+		return new ControlOperationAssetRequest(operation, name, parameters);
+	}
+	else if (destination.compare("broadcast") == 0)
+	{
+		return new ControlOperationBroadcastRequest(operation, parameters);
+	}
+	return NULL;
 }
 
 /**
@@ -289,6 +387,35 @@ PipelineEndpoint ControlRequest::getSource()
 	return PipelineEndpoint(PipelineEndpoint::EndpointAny);
 }
 
+/**
+ * Return the name of the caller that made the control request. The
+ * authenticated caller is used in preference to the name given in the
+ * request as the latter is chosen by the client.
+ *
+ * @return string	The name of the caller
+ */
+string ControlRequest::getCallerName()
+{
+	if (!m_source_name.empty())
+		return m_source_name;
+	if (!m_callerName.empty())
+		return m_callerName;
+	return m_callerType;
+}
+
+/**
+ * Return the name of the destination of the control request
+ *
+ * @return string	The name of the destination
+ */
+string ControlRequest::getDestinationName()
+{
+	PipelineEndpoint destination = getDestination();
+	if (destination.getName().empty())
+		return destination.toString();
+	return destination.getName();
+}
+
 /**
  * Pass a control operation through a control filter pipeline if
  * one has been defined for the particular source and destination.
@@ -296,45 +423,104 @@ PipelineEndpoint ControlRequest::getSource()
  * This method will look for a best match pipeline for the control request
  * based on the source of the request and the destination of the request.
  *
- * If a pipeline is found then it will fetch an execution context for the
- * pipeline and then the write request will be transformed into
- * a reading. That reading will be passed to the pipeline and the result
- * of that pipeline execution turned back into a control request and the
+ * If a pipeline is found and the request satisfies the predicate of the
+ * pipeline then it will fetch an execution context for the
+ * pipeline and the request will be passed through the stages of that
+ * pipeline. Native stages operate directly on the request, for filter
+ * plugins the request is transformed into a reading and the result
+ * of that pipeline execution turned back into a control request. The
  * request will then proceed as previously.
  *
  * @param manager	The control pipeline manager
+ * @param trace		An optional trace of the pipeline execution
  */
-void ControlOperationRequest::filter(ControlPipelineManager *manager)
+void ControlOperationRequest::filter(ControlPipelineManager *manager, PipelineTrace *trace)
 {
 	PipelineEndpoint destination = getDestination();
 	PipelineEndpoint source = getSource();
 	ControlPipeline *pipeline = manager->findPipeline(source, destination);
+	ControlPipelineReference reference(pipeline);
+	DISPATCHER_PROBE3(pipeline_match, m_traceId.c_str(), destination.toString().c_str(),
+			pipeline ? pipeline->getName().c_str() : "");
 	if (!pipeline)
 	{
+		if (!m_dryRun)
+			DispatcherMetrics::getInstance()->increment(MetricPipelineMisses);
 		// Nothing to do
 		return;
 	}
 	if (!pipeline->isEnabled())
 	{
-		Logger::getLogger()->debug("Pipeline %s will be ignored as it is not enabled",
+		DEBUG_LOG(Logger::getLogger(), "Pipeline %s will be ignored as it is not enabled",
 				pipeline->getName().c_str());
 		return;
 	}
-	PipelineExecutionContext *context = pipeline->getExecutionContext(source, destination);
+	if (!pipeline->accepts(m_parameters, &m_operation))
+	{
+		if (!m_dryRun)
+			DispatcherMetrics::getInstance()->increment(MetricPipelineSkipped, pipeline->getName());
+		DEBUG_LOG(Logger::getLogger(), "Operation %s does not satisfy the predicate of pipeline %s",
+				m_operation.c_str(), pipeline->getName().c_str());
+		if (trace)
+		{
+			trace->setPipeline(pipeline->getName());
+			trace->setSkipped(true);
+		}
+		return;
+	}
+	// A dry run must not change the state of the filters used by live requests
+	PipelineExecutionContext *context = m_dryRun ? pipeline->createDryRunContext()
+				: pipeline->getExecutionContext(source, destination);
 	if (!context)
 	{
-		Logger::getLogger()->error("Unable to allocate an execution context for the control pipeline '%s'",
-				pipeline->getName());
+		AsyncLogger::getInstance()->error("Unable to allocate an execution context for the control pipeline '%s'",
+				pipeline->getName().c_str());
 		return;
 	}
-	Reading *reading = m_parameters.toReading(m_operation);
-	// Filter the reading
-	reading = context->filter(reading);
-	m_parameters.fromReading(reading);
-	// All the filter pipeline to change the operation name
-	if (reading)
+	if (trace)
+		trace->setPipeline(pipeline->getName());
+	m_pipeline = pipeline->getName();
+	WorkerState *state = WorkerState::current();
+	if (state)
+		state->filtering(pipeline, context);
+	bool forward;
+	{
+		WorkerStageScope scope(state);
+		// Filter the request, the filter pipeline may change the operation name
+		DISPATCHER_PROBE3(filter_start, m_traceId.c_str(), pipeline->getName().c_str(), m_parameters.size());
+		m_timings.m_filterStart = RequestTimings::now();
+		forward = context->filter(m_parameters, m_operation, trace);
+		m_timings.m_filterEnd = RequestTimings::now();
+	}
+	context->release();
+	DISPATCHER_PROBE4(filter_end, m_traceId.c_str(), pipeline->getName().c_str(), m_parameters.size(), forward);
+	if (!m_dryRun)
+	{
+		DispatcherMetrics *metrics = DispatcherMetrics::getInstance();
+		metrics->increment(MetricPipelineHits, pipeline->getName());
+		if (!forward)
+			metrics->increment(MetricPipelineRemoved, pipeline->getName());
+	}
+	m_filteredOut = !forward;
+	if (trace)
+		trace->setRemoved(!forward);
+}
+
+/**
+ * Return the payload of an operation request
+ *
+ * @return string	The JSON payload sent to the destination
+ */
+string ControlOperationRequest::getPayload()
+{
+	string payload = "{ \"operation\" : \"";
+	payload += m_operation;
+	payload += "\"";
+	if (m_parameters.size() > 0)
 	{
-		m_operation = reading->getAssetName();
-		delete reading;
+		payload += ", \"parameters\" : ";
+		payload += m_parameters.toJSON();
 	}
+	payload += " }";
+	return payload;
 }
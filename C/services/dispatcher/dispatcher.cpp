@@ -15,6 +15,8 @@
 #include <plugin_api.h>
 #include <plugin.h>
 #include <logger.h>
+#include <debug_log.h>
+#include <flight_recorder.h>
 #include <iostream>
 #include <string>
 #include <csignal>
@@ -54,6 +56,18 @@ static void signalHandler(int signal)
 	}
 }
 
+/**
+ * Handle the signal used to request a dump of the flight recorder. The
+ * dump is written by the execution watchdog thread rather than within
+ * the signal handler.
+ *
+ * @param    signal	The received signal
+ */
+static void dumpHandler(int signal)
+{
+	FlightRecorder::requestDump();
+}
+
 /**
  * Dispatcher service main entry point
  */
@@ -117,10 +131,11 @@ int main(int argc, char *argv[])
 	std::signal(SIGINT,  signalHandler);
 	std::signal(SIGSTOP, signalHandler);
 	std::signal(SIGTERM, signalHandler);
+	std::signal(SIGUSR1, dumpHandler);
 
 	// Instantiate the DispatcherService class
 	service = new DispatcherService(myName, token);
-	Logger::getLogger()->setMinLevel(logLevel);
+	DebugLog::setMinLevel(Logger::getLogger(), logLevel);
 
 	if (dryRun)
 	{
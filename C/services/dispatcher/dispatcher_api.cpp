@@ -16,6 +16,14 @@
 #include <dispatcher_service.h>
 #include <controlrequest.h>
 #include <plugin_api.h>
+#include <metrics.h>
+#include <latency.h>
+#include <flight_recorder.h>
+#include <lock_profiler.h>
+#include <caller_accounting.h>
+#include <dispatcher_probes.h>
+#include <tracing.h>
+#include <debug_log.h>
 
 DispatcherApi* DispatcherApi::m_instance = 0;
 
@@ -148,10 +156,13 @@ void DispatcherApi::wait()
 void DispatcherApi::write(shared_ptr<HttpServer::Response> response,
 				      shared_ptr<HttpServer::Request> request)
 {
+	int64_t received = RequestTimings::now();
+	string traceId = getTraceId(request);
+
 	// Get authentication enabled value
 	bool auth_set = m_service->getAuthenticatedCaller();
 
-	Logger::getLogger()->debug("Service '%s' has AuthenticatedCaller flag set %d",
+	DEBUG_LOG(Logger::getLogger(), "Service '%s' has AuthenticatedCaller flag set %d",
 				m_service->getName().c_str(),
 				auth_set);
 
@@ -213,24 +224,8 @@ void DispatcherApi::write(shared_ptr<HttpServer::Response> response,
 			if (doc.HasMember("write") && doc["write"].IsObject())
 			{
 				KVList values(doc["write"]);
-				ControlRequest *writeRequest = NULL;
-				if (destination.compare("service") == 0)
-				{
-					writeRequest = new ControlWriteServiceRequest(name, values); 
-				}
-				else if (destination.compare("asset") == 0)
-				{
-					writeRequest = new ControlWriteAssetRequest(name, values); 
-				}
-				else if (destination.compare("script") == 0)
-				{
-					writeRequest = new ControlWriteScriptRequest(name, values); 
-				}
-				else if (destination.compare("broadcast") == 0)
-				{
-					writeRequest = new ControlWriteBroadcastRequest(values); 
-				}
-				else
+				ControlRequest *writeRequest = ControlRequest::createWrite(destination, name, values);
+				if (!writeRequest)
 				{
 					string responsePayload = QUOTE({ "message" : "Unsupported destination for write request" });
 					respond(response, SimpleWeb::StatusCode::client_error_bad_request,responsePayload);
@@ -251,6 +246,10 @@ void DispatcherApi::write(shared_ptr<HttpServer::Response> response,
 					}
 
 					// Add request to the queue
+					writeRequest->getTimings().m_received = received;
+					writeRequest->setTraceId(traceId);
+					DISPATCHER_PROBE4(request_parse, traceId.c_str(), writeRequest->getRequestType(),
+							writeRequest->getDestinationName().c_str(), payload.length());
 					queueRequest(writeRequest);
 				}
 			}
@@ -267,7 +266,7 @@ void DispatcherApi::write(shared_ptr<HttpServer::Response> response,
 		string responsePayload = QUOTE({ "message" : buffer });
 		respond(response, SimpleWeb::StatusCode::client_error_bad_request,responsePayload);
 	}
-	string responsePayload = QUOTE({ "message" : "Request queued" });
+	string responsePayload = "{ \"message\" : \"Request queued\", \"trace_id\" : \"" + traceId + "\" }";
 	respond(response, SimpleWeb::StatusCode::success_accepted,responsePayload);
 }
 
@@ -277,13 +276,15 @@ void DispatcherApi::write(shared_ptr<HttpServer::Response> response,
 void DispatcherApi::operation(shared_ptr<HttpServer::Response> response,
 				      shared_ptr<HttpServer::Request> request)
 {
+	int64_t received = RequestTimings::now();
+	string traceId = getTraceId(request);
 	string destination, name, key, value;
 	string payload = request->content.string();
 
 	// Get authentication enabled value
 	bool auth_set = m_service->getAuthenticatedCaller();
 
-	Logger::getLogger()->debug("Service '%s' has AuthenticatedCaller flag set %d",
+	DEBUG_LOG(Logger::getLogger(), "Service '%s' has AuthenticatedCaller flag set %d",
 				m_service->getName().c_str(),
 				auth_set);
 
@@ -346,20 +347,8 @@ void DispatcherApi::operation(shared_ptr<HttpServer::Response> response,
 				{
 					string operation = op.name.GetString();
 					KVList values(op.value);
-					ControlRequest *opRequest = NULL;
-					if (destination.compare("service") == 0)
-					{
-						opRequest = new ControlOperationServiceRequest(operation, name, values); 
-					}
-					else if (destination.compare("asset") == 0)
-					{
-						opRequest = new ControlOperationAssetRequest(operation, name, values); 
-					}
-					else if (destination.compare("broadcast") == 0)
-					{
-						opRequest = new ControlOperationBroadcastRequest(operation, values); 
-					}
-					else
+					ControlRequest *opRequest = ControlRequest::createOperation(destination, name, operation, values);
+					if (!opRequest)
 					{
 						string responsePayload = QUOTE({ "message" : "Unsupported destination for operation request" });
 						respond(response, SimpleWeb::StatusCode::client_error_bad_request,responsePayload);
@@ -379,6 +368,10 @@ void DispatcherApi::operation(shared_ptr<HttpServer::Response> response,
 							opRequest->setSourceType(callerType);
 						}
 
+						opRequest->getTimings().m_received = received;
+						opRequest->setTraceId(traceId);
+						DISPATCHER_PROBE4(request_parse, traceId.c_str(), opRequest->getRequestType(),
+								opRequest->getDestinationName().c_str(), payload.length());
 						queueRequest(opRequest);
 					}
 				}
@@ -396,10 +389,294 @@ void DispatcherApi::operation(shared_ptr<HttpServer::Response> response,
 		string responsePayload = QUOTE({ "message" : buffer });
 		respond(response, SimpleWeb::StatusCode::client_error_bad_request,responsePayload);
 	}
-	string responsePayload = QUOTE({ "message" : "Request queued" });
+	string responsePayload = "{ \"message\" : \"Request queued\", \"trace_id\" : \"" + traceId + "\" }";
 	respond(response, SimpleWeb::StatusCode::success_accepted,responsePayload);
 }
 
+/**
+ * Handle a dry run request call. The write or operation in the payload is
+ * passed through the matching control pipeline but is not delivered to the
+ * destination. The response contains the pipeline that was selected, the
+ * payload that would have been delivered and the time spent in each stage
+ * of the pipeline. The pipeline is executed in a throwaway context so that
+ * the dry run does not affect live requests or the pipeline metrics.
+ */
+void DispatcherApi::dryRun(shared_ptr<HttpServer::Response> response,
+				      shared_ptr<HttpServer::Request> request)
+{
+	// Get authentication enabled value
+	bool auth_set = m_service->getAuthenticatedCaller();
+
+	string callerName, callerType;
+
+	// If authentication is set verify input token and service/URL ACLs
+	if (auth_set)
+	{
+		// Verify access token from caller and check caller can access dispatcher
+		// Routine sends HTTP reply in case of errors
+		if (!m_service->AuthenticationMiddlewareCommon(response,
+					request,
+					callerName,
+					callerType))
+		{
+			return;
+		}
+	}
+
+	ControlPipelineManager *manager = m_service->getPipelineManager();
+	if (!manager)
+	{
+		string responsePayload = QUOTE({ "message" : "The control pipelines have not been loaded" });
+		respond(response, SimpleWeb::StatusCode::server_error_service_unavailable, responsePayload);
+		return;
+	}
+
+	string destination, name;
+	string payload = request->content.string();
+	vector<ControlRequest *> requests;
+	try {
+		Document doc;
+		ParseResult result = doc.Parse(payload.c_str());
+		if (!result)
+		{
+			string responsePayload = QUOTE({ "message" : "Failed to parse request payload" });
+			respond(response, SimpleWeb::StatusCode::client_error_bad_request,responsePayload);
+			return;
+		}
+		if (doc.HasMember("destination") && doc["destination"].IsString())
+		{
+			destination = doc["destination"].GetString();
+		}
+		else
+		{
+			string responsePayload = QUOTE({ "message" : "Missing 'destination' in dry run payload" });
+			respond(response, SimpleWeb::StatusCode::client_error_bad_request,responsePayload);
+			return;
+		}
+		if (doc.HasMember("name") && doc["name"].IsString())
+		{
+			name = doc["name"].GetString();
+		}
+		else if (destination.compare("broadcast") != 0)
+		{
+			string responsePayload = QUOTE({ "message" : "Missing destination name in dry run payload" });
+			respond(response, SimpleWeb::StatusCode::client_error_bad_request,responsePayload);
+			return;
+		}
+
+		if (doc.HasMember("write") && doc["write"].IsObject())
+		{
+			KVList values(doc["write"]);
+			ControlRequest *writeRequest = ControlRequest::createWrite(destination, name, values);
+			if (writeRequest)
+				requests.push_back(writeRequest);
+		}
+		else if (doc.HasMember("operation") && doc["operation"].IsObject())
+		{
+			for (auto& op : doc["operation"].GetObject())
+			{
+				string operation = op.name.GetString();
+				KVList values(op.value);
+				ControlRequest *opRequest = ControlRequest::createOperation(destination, name, operation, values);
+				if (opRequest)
+					requests.push_back(opRequest);
+			}
+		}
+		else
+		{
+			string responsePayload = QUOTE({ "message" : "The dry run payload must contain a 'write' or 'operation' object" });
+			respond(response, SimpleWeb::StatusCode::client_error_bad_request,responsePayload);
+			return;
+		}
+		if (requests.size() == 0)
+		{
+			string responsePayload = QUOTE({ "message" : "Unsupported destination for dry run request" });
+			respond(response, SimpleWeb::StatusCode::client_error_bad_request,responsePayload);
+			return;
+		}
+
+		string responsePayload = "{ \"results\" : [ ";
+		for (int i = 0; i < requests.size(); i++)
+		{
+			ControlRequest *controlRequest = requests[i];
+			if (doc.HasMember("source") && doc["source"].IsString() &&
+				doc.HasMember("source_name") && doc["source_name"].IsString())
+			{
+				controlRequest->addCaller(doc["source"].GetString(), doc["source_name"].GetString());
+			}
+			if (auth_set)
+			{
+				controlRequest->setSourceName(callerName);
+				controlRequest->setSourceType(callerType);
+			}
+
+			PipelineTrace trace;
+			controlRequest->setDryRun(true);
+			controlRequest->filter(manager, &trace);
+
+			if (i > 0)
+				responsePayload += ", ";
+			responsePayload += "{ \"payload\" : " + controlRequest->getPayload();
+			responsePayload += ", \"trace\" : " + trace.toJSON() + " }";
+		}
+		responsePayload += " ] }";
+		respond(response, responsePayload);
+	} catch (exception &e) {
+		char buffer[80];
+		snprintf(buffer, sizeof(buffer), "\"Exception: %s\"", e.what());
+		string responsePayload = QUOTE({ "message" : buffer });
+		respond(response, SimpleWeb::StatusCode::client_error_bad_request,responsePayload);
+	}
+	for (auto& controlRequest : requests)
+		delete controlRequest;
+}
+
+/**
+ * Handle a request for the runtime metrics of the dispatcher. The metrics
+ * are returned in the Prometheus text exposition format.
+ */
+void DispatcherApi::metrics(shared_ptr<HttpServer::Response> response,
+				      shared_ptr<HttpServer::Request> request)
+{
+	string callerName, callerType;
+
+	// If authentication is set verify input token and service/URL ACLs
+	if (m_service->getAuthenticatedCaller())
+	{
+		// Verify access token from caller and check caller can access dispatcher
+		// Routine sends HTTP reply in case of errors
+		if (!m_service->AuthenticationMiddlewareCommon(response,
+					request,
+					callerName,
+					callerType))
+		{
+			return;
+		}
+	}
+
+	string payload = DispatcherMetrics::getInstance()->toPrometheus();
+	payload += LatencyRegistry::getInstance()->toPrometheus();
+	payload += LockProfiler::getInstance()->toPrometheus();
+	payload += CallerAccounting::getInstance()->toPrometheus();
+	*response << "HTTP/1.1 200 OK\r\nContent-Length: "
+		  << payload.length() << "\r\n"
+		  <<  "Content-type: text/plain; version=0.0.4\r\n\r\n" << payload;
+}
+
+/**
+ * Handle a request for the contents of the flight recorder, the most
+ * recent control requests handled by the dispatcher.
+ */
+void DispatcherApi::flightRecorder(shared_ptr<HttpServer::Response> response,
+				      shared_ptr<HttpServer::Request> request)
+{
+	string callerName, callerType;
+
+	// If authentication is set verify input token and service/URL ACLs
+	if (m_service->getAuthenticatedCaller())
+	{
+		// Verify access token from caller and check caller can access dispatcher
+		// Routine sends HTTP reply in case of errors
+		if (!m_service->AuthenticationMiddlewareCommon(response,
+					request,
+					callerName,
+					callerType))
+		{
+			return;
+		}
+	}
+
+	respond(response, FlightRecorder::getInstance()->toJSON());
+}
+
+/**
+ * Handle a request to write the contents of the flight recorder to a file.
+ * The path of the file is returned in the response.
+ */
+void DispatcherApi::dumpFlightRecorder(shared_ptr<HttpServer::Response> response,
+				      shared_ptr<HttpServer::Request> request)
+{
+	string callerName, callerType;
+
+	// If authentication is set verify input token and service/URL ACLs
+	if (m_service->getAuthenticatedCaller())
+	{
+		// Verify access token from caller and check caller can access dispatcher
+		// Routine sends HTTP reply in case of errors
+		if (!m_service->AuthenticationMiddlewareCommon(response,
+					request,
+					callerName,
+					callerType))
+		{
+			return;
+		}
+	}
+
+	string path;
+	if (FlightRecorder::getInstance()->dump(path))
+	{
+		StringEscapeQuotes(path);
+		respond(response, "{ \"file\" : \"" + path + "\" }");
+	}
+	else
+	{
+		string responsePayload = QUOTE({ "message" : "Failed to write the flight recorder file" });
+		respond(response, SimpleWeb::StatusCode::server_error_internal_server_error, responsePayload);
+	}
+}
+
+/**
+ * Handle a request for the runtime status of the dispatcher, the request
+ * queue, the worker threads and the loaded pipeline contexts.
+ */
+void DispatcherApi::status(shared_ptr<HttpServer::Response> response,
+				      shared_ptr<HttpServer::Request> request)
+{
+	string callerName, callerType;
+
+	// If authentication is set verify input token and service/URL ACLs
+	if (m_service->getAuthenticatedCaller())
+	{
+		// Verify access token from caller and check caller can access dispatcher
+		// Routine sends HTTP reply in case of errors
+		if (!m_service->AuthenticationMiddlewareCommon(response,
+					request,
+					callerName,
+					callerType))
+		{
+			return;
+		}
+	}
+
+	respond(response, m_service->statusToJSON());
+}
+
+/**
+ * Handle a request for the resources consumed by each caller of the
+ * dispatcher.
+ */
+void DispatcherApi::callers(shared_ptr<HttpServer::Response> response,
+				      shared_ptr<HttpServer::Request> request)
+{
+	string callerName, callerType;
+
+	// If authentication is set verify input token and service/URL ACLs
+	if (m_service->getAuthenticatedCaller())
+	{
+		// Verify access token from caller and check caller can access dispatcher
+		// Routine sends HTTP reply in case of errors
+		if (!m_service->AuthenticationMiddlewareCommon(response,
+					request,
+					callerName,
+					callerType))
+		{
+			return;
+		}
+	}
+
+	respond(response, CallerAccounting::getInstance()->toJSON());
+}
+
 /**
  * Handle a table insert request call
  */
@@ -417,7 +694,7 @@ void DispatcherApi::tableInsert(shared_ptr<HttpServer::Response> response,
 	// Get authentication enabled value
 	bool auth_set = m_service->getAuthenticatedCaller();
 
-	Logger::getLogger()->debug("Service '%s' has AuthenticatedCaller flag set %d",
+	DEBUG_LOG(Logger::getLogger(), "Service '%s' has AuthenticatedCaller flag set %d",
 				m_service->getName().c_str(),
 				auth_set);
 
@@ -480,7 +757,7 @@ void DispatcherApi::tableUpdate(shared_ptr<HttpServer::Response> response,
 	// Get authentication enabled value
 	bool auth_set = m_service->getAuthenticatedCaller();
 
-	Logger::getLogger()->debug("Service '%s' has AuthenticatedCaller flag set %d",
+	DEBUG_LOG(Logger::getLogger(), "Service '%s' has AuthenticatedCaller flag set %d",
 				m_service->getName().c_str(),
 				auth_set);
 
@@ -542,7 +819,7 @@ void DispatcherApi::tableDelete(shared_ptr<HttpServer::Response> response,
 	// Get authentication enabled value
 	bool auth_set = m_service->getAuthenticatedCaller();
 
-	Logger::getLogger()->debug("Service '%s' has AuthenticatedCaller flag set %d",
+	DEBUG_LOG(Logger::getLogger(), "Service '%s' has AuthenticatedCaller flag set %d",
 				m_service->getName().c_str(),
 				auth_set);
 
@@ -638,6 +915,84 @@ static void operationWrapper(shared_ptr<HttpServer::Response> response,
 	api->operation(response, request);
 }
 
+/**
+ * Wrapper for dry run API entry point
+ *
+ * @param response	The response the should be sent
+ * @param request	The API request
+ */
+static void dryRunWrapper(shared_ptr<HttpServer::Response> response,
+		    shared_ptr<HttpServer::Request> request)
+{
+	DispatcherApi *api = DispatcherApi::getInstance();
+	api->dryRun(response, request);
+}
+
+/**
+ * Wrapper for metrics API entry point
+ *
+ * @param response	The response the should be sent
+ * @param request	The API request
+ */
+static void metricsWrapper(shared_ptr<HttpServer::Response> response,
+		    shared_ptr<HttpServer::Request> request)
+{
+	DispatcherApi *api = DispatcherApi::getInstance();
+	api->metrics(response, request);
+}
+
+/**
+ * Wrapper for the flight recorder API entry point
+ *
+ * @param response	The response the should be sent
+ * @param request	The API request
+ */
+static void flightRecorderWrapper(shared_ptr<HttpServer::Response> response,
+		    shared_ptr<HttpServer::Request> request)
+{
+	DispatcherApi *api = DispatcherApi::getInstance();
+	api->flightRecorder(response, request);
+}
+
+/**
+ * Wrapper for the flight recorder dump API entry point
+ *
+ * @param response	The response the should be sent
+ * @param request	The API request
+ */
+static void dumpFlightRecorderWrapper(shared_ptr<HttpServer::Response> response,
+		    shared_ptr<HttpServer::Request> request)
+{
+	DispatcherApi *api = DispatcherApi::getInstance();
+	api->dumpFlightRecorder(response, request);
+}
+
+/**
+ * Wrapper for the status API entry point
+ *
+ * @param response	The response the should be sent
+ * @param request	The API request
+ */
+static void statusWrapper(shared_ptr<HttpServer::Response> response,
+		    shared_ptr<HttpServer::Request> request)
+{
+	DispatcherApi *api = DispatcherApi::getInstance();
+	api->status(response, request);
+}
+
+/**
+ * Wrapper for the caller accounting API entry point
+ *
+ * @param response	The response the should be sent
+ * @param request	The API request
+ */
+static void callersWrapper(shared_ptr<HttpServer::Response> response,
+		    shared_ptr<HttpServer::Request> request)
+{
+	DispatcherApi *api = DispatcherApi::getInstance();
+	api->callers(response, request);
+}
+
 /**
  * Wrapper for write table insert API entry point
  *
@@ -688,10 +1043,16 @@ void DispatcherApi::initResources()
 	m_server->default_resource["POST"] = defaultWrapper;
 	m_server->default_resource["DELETE"] = defaultWrapper;
 
-	// writeWrapper and operationWrapper
+	// writeWrapper, operationWrapper and dryRunWrapper
 	// call AuthenticationMiddlewareCommon
 	m_server->resource[DISPATCH_WRITE]["POST"] = writeWrapper;
 	m_server->resource[DISPATCH_OPERATION]["POST"] = operationWrapper;
+	m_server->resource[DISPATCH_DRYRUN]["POST"] = dryRunWrapper;
+	m_server->resource[DISPATCH_METRICS]["GET"] = metricsWrapper;
+	m_server->resource[DISPATCH_FLIGHT_RECORDER]["GET"] = flightRecorderWrapper;
+	m_server->resource[DISPATCH_FLIGHT_RECORDER]["POST"] = dumpFlightRecorderWrapper;
+	m_server->resource[DISPATCH_STATUS]["GET"] = statusWrapper;
+	m_server->resource[DISPATCH_CALLERS]["GET"] = callersWrapper;
 	m_server->resource[TABLE_INSERT_URL TABLE_PATTERN]["POST"] = insertWrapper;
 	m_server->resource[TABLE_UPDATE_URL TABLE_PATTERN]["POST"] = updateWrapper;
 	m_server->resource[TABLE_DELETE_URL TABLE_PATTERN]["POST"] = deleteWrapper;
@@ -762,3 +1123,21 @@ bool DispatcherApi::queueRequest(ControlRequest *request)
 	return m_service->queue(request);
 }
 
+/**
+ * Return the trace ID for a control request. A trace ID passed by the caller
+ * in the trace header is used if valid, otherwise a new trace ID is generated.
+ *
+ * @param request	The HTTP request
+ * @return string	The trace ID
+ */
+string DispatcherApi::getTraceId(shared_ptr<HttpServer::Request> request)
+{
+	auto header = request->header.find(TRACE_ID_HEADER);
+	if (header != request->header.end())
+	{
+		if (Tracing::validTraceId(header->second))
+			return header->second;
+		m_logger->warn("Ignoring invalid trace ID passed in the %s header", TRACE_ID_HEADER);
+	}
+	return Tracing::newTraceId();
+}
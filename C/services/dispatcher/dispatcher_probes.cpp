@@ -0,0 +1,31 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <dispatcher_probes.h>
+
+#ifdef HAVE_SYS_SDT_H
+/*
+ * The probe semaphores, a tracer increments the semaphore of a probe while
+ * it is attached to the probe. They must be placed in the .probes section
+ * for the tracer to find them.
+ */
+#define DEFINE_SEMAPHORE(name) \
+	__extension__ unsigned short DISPATCHER_PROBE_SEMAPHORE(name) \
+		__attribute__((unused)) __attribute__((section(".probes")))
+
+DEFINE_SEMAPHORE(request_parse);
+DEFINE_SEMAPHORE(request_enqueue);
+DEFINE_SEMAPHORE(request_dequeue);
+DEFINE_SEMAPHORE(pipeline_match);
+DEFINE_SEMAPHORE(filter_start);
+DEFINE_SEMAPHORE(filter_end);
+DEFINE_SEMAPHORE(delivery_start);
+DEFINE_SEMAPHORE(delivery_end);
+#endif
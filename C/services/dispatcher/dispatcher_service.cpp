@@ -22,6 +22,19 @@
 #include <storage_client.h>
 #include <config_handler.h>
 #include <dispatcher_service.h>
+#include <metrics.h>
+#include <latency.h>
+#include <tracing.h>
+#include <debug_log.h>
+#include <async_logger.h>
+#include <flight_recorder.h>
+#include <caller_accounting.h>
+#include <pipeline_snapshot.h>
+#include <string_utils.h>
+#include <dispatcher_probes.h>
+#include <future>
+#include <chrono>
+#include <thread>
 
 using namespace std;
 
@@ -29,12 +42,68 @@ using namespace std;
  * Thread entry point for the worker threads used to execute the 
  * control functions
  */
-static void worker_thread(void *data)
+static void worker_thread(DispatcherService *service, WorkerState *state)
 {
-	DispatcherService *service = (DispatcherService *)data;
-	service->worker();
+	service->worker(state);
 }
 
+/**
+ * Wait for an HTTP listener to bind to its port. The listeners start on
+ * their own threads and bind within a few milliseconds, the port is
+ * checked at an interval that starts at one millisecond and backs off
+ * to 50 milliseconds.
+ *
+ * @param listener	The listener, a DispatcherApi or ManagementApi
+ * @param timeout	The maximum time to wait in milliseconds
+ * @return bool		True if the listener is bound to a port
+ */
+template<class Listener> static bool waitForListener(Listener *listener, unsigned int timeout)
+{
+	auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout);
+	unsigned int interval = 1;
+	while (listener->getListenerPort() == 0)
+	{
+		if (chrono::steady_clock::now() >= deadline)
+			return false;
+		this_thread::sleep_for(chrono::milliseconds(interval));
+		if (interval < 50)
+			interval *= 2;
+	}
+	return true;
+}
+
+/**
+ * The time taken by each phase of the startup of the service
+ */
+class StartupPhases {
+	public:
+		StartupPhases(int64_t start) : m_start(start), m_last(start) {};
+		/**
+		 * Mark the end of a startup phase
+		 *
+		 * @param name	The name of the phase
+		 */
+		void	phase(const char *name)
+			{
+				int64_t now = RequestTimings::now();
+				char buf[80];
+				snprintf(buf, sizeof(buf), "%s%s %.1f ms", m_phases.empty() ? "" : ", ",
+						name, (now - m_last) / 1000000.0);
+				m_phases += buf;
+				m_last = now;
+			};
+		/**
+		 * Return the total startup time in milliseconds
+		 */
+		double	total() const { return (m_last - m_start) / 1000000.0; };
+		const std::string&
+			toString() const { return m_phases; };
+	private:
+		int64_t		m_start;
+		int64_t		m_last;
+		std::string	m_phases;
+};
+
 /**
  * Constructor for the DispatcherService class
  *
@@ -48,7 +117,16 @@ DispatcherService::DispatcherService(const string& myName, const string& token)
 					 m_stopping(false),
 					 m_dryRun(false),
 					 m_restartRequest(false),
-					 m_removeFromCore(true)
+					 m_removeFromCore(true),
+					 m_pipelineManager(NULL),
+					 m_filterTimeout(0),
+					 m_workerId(0),
+					 m_statistics(NULL),
+					 m_slowThreshold(atoi(DEFAULT_SLOW_REQUEST_THRESHOLD)),
+					 m_startTime(0),
+					 m_firstServed(false),
+					 m_journal(NULL),
+					 m_journalDurability(JournalOff)
 {
 	// Set name
 	m_name = myName;
@@ -61,7 +139,7 @@ DispatcherService::DispatcherService(const string& myName, const string& token)
 
 	// Create new logger instance
 	m_logger = new Logger(myName);
-	m_logger->setMinLevel("warning");
+	DebugLog::setMinLevel(m_logger, "warning");
 
 	// One thread
 	unsigned int threads = 1;
@@ -69,9 +147,12 @@ DispatcherService::DispatcherService(const string& myName, const string& token)
 	// Instantiate the DispatcherApi class
 	m_api = new DispatcherApi(servicePort, threads);
 
+	m_watchdog = new ExecutionWatchdog(this);
+
 	// Set NULL for other resources
 	m_mgtClient = NULL;
 	m_managementApi = NULL;
+	m_storage = NULL;
 }
 
 /**
@@ -94,6 +175,13 @@ DispatcherService::~DispatcherService()
 		delete m_managementApi;
 		m_managementApi = NULL;
 	}
+	delete m_watchdog;
+	CallerAccounting::getInstance()->setStatistics(NULL);
+	delete m_statistics;
+	for (auto request : m_replay)
+		delete request;
+	delete m_journal.load();
+	delete m_storage;
 	delete m_logger;
 }
 
@@ -111,30 +199,33 @@ bool DispatcherService::start(string& coreAddress,
 	// Dynamic port
 	unsigned short managementPort = (unsigned short)0;
 
+	m_startTime = RequestTimings::now();
+	StartupPhases phases(m_startTime);
 	m_logger->info("Starting dispatcher service '" + m_name +  "' ...");
 
+	// Messages from the request processing paths are written asynchronously
+	AsyncLogger::getInstance()->start();
+
 	// Instantiate ManagementApi class
 	m_managementApi = new ManagementApi(SERVICE_NAME, managementPort);
 	m_managementApi->registerService(this);
 	m_managementApi->start();
 
-	// Allow time for the listeners to start before we register
-	while(m_managementApi->getListenerPort() == 0)
-	{
-		sleep(1);
-	}
-
         // Enable http API methods
         m_api->initResources();
 
         // Start the NotificationApi on service port
 	m_api->start(this);
 
-	// Allow time for the listeners to start before we continue
-	while(m_api->getListenerPort() == 0)
+	// Both listeners start together, wait for them to bind before we register
+	if (!waitForListener(m_managementApi, LISTENER_START_TIMEOUT)
+			|| !waitForListener(m_api, LISTENER_START_TIMEOUT))
 	{
-		sleep(1);
+		m_logger->fatal("Dispatcher service '" + m_name + "' listeners failed to start");
+		this->cleanupResources();
+		return false;
 	}
+	phases.phase("listeners");
 
 	// Get management client
 	m_mgtClient = new ManagementClient(coreAddress, corePort);
@@ -172,6 +263,17 @@ bool DispatcherService::start(string& coreAddress,
 			return false;
 		}
 	}
+	phases.phase("registration");
+
+	// The storage service is located whilst the configuration is created
+	ServiceRecord storageInfo("", "Storage");
+	future<bool> storageLookup;
+	if (!m_dryRun)
+	{
+		storageLookup = async(launch::async, [this, &storageInfo]() {
+				return m_mgtClient->getService(storageInfo);
+			});
+	}
 
 	// Make sure we have an instance of the asset tracker
 	AssetTracker *tracker = new AssetTracker(m_mgtClient, m_name);
@@ -182,15 +284,6 @@ bool DispatcherService::start(string& coreAddress,
 	// Create a category with Dispatcher name
 	DefaultConfigCategory dispatcherServerConfig(m_name, string("{}"));
 	dispatcherServerConfig.setDescription("Dispatcher server " + string(m_name));
-	if (!m_mgtClient->addCategory(dispatcherServerConfig, true))
-	{
-		m_logger->fatal("Dispatcher service '" + m_name + \
-				"' can not connect to Fledge ConfigurationManager at " + \
-				string(coreAddress + ":" + to_string(corePort)));
-
-		this->cleanupResources();
-		return false;
-	}
 
 	string serverCatName = m_name+string(" Server");
 	DefaultConfigCategory defConfigServer(serverCatName, string("{}"));
@@ -200,13 +293,6 @@ bool DispatcherService::start(string& coreAddress,
 					 "boolean", "true", "1");
 	defConfigServer.setItemDisplayName("enable",
 						    "Enable control");
-	// Create/Update category name (we pass keep_original_items=true)
-	if (m_mgtClient->addCategory(defConfigServer, true))
-	{
-		vector<string> children1;
-		children1.push_back(serverCatName);
-		m_mgtClient->addChildCategories(m_name, children1);
-	}
 
 	// Deal with registering and fetching the advanced configuration
 	string advancedCatName = m_name + string("Advanced");
@@ -223,14 +309,78 @@ bool DispatcherService::start(string& coreAddress,
 					 "integer", "2", "2");
 	defConfigAdvanced.setItemDisplayName("dispatcherThreads",
 						    "Maximun number of dispatcher threads");
+	defConfigAdvanced.addItem("filterCompletionTimeout",
+					 "The time in milliseconds to wait for control filters that emit their output asynchronously. A value of 0 requires all filters to complete synchronously",
+					 "integer", "0", "0");
+	defConfigAdvanced.setItemDisplayName("filterCompletionTimeout",
+						    "Filter Completion Timeout");
+	defConfigAdvanced.addItem("executionBudget",
+					 "The time in milliseconds a control request may take to execute before it is reported as stuck. A value of 0 disables the check",
+					 "integer", DEFAULT_EXECUTION_BUDGET, DEFAULT_EXECUTION_BUDGET);
+	defConfigAdvanced.setItemDisplayName("executionBudget",
+						    "Execution Budget");
+	defConfigAdvanced.addItem("quarantineStuck",
+					 "Quarantine the pipeline context of a control request that exceeds the execution budget and replace the worker thread",
+					 "boolean", "false", "false");
+	defConfigAdvanced.setItemDisplayName("quarantineStuck",
+						    "Quarantine Stuck Requests");
+	defConfigAdvanced.addItem("slowRequestThreshold",
+					 "The time in milliseconds above which a control request is logged as slow with a breakdown of where the time was spent. A value of 0 disables the check",
+					 "integer", DEFAULT_SLOW_REQUEST_THRESHOLD, DEFAULT_SLOW_REQUEST_THRESHOLD);
+	defConfigAdvanced.setItemDisplayName("slowRequestThreshold",
+						    "Slow Request Threshold");
+	defConfigAdvanced.addItem("lockProfiling",
+					 "Account the time spent waiting for and holding the internal locks of the dispatcher. The results are reported by the metrics API entry point",
+					 "boolean", "false", "false");
+	defConfigAdvanced.setItemDisplayName("lockProfiling",
+						    "Lock Profiling");
+	defConfigAdvanced.addItem("statisticsInterval",
+					 "The interval in seconds between the writes of the control statistics to storage",
+					 "integer", DEFAULT_STATISTICS_INTERVAL, DEFAULT_STATISTICS_INTERVAL);
+	defConfigAdvanced.setItemDisplayName("statisticsInterval",
+						    "Statistics Interval");
+	defConfigAdvanced.addItem("spanFile",
+					 "The file to which the timing spans of each control request are appended. Leave empty to disable span export",
+					 "string", "", "");
+	defConfigAdvanced.setItemDisplayName("spanFile",
+						    "Span Export File");
+	vector<string>  durability = { "off", "buffered", "group", "sync" };
+	defConfigAdvanced.addItem("requestJournal",
+					 "Journal accepted control requests so that requests not executed when the service stops are executed when it restarts. Buffered survives a failure of the service, group and sync survive a failure of the host, group shares each write to disk between concurrent requests",
+					 "off", "off", durability);
+	defConfigAdvanced.setItemDisplayName("requestJournal",
+						    "Request Journal");
 	defConfigAdvanced.setDescription("Dispatcher Service Advanced");
 
-	// Create/Update category name (we pass keep_original_items=true)
-	if (m_mgtClient->addCategory(defConfigAdvanced, true))
+	// Create/Update the categories (we pass keep_original_items=true),
+	// they are independent of each other so are created concurrently
+	future<bool> mainCreated = async(launch::async, [this, &dispatcherServerConfig]() {
+			return m_mgtClient->addCategory(dispatcherServerConfig, true);
+		});
+	future<bool> serverCreated = async(launch::async, [this, &defConfigServer]() {
+			return m_mgtClient->addCategory(defConfigServer, true);
+		});
+	future<bool> advancedCreated = async(launch::async, [this, &defConfigAdvanced]() {
+			return m_mgtClient->addCategory(defConfigAdvanced, true);
+		});
+	bool created = mainCreated.get();
+	vector<string> children;
+	if (serverCreated.get())
+		children.push_back(serverCatName);
+	if (advancedCreated.get())
+		children.push_back(advancedCatName);
+	if (!created)
 	{
-		vector<string> children1;
-		children1.push_back(advancedCatName);
-		m_mgtClient->addChildCategories(m_name, children1);
+		m_logger->fatal("Dispatcher service '" + m_name + \
+				"' can not connect to Fledge ConfigurationManager at " + \
+				string(coreAddress + ":" + to_string(corePort)));
+
+		this->cleanupResources();
+		return false;
+	}
+	if (children.size() > 0)
+	{
+		m_mgtClient->addChildCategories(m_name, children);
 	}
 
 	if (!m_dryRun)
@@ -241,6 +391,19 @@ bool DispatcherService::start(string& coreAddress,
 		registerCategory(serverCatName);
 	}
 
+	// Read the categories once the interest in them is registered, the
+	// security categories also register interest so are created after
+	// the registrations above but concurrently with the reads
+	future<void> security = async(launch::async, [this]() {
+			this->createSecurityCategories(m_mgtClient, m_dryRun);
+		});
+	future<ConfigCategory> advancedRead;
+	if (!m_dryRun)
+	{
+		advancedRead = async(launch::async, [this, &advancedCatName]() {
+				return m_mgtClient->getCategory(advancedCatName);
+			});
+	}
 	ConfigCategory serverCategory = m_mgtClient->getCategory(serverCatName);
 	if (serverCategory.itemExists("enable"))
 	{
@@ -258,12 +421,15 @@ bool DispatcherService::start(string& coreAddress,
 		m_enable = true;
 	}
 
+	phases.phase("configuration");
+
+	future<bool> started;
 	if (!m_dryRun)
 	{
-		ConfigCategory category = m_mgtClient->getCategory(advancedCatName);
+		ConfigCategory category = advancedRead.get();
 		if (category.itemExists("logLevel"))
 		{
-			m_logger->setMinLevel(category.getValue("logLevel"));
+			DebugLog::setMinLevel(m_logger, category.getValue("logLevel"));
 		}
 
 		if (category.itemExists("dispatcherThreads"))
@@ -279,9 +445,40 @@ bool DispatcherService::start(string& coreAddress,
 			}
 		}
 
+		if (category.itemExists("filterCompletionTimeout"))
+		{
+			long val = atol(category.getValue("filterCompletionTimeout").c_str());
+			m_filterTimeout = val > 0 ? val : 0;
+		}
+		if (category.itemExists("executionBudget"))
+		{
+			long val = atol(category.getValue("executionBudget").c_str());
+			m_watchdog->setBudget(val > 0 ? val : 0);
+		}
+		if (category.itemExists("quarantineStuck"))
+		{
+			m_watchdog->setQuarantine(category.getValue("quarantineStuck").compare("true") == 0);
+		}
+		if (category.itemExists("slowRequestThreshold"))
+		{
+			long val = atol(category.getValue("slowRequestThreshold").c_str());
+			m_slowThreshold = val > 0 ? val : 0;
+		}
+		if (category.itemExists("lockProfiling"))
+		{
+			LockProfiler::getInstance()->enable(category.getValue("lockProfiling").compare("true") == 0);
+		}
+		if (category.itemExists("spanFile"))
+		{
+			Tracing::getInstance()->setSpanFile(category.getValue("spanFile"));
+		}
+		if (category.itemExists("requestJournal"))
+		{
+			m_journalDurability = RequestJournal::parseDurability(category.getValue("requestJournal"));
+		}
+
 		// Get Storage service
-		ServiceRecord storageInfo("", "Storage");
-		if (!m_mgtClient->getService(storageInfo))
+		if (!storageLookup.get())
 		{
 			m_logger->fatal("Unable to find Fledge storage "
 					"connection info for service '" + m_name + "'");
@@ -297,37 +494,84 @@ bool DispatcherService::start(string& coreAddress,
 			       storageInfo.getAddress().c_str(),
 			       storageInfo.getPort());
 
-		// Setup StorageClient
-		StorageClient storageClient(storageInfo.getAddress(),
+		// Setup StorageClient, it is shared by all the threads of the
+		// service for its lifetime. The client holds a keep-alive
+		// connection per thread so each worker reuses its connection.
+		m_storage = new StorageClient(storageInfo.getAddress(),
 					    storageInfo.getPort());
-		m_storage = &storageClient;
 
-		m_mgtClient->addAuditEntry("DSPST",
+		// Control statistics are accumulated in memory and written periodically
+		m_statistics = new ControlStatistics(m_storage);
+		if (category.itemExists("statisticsInterval"))
+		{
+			long val = atol(category.getValue("statisticsInterval").c_str());
+			m_statistics->setInterval(val > 0 ? val : 0);
+		}
+		m_statistics->start();
+		CallerAccounting::getInstance()->setStatistics(m_statistics);
+		phases.phase("storage");
+
+		started = async(launch::async, [this]() {
+				return m_mgtClient->addAuditEntry("DSPST",
 						"INFORMATION",
 						"{\"name\": \"" + m_name + "\"}");
+			});
 	}
 
-	// Create default security category
-	this->createSecurityCategories(m_mgtClient, m_dryRun);
+	// Wait for the default security category
+	security.get();
+	phases.phase("security");
 
 	if (!m_dryRun)
 	{
 		// Start the control filter pipeline manager
 		m_pipelineManager = new ControlPipelineManager(m_mgtClient, m_storage);
 		m_pipelineManager->setService(this);
-		m_pipelineManager->loadPipelines();
+		m_pipelineManager->setFilterTimeout(m_filterTimeout);
+		m_pipelineManager->setSnapshot(PipelineSnapshot::defaultPath(m_name));
+		// Read the requests that were accepted but not executed
+		// before the service last stopped, they are replayed once
+		// the pipelines are current
+		openJournal(true);
+		phases.phase("journal");
+
+		if (m_pipelineManager->loadSnapshot())
+		{
+			// Serve from the snapshot, storage is checked in the background
+			// and the journal replayed once it has been
+			m_pipelineManager->reconcile();
+		}
+		else
+		{
+			m_pipelineManager->loadPipelines();
+			replayJournal();
+		}
+		phases.phase("pipelines");
+
+		// The start audit entry has been written whilst the pipelines loaded
+		if (!started.get())
+		{
+			m_logger->warn("Failed to write the audit entry for the start of the dispatcher service '%s'",
+					m_name.c_str());
+		}
 
 		// Start the worker threads after loading the pipelines
 		// to prevent the execution without havign the pipelien details
 		for (int i = 0; i < m_worker_threads; i++)
 		{
-			new thread(worker_thread, this);
+			startWorker();
 		}
+		m_watchdog->start();
+		phases.phase("workers");
+		m_logger->info("Dispatcher service '%s' started in %.1f ms: %s",
+				m_name.c_str(), phases.total(), phases.toString().c_str());
 
 		// .... wait until shutdown ...
 
 		// Wait for all the API threads to complete
 		m_api->wait();
+		m_watchdog->stop();
+		m_statistics->stop();
 
 		// Shutdown is starting ...
 		// NOTE:
@@ -354,6 +598,7 @@ bool DispatcherService::start(string& coreAddress,
 	m_managementApi->stop();
 
 	// Flush all data in the queues
+	AsyncLogger::getInstance()->stop();
 	m_logger->info("Dispatcher service '" + m_name + "' shutdown completed.");
 
 	return true;
@@ -370,7 +615,7 @@ void DispatcherService::stop(bool removeFromCore)
 		m_removeFromCore = false;
 	}
 	m_stopping = true;
-	m_cv.notify_all();
+	m_requests.shutdown();
 	// Stop the DispatcherApi
 	m_api->stop();
 }
@@ -418,7 +663,7 @@ void DispatcherService::cleanupResources()
 void DispatcherService::configChange(const string& categoryName,
 				       const string& category)
 {
-	m_logger->debug("Category change '%s'", categoryName.c_str());
+	DEBUG_LOG(m_logger, "Category change '%s'", categoryName.c_str());
 	if (categoryName.compare(m_name) == 0)
 	{
 			m_logger->warn("Configuration change for '%s' category not implemented yet",
@@ -454,9 +699,49 @@ void DispatcherService::configChange(const string& categoryName,
 		ConfigCategory config(categoryName, category);
 		if (config.itemExists("logLevel"))
 		{
-			m_logger->setMinLevel(config.getValue("logLevel"));
+			DebugLog::setMinLevel(m_logger, config.getValue("logLevel"));
 			m_logger->info("Setting log level to %s", config.getValue("logLevel").c_str());
 		}
+		if (config.itemExists("filterCompletionTimeout"))
+		{
+			long val = atol(config.getValue("filterCompletionTimeout").c_str());
+			m_filterTimeout = val > 0 ? val : 0;
+			if (m_pipelineManager)
+				m_pipelineManager->setFilterTimeout(m_filterTimeout);
+		}
+		if (config.itemExists("executionBudget"))
+		{
+			long val = atol(config.getValue("executionBudget").c_str());
+			m_watchdog->setBudget(val > 0 ? val : 0);
+		}
+		if (config.itemExists("quarantineStuck"))
+		{
+			m_watchdog->setQuarantine(config.getValue("quarantineStuck").compare("true") == 0);
+		}
+		if (config.itemExists("slowRequestThreshold"))
+		{
+			long val = atol(config.getValue("slowRequestThreshold").c_str());
+			m_slowThreshold = val > 0 ? val : 0;
+		}
+		if (config.itemExists("lockProfiling"))
+		{
+			LockProfiler::getInstance()->enable(config.getValue("lockProfiling").compare("true") == 0);
+		}
+		if (config.itemExists("spanFile"))
+		{
+			Tracing::getInstance()->setSpanFile(config.getValue("spanFile"));
+		}
+		if (config.itemExists("statisticsInterval") && m_statistics)
+		{
+			long val = atol(config.getValue("statisticsInterval").c_str());
+			m_statistics->setInterval(val > 0 ? val : 0);
+		}
+		if (config.itemExists("requestJournal"))
+		{
+			m_journalDurability = RequestJournal::parseDurability(config.getValue("requestJournal"));
+			if (m_pipelineManager)
+				openJournal(false);
+		}
 	}
 	else if (categoryName.compare(m_name+"Security") == 0)
 	{
@@ -498,12 +783,117 @@ void DispatcherService::registerCategory(const string& categoryName)
  */
 bool DispatcherService::queue(ControlRequest *request)
 {
-	lock_guard<mutex> guard(m_mutex);
+	// A replayed request was counted when it was first received
+	bool replayed = request->getJournalSequence() != 0;
+	RequestJournal *journal = m_journal.load();
+	if (journal && !replayed)
+		journal->append(request);
+
+	DispatcherMetrics *metrics = DispatcherMetrics::getInstance();
+	if (!replayed)
+		metrics->increment(MetricRequestsQueued);
+	metrics->adjust(MetricQueueDepth, 1);
+	request->getTimings().m_queued = RequestTimings::now();
+	if (m_statistics && !replayed)
+		m_statistics->record(StatisticReceived, request->getDestinationName(),
+				request->getCallerName());
 	m_requests.push(request);
-	m_cv.notify_all();
+	DISPATCHER_PROBE4(request_enqueue, request->getTraceId().c_str(), request->getRequestType(),
+			request->getDestinationName().c_str(), m_requests.size());
 	return true;
 }
 
+/**
+ * Open the request journal if journaling is enabled. If the journal is
+ * already open only the durability is changed, once opened the journal
+ * remains open so that the requests already journaled are marked as done
+ * as they complete.
+ *
+ * When the service starts the requests that were accepted but had not
+ * completed when the service last stopped are read from the journal and
+ * held until replayJournal is called. When journaling is enabled whilst
+ * the service is running the records in the journal predate the time
+ * journaling was disabled and are discarded.
+ *
+ * @param replay	Read the requests in the journal for replay
+ */
+void DispatcherService::openJournal(bool replay)
+{
+	lock_guard<mutex> guard(m_journalMutex);
+	RequestJournal *journal = m_journal.load();
+	if (journal)
+	{
+		journal->setDurability(m_journalDurability);
+		return;
+	}
+	if (m_journalDurability == JournalOff)
+		return;
+
+	journal = new RequestJournal(RequestJournal::defaultPath(m_name), m_journalDurability);
+	if (!journal->open())
+	{
+		delete journal;
+		return;
+	}
+	if (replay)
+		journal->replay(m_replay);
+	else
+		journal->reset();
+	m_journal = journal;
+}
+
+/**
+ * Queue the requests read from the request journal when the service
+ * started. Called once the control pipelines are current, so that the
+ * requests are executed by the pipelines held in storage rather than
+ * those in the snapshot.
+ */
+void DispatcherService::replayJournal()
+{
+	vector<ControlRequest *> requests;
+	{
+		lock_guard<mutex> guard(m_journalMutex);
+		requests.swap(m_replay);
+	}
+	for (auto request : requests)
+		queue(request);
+}
+
+/**
+ * Return a snapshot of the runtime state of the dispatcher. The snapshot
+ * is assembled from the state each component publishes and does not wait
+ * for requests that are being executed.
+ *
+ * @return string	The JSON document describing the dispatcher state
+ */
+string DispatcherService::statusToJSON()
+{
+	DispatcherMetrics *metrics = DispatcherMetrics::getInstance();
+	string json = "{ \"queue\" : { \"depth\" : " + to_string(m_requests.size());
+	json += ", \"destinations\" : { ";
+	bool first = true;
+	for (auto& it : m_requests.depthByDestination())
+	{
+		string destination = it.first;
+		StringEscapeQuotes(destination);
+		if (!first)
+			json += ", ";
+		first = false;
+		json += "\"" + destination + "\" : " + to_string(it.second);
+	}
+	json += " } }";
+	json += ", \"in_flight\" : " + to_string(metrics->getGauge(MetricInFlight));
+	json += ", \"workers\" : " + m_watchdog->workersToJSON();
+	if (m_pipelineManager)
+		json += ", \"control\" : " + m_pipelineManager->statusToJSON();
+	FlightRecorder *recorder = FlightRecorder::getInstance();
+	uint64_t recorded = recorder->recorded();
+	json += ", \"flight_recorder\" : { \"size\" : " + to_string(FLIGHT_RECORDER_SIZE);
+	json += ", \"occupied\" : " + to_string(recorded < FLIGHT_RECORDER_SIZE ? recorded : FLIGHT_RECORDER_SIZE);
+	json += " } }";
+	return json;
+}
+
 /**
  * Return the next request to process or NULL if the service is shutting down
  *
@@ -511,30 +901,128 @@ bool DispatcherService::queue(ControlRequest *request)
  */
 ControlRequest *DispatcherService::getRequest()
 {
-	unique_lock<mutex> lock(m_mutex);
-	while (m_requests.empty())
-	{
-		if (m_stopping)
-			return NULL;
-		m_cv.wait(lock);
-	}
-	ControlRequest *ret = m_requests.front();
-	m_requests.pop();
+	ControlRequest *ret = m_requests.pop();
+	if (!ret)
+		return NULL;
+
+	ret->getTimings().m_dequeued = RequestTimings::now();
+	DispatcherMetrics *metrics = DispatcherMetrics::getInstance();
+	metrics->increment(MetricRequestsDequeued);
+	metrics->adjust(MetricQueueDepth, -1);
+	DISPATCHER_PROBE3(request_dequeue, ret->getTraceId().c_str(), ret->getDestinationName().c_str(),
+			ret->getTimings().m_dequeued - ret->getTimings().m_queued);
 	return ret;
 }
 
 /**
- * Worker thread that executes the control functions
+ * Start a new worker thread and register it with the execution watchdog
  */
-void DispatcherService::worker()
+void DispatcherService::startWorker()
+{
+	WorkerState *state = new WorkerState(++m_workerId);
+	m_watchdog->addWorker(state);
+	new thread(worker_thread, this, state);
+}
+
+/**
+ * Worker thread that executes the control functions. A worker that has
+ * been abandoned by the execution watchdog exits once the request it is
+ * executing completes, a replacement worker will have been started.
+ *
+ * @param state		The execution state of the worker
+ */
+void DispatcherService::worker(WorkerState *state)
 {
 ControlRequest *request;
+DispatcherMetrics *metrics = DispatcherMetrics::getInstance();
 
-	while ((request = getRequest()) != NULL)
+	WorkerState::setCurrent(state);
+	while (!state->isAbandoned() && (request = getRequest()) != NULL)
 	{
-		request->execute(this);
+		metrics->adjust(MetricInFlight, 1);
+		string destination = request->getDestination().toString();
+		RequestTimings::setCurrent(&request->getTimings());
+		ControlStatistics::setCaller(request->getCallerName());
+		{
+			state->begin(destination);
+			WorkerStageScope scope(state);
+			request->execute(this);
+		}
+		if (request->isFilteredOut() && m_statistics)
+			m_statistics->record(StatisticFiltered, request->getDestinationName());
+		RequestTimings::setCurrent(NULL);
+		LatencyRegistry::getInstance()->record(request->getRequestType(), destination,
+				request->getTimings());
+		Tracing::getInstance()->exportSpan(request->getTraceId(), request->getRequestType(),
+				destination, request->getCallerName(), request->getTimings());
+		FlightRecorder::getInstance()->record(request->getRequestType(), request->getTraceId(),
+				destination, request->getCallerName(), request->getPipelineName(),
+				request->isFilteredOut(), request->getTimings());
+		CallerAccounting::getInstance()->record(request);
+		checkSlowRequest(request, state, destination);
+		if (request->getJournalSequence())
+		{
+			RequestJournal *journal = m_journal.load();
+			if (journal)
+				journal->complete(request->getJournalSequence());
+		}
+		if (!m_firstServed.load(memory_order_relaxed) && !m_firstServed.exchange(true))
+		{
+			AsyncLogger::getInstance()->info("First control request served %.1f ms after the dispatcher service started",
+					(RequestTimings::now() - m_startTime) / 1000000.0);
+		}
 		delete request;
+		metrics->adjust(MetricInFlight, -1);
+		metrics->increment(MetricRequestsCompleted);
+	}
+	if (state->isAbandoned())
+	{
+		AsyncLogger::getInstance()->warn("Abandoned dispatcher worker %d has completed its request", state->getId());
 	}
+	m_watchdog->removeWorker(state);
+	WorkerState::setCurrent(NULL);
+	delete state;
+}
+
+/**
+ * Check if a completed control request exceeded the slow request threshold.
+ * A slow request is logged with the time spent in each stage of its
+ * execution and counted against its destination and control pipeline.
+ *
+ * @param request	The completed control request
+ * @param state		The execution state of the worker that executed the request
+ * @param destination	The printable destination of the request
+ */
+void DispatcherService::checkSlowRequest(ControlRequest *request, WorkerState *state,
+					const string& destination)
+{
+	unsigned int threshold = m_slowThreshold;
+	if (threshold == 0)
+		return;
+	const RequestTimings& timings = request->getTimings();
+	int64_t completed = RequestTimings::now();
+	int64_t total = timings.duration(LatencyTotal, completed);
+	if (total < (int64_t)threshold * 1000)
+		return;
+
+	const string& pipeline = request->getPipelineName();
+	DispatcherMetrics *metrics = DispatcherMetrics::getInstance();
+	metrics->increment(MetricSlowDestination, destination);
+	if (!pipeline.empty())
+		metrics->increment(MetricSlowPipeline, pipeline);
+
+	int64_t stages[LatencyStageCount];
+	for (int stage = 0; stage < LatencyStageCount; stage++)
+	{
+		int64_t duration = timings.duration(stage, completed);
+		stages[stage] = duration > 0 ? duration / 1000 : 0;
+	}
+	AsyncLogger::getInstance()->warn("Slow %s request to %s took %ldms on worker %d, "
+			"parse %ldms, queue wait %ldms, pipeline '%s' %ldms, delivery %ldms, trace ID %s",
+			request->getRequestType(), destination.c_str(), (long)(total / 1000),
+			state->getId(), (long)stages[LatencyParse], (long)stages[LatencyQueue],
+			pipeline.c_str(), (long)stages[LatencyFilter], (long)stages[LatencyDeliver],
+			request->getTraceId().c_str());
 }
 
 /**
@@ -545,24 +1033,77 @@ ControlRequest *request;
  * @param serviceName	The name of the service to send to
  * @param url		The url path component to send to on the service API of the service
  * @param payload	The JSON payload to send
+ * @param sourceName	The name of the source of the control request
+ * @param sourceType	The type of the source of the control request
+ * @param traceId	The trace ID of the control request
  * @return bool		True if the payload was delivered to the service
  */
 bool DispatcherService::sendToService(const string& serviceName,
 				const string& url,
 				const string& payload,
 				const string& sourceName,
-				const string& sourceType)
+				const string& sourceType,
+				const string& traceId)
 {
 	if (!m_enable)
 	{
-		m_logger->warn("Control functions are currently disabled, control request to service %s is not being sent", serviceName.c_str());
+		AsyncLogger::getInstance()->warn("Control functions are currently disabled, control request to service %s is not being sent", serviceName.c_str());
 		return false;
 	}
+	WorkerState *state = WorkerState::current();
+	if (state)
+		state->delivering(serviceName);
+	WorkerStageScope scope(state);
+
+	RequestTimings *timings = RequestTimings::current();
+	if (timings)
+		timings->deliveryStarted();
+	DISPATCHER_PROBE3(delivery_start, traceId.c_str(), serviceName.c_str(), payload.length());
+	bool delivered = deliverToService(serviceName, url, payload, sourceName, sourceType, traceId);
+	DISPATCHER_PROBE3(delivery_end, traceId.c_str(), serviceName.c_str(), delivered);
+	if (timings)
+		timings->deliveryEnded(delivered);
+
+	DispatcherMetrics *metrics = DispatcherMetrics::getInstance();
+	if (delivered)
+	{
+		metrics->increment(MetricDeliverySuccess);
+		metrics->increment(MetricServiceSuccess, serviceName);
+	}
+	else
+	{
+		metrics->increment(MetricDeliveryFailure);
+		metrics->increment(MetricServiceFailure, serviceName);
+	}
+	if (m_statistics)
+		m_statistics->record(delivered ? StatisticDelivered : StatisticFailed, serviceName);
+	return delivered;
+}
+
+/**
+ * Deliver a JSON payload to the service API of a specified service using
+ * a PUT operation.
+ *
+ * @param serviceName	The name of the service to send to
+ * @param url		The url path component to send to on the service API of the service
+ * @param payload	The JSON payload to send
+ * @param sourceName	The name of the source of the control request
+ * @param sourceType	The type of the source of the control request
+ * @param traceId	The trace ID of the control request
+ * @return bool		True if the payload was delivered to the service
+ */
+bool DispatcherService::deliverToService(const string& serviceName,
+				const string& url,
+				const string& payload,
+				const string& sourceName,
+				const string& sourceType,
+				const string& traceId)
+{
 	try {
 		ServiceRecord service(serviceName);
 		if (!m_mgtClient->getService(service))
 		{
-			Logger::getLogger()->error("Unable to find service '%s'", serviceName.c_str());
+			AsyncLogger::getInstance()->error("Unable to find service '%s'", serviceName.c_str());
 			return false;
 		}
 		string address = service.getAddress();
@@ -570,6 +1111,12 @@ bool DispatcherService::sendToService(const string& serviceName,
 		char addressAndPort[80];
 		snprintf(addressAndPort, sizeof(addressAndPort), "%s:%d", address.c_str(), port);
 		SimpleWeb::Client<SimpleWeb::HTTP> http(addressAndPort);
+		unsigned int budget = m_watchdog->getBudget();
+		if (budget)
+		{
+			// Do not allow a service that fails to respond to pin the worker
+			http.config.timeout = (budget + 999) / 1000;
+		}
 
 		try {
 			SimpleWeb::CaseInsensitiveMultimap headers = {{"Content-Type", "application/json"}};
@@ -581,24 +1128,29 @@ bool DispatcherService::sendToService(const string& serviceName,
 			}
 			headers.emplace("Service-Orig-From", sourceName);
 			headers.emplace("Service-Orig-Type", sourceType);
+			if (!traceId.empty())
+			{
+				headers.emplace(TRACE_ID_HEADER, traceId);
+			}
 			auto res = http.request("PUT", url, payload, headers);
 			if (res->status_code.compare("200 OK"))
 			{
-				Logger::getLogger()->error(
-						"Failed to send set point operation to service %s, %s, %s",
-							serviceName.c_str(), res->status_code.c_str(),
+				AsyncLogger::getInstance()->error(
+						"Failed to send set point operation to service %s, trace %s, %s, %s",
+							serviceName.c_str(), traceId.c_str(),
+							res->status_code.c_str(),
 							res->content.string().c_str());
 				return false;
 			}
 		} catch (exception& e) {
-			Logger::getLogger()->error("Failed to send set point operation to service %s, %s",
-						serviceName.c_str(), e.what());
+			AsyncLogger::getInstance()->error("Failed to send set point operation to service %s, trace %s, %s",
+						serviceName.c_str(), traceId.c_str(), e.what());
 			return false;
 		}
 		return true;
 	}
 	catch (exception &e) {
-		Logger::getLogger()->error("Failed to send to service %s, %s: %s",
+		AsyncLogger::getInstance()->error("Failed to send to service %s, %s: %s",
 				serviceName.c_str(), url.c_str(), e.what());
 		return false;
 	}
@@ -0,0 +1,188 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <filter_config.h>
+#include <management_client.h>
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * Return the configuration category of a filter from the Fledge core
+ *
+ * @param name		The name of the category
+ * @return ConfigCategory	The category
+ */
+ConfigCategory ManagementConfigProvider::getCategory(const string& name)
+{
+	return m_management->getCategory(name);
+}
+
+/**
+ * Create or update a configuration category in the Fledge core
+ *
+ * @param category	The default configuration category
+ * @param keepOriginalItems	Keep the values of existing items
+ * @return bool		True if the category was created
+ */
+bool ManagementConfigProvider::addCategory(const DefaultConfigCategory& category, bool keepOriginalItems)
+{
+	return m_management->addCategory(category, keepOriginalItems);
+}
+
+/**
+ * Construct the filter configuration from a JSON file
+ *
+ * @param path	The path of the configuration file
+ * @throws runtime_error	If the file cannot be read or is not valid
+ */
+FileConfigProvider::FileConfigProvider(const string& path)
+{
+	ifstream file(path);
+	if (!file)
+	{
+		throw runtime_error("Unable to open the filter configuration file " + path);
+	}
+	stringstream content;
+	content << file.rdbuf();
+
+	Document doc;
+	doc.Parse(content.str().c_str());
+	if (doc.HasParseError() || !doc.IsObject())
+	{
+		throw runtime_error("The filter configuration file " + path + " is not a valid JSON object");
+	}
+	if (!doc.HasMember("filters") || !doc["filters"].IsObject())
+	{
+		throw runtime_error("The filter configuration file " + path + " does not contain a filters object");
+	}
+	for (auto& filter : doc["filters"].GetObject())
+	{
+		if (!filter.value.IsObject())
+		{
+			throw runtime_error(string("The configuration of the filter ")
+					+ filter.name.GetString() + " should be an object");
+		}
+		map<string, string>& values = m_values[filter.name.GetString()];
+		for (auto& item : filter.value.GetObject())
+		{
+			if (item.value.IsString())
+			{
+				values[item.name.GetString()] = item.value.GetString();
+			}
+			else
+			{
+				StringBuffer buffer;
+				Writer<StringBuffer> writer(buffer);
+				item.value.Accept(writer);
+				values[item.name.GetString()] = buffer.GetString();
+			}
+		}
+	}
+}
+
+/**
+ * Return the configuration category of a filter. Before the category has
+ * been created from the defaults of the plugin only the items given in
+ * the file are present.
+ *
+ * @param name		The name of the category
+ * @return ConfigCategory	The category, empty if the filter is not in the file
+ */
+ConfigCategory FileConfigProvider::getCategory(const string& name)
+{
+	auto created = m_categories.find(name);
+	if (created != m_categories.end())
+	{
+		return ConfigCategory(name, created->second);
+	}
+
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	writer.StartObject();
+	auto it = m_values.find(name);
+	if (it != m_values.end())
+	{
+		for (auto& value : it->second)
+		{
+			writer.Key(value.first.c_str());
+			writer.StartObject();
+			writer.Key("description");
+			writer.String("");
+			writer.Key("type");
+			writer.String("string");
+			writer.Key("default");
+			writer.String(value.second.c_str());
+			writer.Key("value");
+			writer.String(value.second.c_str());
+			writer.EndObject();
+		}
+	}
+	writer.EndObject();
+	return ConfigCategory(name, buffer.GetString());
+}
+
+/**
+ * Create a configuration category from the defaults of a filter plugin.
+ * Items given in the file take the value from the file, all other items
+ * take their default value. The values in the file always take precedence,
+ * hence keepOriginalItems has no effect.
+ *
+ * @param category	The default configuration category
+ * @param keepOriginalItems	Unused
+ * @return bool		True if the category was created
+ */
+bool FileConfigProvider::addCategory(const DefaultConfigCategory& category, bool keepOriginalItems)
+{
+	Document defaults;
+	defaults.Parse(category.itemsToJSON().c_str());
+	if (defaults.HasParseError() || !defaults.IsObject())
+	{
+		return false;
+	}
+	const map<string, string>& values = m_values[category.getName()];
+
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	writer.StartObject();
+	for (auto& item : defaults.GetObject())
+	{
+		if (!item.value.IsObject())
+			continue;
+		string value;
+		auto it = values.find(item.name.GetString());
+		if (it != values.end())
+			value = it->second;
+		else if (item.value.HasMember("default") && item.value["default"].IsString())
+			value = item.value["default"].GetString();
+
+		writer.Key(item.name.GetString());
+		writer.StartObject();
+		for (auto& property : item.value.GetObject())
+		{
+			if (string(property.name.GetString()).compare("value") == 0)
+				continue;
+			writer.Key(property.name.GetString());
+			property.value.Accept(writer);
+		}
+		writer.Key("value");
+		writer.String(value.c_str());
+		writer.EndObject();
+	}
+	writer.EndObject();
+	m_categories[category.getName()] = buffer.GetString();
+	return true;
+}
@@ -0,0 +1,256 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <flight_recorder.h>
+#include <logger.h>
+#include <string_utils.h>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+
+using namespace std;
+
+volatile sig_atomic_t FlightRecorder::m_dumpRequested = 0;
+
+static const char *stageNames[LatencyStageCount] = {
+	"parse", "queue", "filter", "deliver", "total"
+};
+
+static const char *outcomeNames[] = {
+	"none", "delivered", "partial", "failed"
+};
+
+/**
+ * Return the singleton flight recorder
+ *
+ * @return FlightRecorder*	The flight recorder
+ */
+FlightRecorder *FlightRecorder::getInstance()
+{
+	static FlightRecorder instance;
+	return &instance;
+}
+
+/**
+ * Record the handling of a control request. This is called by the worker
+ * thread once the request has been executed. The slot is claimed with a
+ * single atomic increment and the request details copied into it, no
+ * memory is allocated and no locks are taken.
+ *
+ * @param type		The type of the request
+ * @param traceId	The trace ID of the request
+ * @param destination	The destination of the request
+ * @param caller	The name of the caller
+ * @param pipeline	The control pipeline executed, may be empty
+ * @param filteredOut	The control pipeline removed the request
+ * @param timings	The timestamps of the stages of the request
+ */
+void FlightRecorder::record(const char *type, const string& traceId,
+		const string& destination, const string& caller, const string& pipeline,
+		bool filteredOut, const RequestTimings& timings)
+{
+	uint64_t index = m_next.fetch_add(1, memory_order_relaxed);
+	Slot& slot = m_slots[index & (FLIGHT_RECORDER_SIZE - 1)];
+
+	slot.m_sequence.store((index * 2) + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	strncpy(slot.m_type, type, sizeof(slot.m_type) - 1);
+	slot.m_type[sizeof(slot.m_type) - 1] = 0;
+	copy(slot.m_traceId, traceId, sizeof(slot.m_traceId));
+	copy(slot.m_destination, destination, sizeof(slot.m_destination));
+	copy(slot.m_caller, caller, sizeof(slot.m_caller));
+	copy(slot.m_pipeline, pipeline, sizeof(slot.m_pipeline));
+	int64_t completed = RequestTimings::now();
+	for (int stage = 0; stage < LatencyStageCount; stage++)
+	{
+		slot.m_stages[stage] = timings.duration(stage, completed);
+	}
+	slot.m_completed = chrono::duration_cast<chrono::microseconds>(
+			chrono::system_clock::now().time_since_epoch()).count();
+	slot.m_filteredOut = filteredOut;
+	slot.m_deliveries = timings.m_deliveries;
+	slot.m_failures = timings.m_failures;
+	if (timings.m_failures == 0)
+		slot.m_outcome = timings.m_deliveries ? OutcomeDelivered : OutcomeNone;
+	else
+		slot.m_outcome = timings.m_deliveries ? OutcomePartial : OutcomeFailed;
+
+	slot.m_sequence.store((index * 2) + 2, memory_order_release);
+}
+
+/**
+ * Copy a string into a fixed size field of a slot, truncating it if required
+ *
+ * @param dest	The field to copy into
+ * @param src	The string to copy
+ * @param size	The size of the field
+ */
+void FlightRecorder::copy(char *dest, const string& src, size_t size)
+{
+	size_t len = src.length() < size - 1 ? src.length() : size - 1;
+	memcpy(dest, src.data(), len);
+	dest[len] = 0;
+}
+
+/**
+ * Return the contents of the flight recorder as a JSON document, the
+ * requests are ordered from the oldest to the most recent. Slots that are
+ * being written while the recorder is read are omitted.
+ *
+ * @return string	The JSON document
+ */
+string FlightRecorder::toJSON()
+{
+	uint64_t next = m_next.load(memory_order_acquire);
+	uint64_t first = next > FLIGHT_RECORDER_SIZE ? next - FLIGHT_RECORDER_SIZE : 0;
+
+	string json = "{ \"size\" : " + to_string(FLIGHT_RECORDER_SIZE);
+	json += ", \"recorded\" : " + to_string(next);
+	json += ", \"requests\" : [ ";
+	bool firstRequest = true;
+	Slot snapshot;
+	for (uint64_t index = first; index < next; index++)
+	{
+		const Slot& slot = m_slots[index & (FLIGHT_RECORDER_SIZE - 1)];
+		uint64_t sequence = slot.m_sequence.load(memory_order_acquire);
+		if (sequence != (index * 2) + 2)
+			continue;	// Being written or already overwritten
+		memcpy(snapshot.m_type, slot.m_type, sizeof(snapshot.m_type));
+		memcpy(snapshot.m_traceId, slot.m_traceId, sizeof(snapshot.m_traceId));
+		memcpy(snapshot.m_destination, slot.m_destination, sizeof(snapshot.m_destination));
+		memcpy(snapshot.m_caller, slot.m_caller, sizeof(snapshot.m_caller));
+		memcpy(snapshot.m_pipeline, slot.m_pipeline, sizeof(snapshot.m_pipeline));
+		memcpy(snapshot.m_stages, slot.m_stages, sizeof(snapshot.m_stages));
+		snapshot.m_completed = slot.m_completed;
+		snapshot.m_outcome = slot.m_outcome;
+		snapshot.m_filteredOut = slot.m_filteredOut;
+		snapshot.m_deliveries = slot.m_deliveries;
+		snapshot.m_failures = slot.m_failures;
+		atomic_thread_fence(memory_order_acquire);
+		if (slot.m_sequence.load(memory_order_relaxed) != sequence)
+			continue;	// Overwritten while it was copied
+		if (!firstRequest)
+			json += ", ";
+		firstRequest = false;
+		json += slotToJSON(snapshot);
+	}
+	json += " ] }";
+	return json;
+}
+
+/**
+ * Return the JSON representation of a recorded request
+ *
+ * @param slot		The recorded request
+ * @return string	The JSON object
+ */
+string FlightRecorder::slotToJSON(const Slot& slot)
+{
+	string destination = slot.m_destination;
+	string caller = slot.m_caller;
+	string pipeline = slot.m_pipeline;
+	StringEscapeQuotes(destination);
+	StringEscapeQuotes(caller);
+	StringEscapeQuotes(pipeline);
+
+	string json = "{ \"completed\" : " + to_string(slot.m_completed);
+	json += ", \"type\" : \"" + string(slot.m_type) + "\"";
+	json += ", \"trace_id\" : \"" + string(slot.m_traceId) + "\"";
+	json += ", \"destination\" : \"" + destination + "\"";
+	json += ", \"caller\" : \"" + caller + "\"";
+	json += ", \"pipeline\" : \"" + pipeline + "\"";
+	json += ", \"filtered_out\" : ";
+	json += slot.m_filteredOut ? "true" : "false";
+	json += ", \"outcome\" : \"" + string(outcomeNames[slot.m_outcome]) + "\"";
+	json += ", \"deliveries\" : " + to_string(slot.m_deliveries);
+	json += ", \"failures\" : " + to_string(slot.m_failures);
+	json += ", \"stages_us\" : { ";
+	bool first = true;
+	for (int stage = 0; stage < LatencyStageCount; stage++)
+	{
+		if (slot.m_stages[stage] < 0)
+			continue;
+		if (!first)
+			json += ", ";
+		first = false;
+		json += "\"" + string(stageNames[stage]) + "\" : " + to_string(slot.m_stages[stage]);
+	}
+	json += " } }";
+	return json;
+}
+
+/**
+ * Write the contents of the flight recorder to a file in the Fledge data
+ * directory. The name of the file includes the process ID and the time of
+ * the dump so that successive dumps do not overwrite each other.
+ *
+ * @param path		Returns the path of the file written
+ * @return bool		True if the file was written
+ */
+bool FlightRecorder::dump(string& path)
+{
+	string dir;
+	if (getenv("FLEDGE_DATA"))
+		dir = getenv("FLEDGE_DATA");
+	else if (getenv("FLEDGE_ROOT"))
+		dir = string(getenv("FLEDGE_ROOT")) + "/data";
+	else
+		dir = "/tmp";
+	path = dir + "/dispatcher_flight_recorder_" + to_string(getpid())
+		+ "_" + to_string(time(NULL)) + ".json";
+
+	string json = toJSON();
+	FILE *fp = fopen(path.c_str(), "w");
+	if (!fp)
+	{
+		Logger::getLogger()->error("Unable to create the flight recorder dump file %s, %s",
+				path.c_str(), strerror(errno));
+		return false;
+	}
+	bool ok = fwrite(json.data(), 1, json.length(), fp) == json.length();
+	if (fclose(fp) != 0)
+		ok = false;
+	if (!ok)
+	{
+		Logger::getLogger()->error("Failed to write the flight recorder dump file %s",
+				path.c_str());
+		return false;
+	}
+	Logger::getLogger()->info("Flight recorder written to %s", path.c_str());
+	return true;
+}
+
+/**
+ * Request that the flight recorder is dumped. This is safe to call from a
+ * signal handler, the dump itself is performed by the next call to
+ * checkDump.
+ */
+void FlightRecorder::requestDump()
+{
+	m_dumpRequested = 1;
+}
+
+/**
+ * Dump the flight recorder if a dump has been requested
+ */
+void FlightRecorder::checkDump()
+{
+	if (m_dumpRequested)
+	{
+		m_dumpRequested = 0;
+		string path;
+		dump(path);
+	}
+}
@@ -0,0 +1,91 @@
+#ifndef _ASYNC_LOGGER_H
+#define _ASYNC_LOGGER_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <logger.h>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+#define ASYNC_LOG_SLOTS		1024	// Must be a power of 2
+#define ASYNC_LOG_MESSAGE_SIZE	480	// Longer messages are truncated
+#define ASYNC_LOG_RATE		100	// Maximum messages written per second
+#define ASYNC_LOG_DEDUP_ENTRIES	256	// Maximum distinct messages tracked per second
+#define ASYNC_LOG_DRAIN_INTERVAL	50	// Milliseconds
+
+/**
+ * A logger for the request processing paths of the dispatcher that never
+ * blocks the calling thread on the write to syslog.
+ *
+ * Messages are formatted into a slot of a bounded lock free ring and written
+ * to the Fledge logger by a background thread. If the ring is full the
+ * message is dropped and counted. The background thread removes repeats
+ * of identical messages, reporting the number of repeats once a second,
+ * and limits the rate at which messages are written so that an error storm,
+ * such as every request failing because a south service is down, does not
+ * flood syslog.
+ *
+ * Messages logged before the background thread is started, or after it is
+ * stopped, are written directly to the Fledge logger.
+ */
+class AsyncLogger {
+	public:
+		enum Level { LevelInfo, LevelWarn, LevelError };
+
+		static AsyncLogger	*getInstance();
+		void			start();
+		void			stop();
+		void			info(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+		void			warn(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+		void			error(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+		void			run();
+	private:
+		/**
+		 * A slot in the ring. The sequence number of the slot
+		 * records if the slot is free or holds a message.
+		 */
+		class Slot {
+			public:
+				std::atomic<size_t>	m_sequence;
+				Level			m_level;
+				char			m_message[ASYNC_LOG_MESSAGE_SIZE];
+		};
+		AsyncLogger();
+		~AsyncLogger();
+		void			log(Level level, const char *fmt, va_list args);
+		void			drain();
+		void			write(Level level, const std::string& message);
+		void			endWindow();
+	private:
+		Slot			m_slots[ASYNC_LOG_SLOTS];
+		std::atomic<size_t>	m_tail;		// Next slot to write
+		size_t			m_head;		// Next slot to read, only used by the drain thread
+		std::atomic<bool>	m_running;
+		std::atomic<int>	m_producers;	// Threads currently queuing a message
+		std::atomic<long>	m_dropped;
+		std::thread		*m_thread;
+		std::mutex		m_mutex;
+		std::condition_variable	m_cv;
+		// State of the drain thread for the current one second window
+		std::unordered_map<std::string, long>
+					m_repeats;
+		long			m_written;
+		long			m_suppressed;
+		std::chrono::steady_clock::time_point
+					m_windowStart;
+};
+
+#endif
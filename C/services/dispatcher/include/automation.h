@@ -65,11 +65,16 @@ class Script {
 		{
 			m_request_url = url;
 		};
+		void	setTraceId(const std::string& traceId)
+		{
+			m_traceId = traceId;
+		};
 
 	private:
 		std::string	m_source_name;
 		std::string	m_source_type;
 		std::string	m_request_url;
+		std::string	m_traceId;
 };
 
 /**
@@ -106,11 +111,16 @@ class ScriptStep {
 		{
 			m_request_url = url;
 		};
+		void	setTraceId(const std::string& traceId)
+		{
+			m_traceId = traceId;
+		};
 
 	protected:
 		std::string	m_source_name;
 		std::string	m_source_type;
 		std::string	m_request_url;
+		std::string	m_traceId;
 };
 
 /**
@@ -0,0 +1,44 @@
+#ifndef _CALLER_ACCOUNTING_H
+#define _CALLER_ACCOUNTING_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <atomic>
+
+class ControlRequest;
+class ControlStatistics;
+
+/**
+ * The resources consumed by the control requests of each caller of the
+ * dispatcher. A caller is identified by the caller name of the request,
+ * which is the authenticated caller if the service requires
+ * authentication.
+ *
+ * The accounts are not held separately, they are the per-caller entries
+ * of the control statistics. Hence the number of callers accounted for
+ * individually is capped in the same way as the statistics, requests from
+ * further callers are accounted to a single overflow entry.
+ */
+class CallerAccounting {
+	public:
+		static CallerAccounting	*getInstance();
+		void			setStatistics(ControlStatistics *statistics);
+		void			record(ControlRequest *request);
+		std::string		toPrometheus();
+		std::string		toJSON();
+	private:
+		CallerAccounting();
+	private:
+		std::atomic<ControlStatistics *>
+					m_statistics;
+};
+
+#endif
@@ -12,7 +12,10 @@
  */
 #include <string>
 #include <vector>
+#include <memory>
+#include <atomic>
 #include <pipeline_manager.h>
+#include <pipeline_predicate.h>
 
 class PipelineExecutionContext;
 
@@ -48,6 +51,15 @@ class ContextEndpoints {
 		~ContextEndpoints();
 		void		setContext(PipelineExecutionContext *context);
 
+		/**
+		 * Release the ownership of the execution context, the
+		 * context will no longer be deleted with the endpoints.
+		 */
+		void		releaseContext()
+				{
+					m_context = NULL;
+				}
+
 		/**
 		 * Get the Pipeline Execution Context
 		 *
@@ -69,6 +81,28 @@ class ContextEndpoints {
 					return m_source.match(rhs.m_source) && m_dest.match(rhs.m_dest);
 				}
 
+		/**
+		 * Return the source endpoint of the context
+		 *
+		 * @return PipelineEndpoint	The source endpoint
+		 */
+		const PipelineEndpoint&
+				getSource() const
+				{
+					return m_source;
+				}
+
+		/**
+		 * Return the destination endpoint of the context
+		 *
+		 * @return PipelineEndpoint	The destination endpoint
+		 */
+		const PipelineEndpoint&
+				getDestination() const
+				{
+					return m_dest;
+				}
+
 	private:
 		PipelineEndpoint		m_source;
 		PipelineEndpoint		m_dest;
@@ -77,12 +111,26 @@ class ContextEndpoints {
 
 /**
  * Encapsulation of a control pipeline
+ *
+ * The pipeline is reference counted. The pipeline manager holds a
+ * reference for as long as the pipeline is configured, requests and the
+ * worker states that refer to the pipeline hold a reference whilst they
+ * use it. The pipeline is deleted when the last reference is released.
  */
 class ControlPipeline {
 	public:
 		ControlPipeline(ControlPipelineManager *manager, const std::string& name);
 		~ControlPipeline();
 
+		/**
+		 * Add a reference to the pipeline
+		 */
+		void			acquire()
+					{
+						m_references.fetch_add(1);
+					};
+		void			release();
+
 		/**
 		 * Set the enabled state of the pipeline
 		 *
@@ -122,7 +170,9 @@ class ControlPipeline {
 		 */
 		void			setPipeline(const std::vector<std::string>& pipeline)
 					{
+						std::lock_guard<ProfiledMutex> guard(m_contextMutex);
 						m_pipeline = pipeline;
+						compilePredicate();
 					}
 
 		/**
@@ -159,12 +209,47 @@ class ControlPipeline {
 						return m_name;
 					}
 
+		/**
+		 * Return the source endpoint of the pipeline
+		 *
+		 * @return PipelineEndpoint	The source endpoint
+		 */
+		const PipelineEndpoint&	getSource() const
+					{
+						return m_source;
+					}
+
+		/**
+		 * Return the destination endpoint of the pipeline
+		 *
+		 * @return PipelineEndpoint	The destination endpoint
+		 */
+		const PipelineEndpoint&	getDestination() const
+					{
+						return m_dest;
+					}
+
+		/**
+		 * Return true if the pipeline has exclusive execution
+		 *
+		 * @return bool		Pipeline exclusive state
+		 */
+		bool			isExclusive() const
+					{
+						return m_exclusive;
+					}
+
 		PipelineExecutionContext
 					*getExecutionContext(const PipelineEndpoint& source,
 							const PipelineEndpoint& dest);
+		PipelineExecutionContext
+					*createDryRunContext();
+		bool			accepts(const KVList& values, const std::string *operation);
 		void			addFilter(const std::string& filter, int order);
 		void			removeFilter(const std::string& filter);
 		void			reorder(const std::string& filter, int order);
+		bool			quarantine(PipelineExecutionContext *context);
+		std::string		toJSON();
 
 		/**
 		 * Return true if the pipeline is enabled
@@ -177,6 +262,7 @@ class ControlPipeline {
 					}
 	private:
 		void			removeAllContexts();
+		void			compilePredicate();
 	private:
 		std::string		m_name;
 		bool			m_enable;
@@ -187,11 +273,30 @@ class ControlPipeline {
 					m_pipeline;
 		PipelineExecutionContext
 					*m_sharedContext;
-		std::vector<ContextEndpoints>
+		std::vector<ContextEndpoints *>
 					m_contexts;
 		ControlPipelineManager	*m_manager;
-		std::mutex		m_contextMutex;
+		std::atomic<int>	m_references;
+		ProfiledMutex		m_contextMutex;
+		std::shared_ptr<const PipelinePredicate>
+					m_predicate;	// Replaced atomically, read without a lock
 		Logger			*m_logger;
 };
 
+/**
+ * A scope guard that releases a reference to a control pipeline when the
+ * guard goes out of scope
+ */
+class ControlPipelineReference {
+	public:
+		ControlPipelineReference(ControlPipeline *pipeline) : m_pipeline(pipeline) {};
+		~ControlPipelineReference()
+		{
+			if (m_pipeline)
+				m_pipeline->release();
+		};
+	private:
+		ControlPipeline		*m_pipeline;
+};
+
 #endif
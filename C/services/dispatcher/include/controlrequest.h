@@ -16,6 +16,8 @@
 #include <string>
 #include <kvlist.h>
 #include <pipeline_manager.h>
+#include <pipeline_trace.h>
+#include <latency.h>
 
 class DispatcherService;
 
@@ -25,9 +27,45 @@ class DispatcherService;
  */
 class ControlRequest {
 	public:
+		ControlRequest() : m_filteredOut(false), m_journalSequence(0), m_dryRun(false) {};
+		virtual ~ControlRequest() {};
 		virtual void execute(DispatcherService *) = 0;
 		virtual PipelineEndpoint getDestination() = 0;
 
+		/**
+		 * Pass the control request through the control pipeline that
+		 * matches the source and destination of the request
+		 *
+		 * @param manager	The control pipeline manager
+		 * @param trace		An optional trace of the pipeline execution
+		 */
+		virtual void filter(ControlPipelineManager *manager, PipelineTrace *trace = NULL) = 0;
+
+		/**
+		 * Return the payload that will be sent to the destination
+		 * of the control request
+		 *
+		 * @return string	The JSON payload
+		 */
+		virtual std::string getPayload() = 0;
+
+		/**
+		 * Return the type of the control request
+		 *
+		 * @return string	The request type
+		 */
+		virtual const char *getRequestType() const = 0;
+
+		/**
+		 * Return the timestamps of the stages of the control request
+		 *
+		 * @return RequestTimings&	The timestamps of the request
+		 */
+		RequestTimings&	getTimings()
+		{
+			return m_timings;
+		};
+
 		/**
 		 * Set the source name from the authentication sent for
 		 * the caller. Note this is only done if the call is 
@@ -77,7 +115,90 @@ class ControlRequest {
 			m_callerName = name;
 		};
 
+		/**
+		 * Return if the control pipeline removed the request
+		 *
+		 * @return bool	True if the request was removed by the pipeline
+		 */
+		bool	isFilteredOut() const
+		{
+			return m_filteredOut;
+		};
+
+		/**
+		 * Set the trace ID used to correlate the handling of the
+		 * request in the dispatcher and the destination service
+		 *
+		 * @param traceId	The trace ID of the request
+		 */
+		void	setTraceId(const std::string& traceId)
+		{
+			m_traceId = traceId;
+		};
+
+		/**
+		 * Return the trace ID of the request
+		 *
+		 * @return string	The trace ID
+		 */
+		const std::string&	getTraceId() const
+		{
+			return m_traceId;
+		};
+
+		/**
+		 * Return the name of the control pipeline that was
+		 * executed for the request
+		 *
+		 * @return string	The pipeline name, empty if no pipeline was executed
+		 */
+		const std::string&	getPipelineName() const
+		{
+			return m_pipeline;
+		};
+
+		/**
+		 * Set the sequence number of the record of the request
+		 * in the request journal
+		 *
+		 * @param sequence	The journal sequence number
+		 */
+		void	setJournalSequence(uint64_t sequence)
+		{
+			m_journalSequence = sequence;
+		};
+
+		/**
+		 * Return the sequence number of the record of the request
+		 * in the request journal
+		 *
+		 * @return uint64_t	The sequence number, 0 if the request is not journaled
+		 */
+		uint64_t	getJournalSequence() const
+		{
+			return m_journalSequence;
+		};
+
+		/**
+		 * Mark the request as a dry run. A dry run is filtered in
+		 * a throwaway execution context and is not counted in the
+		 * pipeline metrics.
+		 *
+		 * @param dryRun	True if the request is a dry run
+		 */
+		void	setDryRun(bool dryRun)
+		{
+			m_dryRun = dryRun;
+		};
+
 		PipelineEndpoint	getSource();
+		std::string		getCallerName();
+		std::string		getDestinationName();
+		static ControlRequest	*createWrite(const std::string& destination,
+						const std::string& name, KVList& values);
+		static ControlRequest	*createOperation(const std::string& destination,
+						const std::string& name, const std::string& operation,
+						KVList& parameters);
 
 	public:
 		std::string	m_source_name;
@@ -85,6 +206,13 @@ class ControlRequest {
 		std::string	m_request_url;
 		std::string	m_callerType;
 		std::string	m_callerName;
+	protected:
+		RequestTimings	m_timings;
+		bool		m_filteredOut;
+		std::string	m_traceId;
+		std::string	m_pipeline;
+		uint64_t	m_journalSequence;
+		bool		m_dryRun;
 };
 
 /**
@@ -96,8 +224,10 @@ class WriteControlRequest : public ControlRequest {
 		{
 		};
 		virtual void execute(DispatcherService *) = 0;
-	protected:
-		void	     filter(ControlPipelineManager *manager);
+		void	     filter(ControlPipelineManager *manager, PipelineTrace *trace = NULL);
+		std::string  getPayload();
+		const char   *getRequestType() const { return "write"; };
+		const KVList& getValues() const { return m_values; };
 	protected:
 		KVList				m_values;
 };
@@ -213,9 +343,12 @@ class ControlOperationRequest : public ControlRequest {
 		{
 		};
 		virtual void	execute(DispatcherService *) = 0;
-
-	protected:
-		void		filter(ControlPipelineManager *manager);
+		void		filter(ControlPipelineManager *manager, PipelineTrace *trace = NULL);
+		std::string	getPayload();
+		const char	*getRequestType() const { return "operation"; };
+		const std::string&
+				getOperation() const { return m_operation; };
+		const KVList&	getParameters() const { return m_parameters; };
 	protected:
 		std::string			m_operation;
 		KVList				m_parameters;
@@ -0,0 +1,61 @@
+#ifndef _DEBUG_LOG_H
+#define _DEBUG_LOG_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <logger.h>
+#include <string>
+#include <atomic>
+
+/*
+ * Log a debug message. The arguments of the message are only evaluated if
+ * debug logging is enabled, expensive arguments such as the JSON form of a
+ * reading therefore cost nothing at the default log level.
+ */
+#define DEBUG_LOG(logger, ...)	do { if (DebugLog::enabled()) (logger)->debug(__VA_ARGS__); } while (0)
+
+/**
+ * Tracks if debug logging is enabled so that the check made by DEBUG_LOG
+ * is a single load rather than a comparison of the log level string
+ */
+class DebugLog {
+	public:
+		/**
+		 * Return if debug logging is enabled
+		 *
+		 * @return bool	True if debug messages are logged
+		 */
+		static bool	enabled()
+				{
+					return flag().load(std::memory_order_relaxed);
+				};
+
+		/**
+		 * Set the minimum log level of a logger, this must be used
+		 * in place of calling setMinLevel on the logger directly
+		 *
+		 * @param logger	The logger
+		 * @param level		The minimum level to log
+		 */
+		static void	setMinLevel(Logger *logger, const std::string& level)
+				{
+					logger->setMinLevel(level);
+					flag().store(level.compare("debug") == 0, std::memory_order_relaxed);
+				};
+	private:
+		static std::atomic<bool>&
+				flag()
+				{
+					static std::atomic<bool> enabled(false);
+					return enabled;
+				};
+};
+
+#endif
@@ -21,6 +21,11 @@ using HttpServer = SimpleWeb::Server<SimpleWeb::HTTP>;
  */
 #define	DISPATCH_WRITE			"/dispatch/write"
 #define DISPATCH_OPERATION		"/dispatch/operation"
+#define DISPATCH_DRYRUN			"/dispatch/dryrun"
+#define DISPATCH_METRICS		"/dispatch/metrics"
+#define DISPATCH_FLIGHT_RECORDER	"/dispatch/flightrecorder"
+#define DISPATCH_STATUS			"/dispatch/status"
+#define DISPATCH_CALLERS		"/dispatch/callers"
 
 /*
  * URL's for monitor pipeline definitions
@@ -34,6 +39,7 @@ using HttpServer = SimpleWeb::Server<SimpleWeb::HTTP>;
 #define ESCAPE_SPECIAL_CHARS		"\\{\\}\\\"\\(\\)\\!\\[\\]\\^\\$\\.\\|\\?\\*\\+\\-"
 
 class ControlRequest;
+class KVList;
 class DispatcherService;
 
 /**
@@ -62,6 +68,18 @@ class DispatcherApi
 						shared_ptr<HttpServer::Request> request);
 		void		operation(shared_ptr<HttpServer::Response> response,
 						shared_ptr<HttpServer::Request> request);
+		void		dryRun(shared_ptr<HttpServer::Response> response,
+						shared_ptr<HttpServer::Request> request);
+		void		metrics(shared_ptr<HttpServer::Response> response,
+						shared_ptr<HttpServer::Request> request);
+		void		flightRecorder(shared_ptr<HttpServer::Response> response,
+						shared_ptr<HttpServer::Request> request);
+		void		dumpFlightRecorder(shared_ptr<HttpServer::Response> response,
+						shared_ptr<HttpServer::Request> request);
+		void		status(shared_ptr<HttpServer::Response> response,
+						shared_ptr<HttpServer::Request> request);
+		void		callers(shared_ptr<HttpServer::Response> response,
+						shared_ptr<HttpServer::Request> request);
 		void		tableInsert(shared_ptr<HttpServer::Response> response,
 						shared_ptr<HttpServer::Request> request);
 		void		tableDelete(shared_ptr<HttpServer::Response> response,
@@ -78,6 +96,7 @@ class DispatcherApi
 					SimpleWeb::StatusCode,
 					const string&);
 		bool		queueRequest(ControlRequest *);
+		std::string	getTraceId(shared_ptr<HttpServer::Request> request);
 
 	private:
 		static DispatcherApi*		m_instance;
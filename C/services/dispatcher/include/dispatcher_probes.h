@@ -0,0 +1,76 @@
+#ifndef _DISPATCHER_PROBES_H
+#define _DISPATCHER_PROBES_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+
+/*
+ * Static user space tracepoints (USDT) on the control request path for use
+ * with bpftrace, perf and SystemTap. The probes belong to the provider
+ * "dispatcher" and are listed with
+ *
+ *   bpftrace -l 'usdt:/usr/local/fledge/services/fledge.services.dispatcher:*'
+ *
+ * Each probe has a semaphore that is non-zero only while a tracer is
+ * attached to it. The arguments of a probe are only evaluated when the
+ * semaphore is set, an unused probe costs a test of the semaphore and a
+ * nop instruction. If sys/sdt.h is not available when the dispatcher is
+ * built the probes compile to nothing.
+ *
+ * The probes and their arguments, trace_id is the trace ID of the request:
+ *
+ *   request_parse(trace_id, type, destination, payload_bytes)
+ *   request_enqueue(trace_id, type, destination, queue_depth)
+ *   request_dequeue(trace_id, destination, queue_wait_ns)
+ *   pipeline_match(trace_id, destination, pipeline)	pipeline is "" if none matched
+ *   filter_start(trace_id, pipeline, values)
+ *   filter_end(trace_id, pipeline, values, forwarded)
+ *   delivery_start(trace_id, service, payload_bytes)
+ *   delivery_end(trace_id, service, delivered)
+ */
+#ifdef HAVE_SYS_SDT_H
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define DISPATCHER_PROBE_SEMAPHORE(name)	dispatcher_##name##_semaphore
+
+extern unsigned short DISPATCHER_PROBE_SEMAPHORE(request_parse);
+extern unsigned short DISPATCHER_PROBE_SEMAPHORE(request_enqueue);
+extern unsigned short DISPATCHER_PROBE_SEMAPHORE(request_dequeue);
+extern unsigned short DISPATCHER_PROBE_SEMAPHORE(pipeline_match);
+extern unsigned short DISPATCHER_PROBE_SEMAPHORE(filter_start);
+extern unsigned short DISPATCHER_PROBE_SEMAPHORE(filter_end);
+extern unsigned short DISPATCHER_PROBE_SEMAPHORE(delivery_start);
+extern unsigned short DISPATCHER_PROBE_SEMAPHORE(delivery_end);
+
+#define DISPATCHER_PROBE_ENABLED(name)	__builtin_expect(DISPATCHER_PROBE_SEMAPHORE(name), 0)
+
+#define DISPATCHER_PROBE3(name, a1, a2, a3) \
+	do { \
+		if (DISPATCHER_PROBE_ENABLED(name)) \
+			DTRACE_PROBE3(dispatcher, name, a1, a2, a3); \
+	} while (0)
+
+#define DISPATCHER_PROBE4(name, a1, a2, a3, a4) \
+	do { \
+		if (DISPATCHER_PROBE_ENABLED(name)) \
+			DTRACE_PROBE4(dispatcher, name, a1, a2, a3, a4); \
+	} while (0)
+
+#else
+
+#define DISPATCHER_PROBE_ENABLED(name)		0
+#define DISPATCHER_PROBE3(name, a1, a2, a3)	do { } while (0)
+#define DISPATCHER_PROBE4(name, a1, a2, a3, a4)	do { } while (0)
+
+#endif
+
+#endif
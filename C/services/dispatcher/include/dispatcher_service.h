@@ -21,11 +21,19 @@
 #include <condition_variable>
 #include <queue>
 #include <pipeline_manager.h>
+#include <watchdog.h>
+#include <request_queue.h>
+#include <statistics.h>
+#include <request_journal.h>
+#include <atomic>
 #include <rapidjson/document.h>
 
 #define SERVICE_NAME		"Fledge Dispatcher"
 #define SERVICE_TYPE		"Dispatcher"
 #define DEFAULT_WORKER_THREADS	2
+#define DEFAULT_EXECUTION_BUDGET	"30000"
+#define DEFAULT_SLOW_REQUEST_THRESHOLD	"1000"
+#define LISTENER_START_TIMEOUT	30000	// Milliseconds
 
 /**
  * The DispatcherService class.
@@ -48,14 +56,22 @@ class DispatcherService : public ServiceAuthHandler
 		void			configChange(const std::string&,
 						     const std::string&);
 		void			registerCategory(const std::string& categoryName);
+
+		/**
+		 * Return the storage client of the service. The client is owned
+		 * by the service and shared by all of its threads, it is NULL
+		 * until the storage service has been located and in a dry run.
+		 */
 		StorageClient*		getStorageClient() { return m_storage; };
 		bool			queue(ControlRequest *request);
-		void			worker();
+		void			worker(WorkerState *state);
+		void			startWorker();
 		bool			sendToService(const std::string& service, 
 						const std::string& url,
 						const std::string& payload,
 						const std::string& sourceName,
-						const std::string& sourceType);
+						const std::string& sourceType,
+						const std::string& traceId = "");
 		void			configChildCreate(const std::string& parent_category,
 							const std::string&,
 							const std::string&) {};
@@ -72,9 +88,21 @@ class DispatcherService : public ServiceAuthHandler
 		void			rowInsert(const std::string& table, const rapidjson::Document& doc);
 		void			rowUpdate(const std::string& table, const rapidjson::Document& doc);
 		void			rowDelete(const std::string& table, const rapidjson::Document& doc);
+		std::string		statusToJSON();
+		void			replayJournal();
 
 	private:
 		ControlRequest		*getRequest();
+		bool			deliverToService(const std::string& service,
+						const std::string& url,
+						const std::string& payload,
+						const std::string& sourceName,
+						const std::string& sourceType,
+						const std::string& traceId);
+		void			checkSlowRequest(ControlRequest *request,
+						WorkerState *state,
+						const std::string& destination);
+		void			openJournal(bool replay);
 
 	private:
 		Logger*				m_logger;
@@ -86,14 +114,23 @@ class DispatcherService : public ServiceAuthHandler
 						m_registerCategories;
 		unsigned long			m_worker_threads;
 		const std::string       	m_token;
-		std::queue<ControlRequest *>	m_requests;
-		std::mutex			m_mutex;
-		std::condition_variable		m_cv;
+		RequestQueue			m_requests;
 		bool				m_stopping;
 		bool				m_enable;
 		bool				m_dryRun;
 		bool				m_restartRequest;
 		bool				m_removeFromCore;
 		ControlPipelineManager		*m_pipelineManager;
+		unsigned int			m_filterTimeout;
+		ExecutionWatchdog		*m_watchdog;
+		std::atomic<int>		m_workerId;
+		ControlStatistics		*m_statistics;
+		std::atomic<unsigned int>	m_slowThreshold;
+		int64_t				m_startTime;
+		std::atomic<bool>		m_firstServed;
+		std::atomic<RequestJournal *>	m_journal;
+		JournalDurability		m_journalDurability;
+		std::mutex			m_journalMutex;
+		std::vector<ControlRequest *>	m_replay;
 };
 #endif
@@ -0,0 +1,87 @@
+#ifndef _FILTER_CONFIG_H
+#define _FILTER_CONFIG_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <map>
+#include <config_category.h>
+
+class ManagementClient;
+
+/**
+ * The source of the configuration categories of the filter plugins in a
+ * pipeline execution context. In the dispatcher service the categories
+ * are held by the Fledge core, tools that run pipelines outside of Fledge
+ * may provide the categories from elsewhere.
+ */
+class FilterConfigProvider {
+	public:
+		virtual ~FilterConfigProvider() {};
+
+		/**
+		 * Return the configuration category of a filter
+		 *
+		 * @param name		The name of the category
+		 * @return ConfigCategory	The category with its current values
+		 */
+		virtual ConfigCategory	getCategory(const std::string& name) = 0;
+
+		/**
+		 * Create a configuration category from the default
+		 * configuration of a filter plugin
+		 *
+		 * @param category	The default configuration category
+		 * @param keepOriginalItems	Keep the values of existing items
+		 * @return bool		True if the category was created
+		 */
+		virtual bool		addCategory(const DefaultConfigCategory& category,
+						bool keepOriginalItems) = 0;
+};
+
+/**
+ * The filter configuration held by the Fledge core, accessed via the
+ * management client of the service
+ */
+class ManagementConfigProvider : public FilterConfigProvider {
+	public:
+		ManagementConfigProvider(ManagementClient *management) :
+			m_management(management) {};
+		ConfigCategory		getCategory(const std::string& name);
+		bool			addCategory(const DefaultConfigCategory& category,
+						bool keepOriginalItems);
+	private:
+		ManagementClient	*m_management;
+};
+
+/**
+ * Filter configuration read from a local JSON file. The file contains a
+ * "filters" object with a member for each filter category, giving the
+ * name of the plugin and the values of any configuration items that
+ * differ from the defaults of the plugin.
+ *
+ *   { "filters" : { "scale1" : { "plugin" : "scale", "factor" : "2" } } }
+ *
+ * Values may be strings, numbers, booleans or, for JSON items, objects.
+ */
+class FileConfigProvider : public FilterConfigProvider {
+	public:
+		FileConfigProvider(const std::string& path);
+		ConfigCategory		getCategory(const std::string& name);
+		bool			addCategory(const DefaultConfigCategory& category,
+						bool keepOriginalItems);
+	private:
+		std::map<std::string, std::map<std::string, std::string> >
+					m_values;	// The values from the file per category
+		std::map<std::string, std::string>
+					m_categories;	// The items JSON of the created categories
+};
+
+#endif
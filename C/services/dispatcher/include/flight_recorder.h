@@ -0,0 +1,91 @@
+#ifndef _FLIGHT_RECORDER_H
+#define _FLIGHT_RECORDER_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <csignal>
+#include <latency.h>
+#include <tracing.h>
+
+#define FLIGHT_RECORDER_SIZE	4096	// Number of requests retained, must be a power of 2
+#define FLIGHT_RECORDER_NAME	64	// Longer names are truncated
+
+/**
+ * The flight recorder retains the details of the most recent control
+ * requests processed by the dispatcher so that they can be examined after
+ * an incident. The recorder is a fixed size ring, recording a request
+ * costs a few copies into a preallocated slot and no locks are taken.
+ *
+ * The contents may be fetched with the flight recorder API entry point or
+ * written to a file by sending SIGUSR1 to the dispatcher.
+ */
+class FlightRecorder {
+	public:
+		/**
+		 * The outcome of the delivery of a control request
+		 */
+		enum Outcome { OutcomeNone, OutcomeDelivered, OutcomePartial, OutcomeFailed };
+
+		static FlightRecorder	*getInstance();
+		void			record(const char *type,
+						const std::string& traceId,
+						const std::string& destination,
+						const std::string& caller,
+						const std::string& pipeline,
+						bool filteredOut,
+						const RequestTimings& timings);
+		std::string		toJSON();
+		bool			dump(std::string& path);
+
+		/**
+		 * Return the total number of requests recorded, the recorder
+		 * retains the most recent FLIGHT_RECORDER_SIZE of these
+		 *
+		 * @return uint64_t	The number of requests recorded
+		 */
+		uint64_t		recorded() const { return m_next.load(std::memory_order_relaxed); };
+		static void		requestDump();
+		void			checkDump();
+	private:
+		/**
+		 * A recorded control request. The sequence number is odd
+		 * while the slot is being written so that readers can detect
+		 * and skip a slot that is changing under them.
+		 */
+		class Slot {
+			public:
+				Slot() : m_sequence(0) {};
+				std::atomic<uint64_t>	m_sequence;
+				char			m_type[16];
+				char			m_traceId[MAX_TRACE_ID_LENGTH + 1];
+				char			m_destination[FLIGHT_RECORDER_NAME];
+				char			m_caller[FLIGHT_RECORDER_NAME];
+				char			m_pipeline[FLIGHT_RECORDER_NAME];
+				int64_t			m_completed;	// Wall clock time in microseconds
+				int64_t			m_stages[LatencyStageCount];	// Microseconds, -1 if not executed
+				Outcome			m_outcome;
+				bool			m_filteredOut;
+				unsigned int		m_deliveries;
+				unsigned int		m_failures;
+		};
+		FlightRecorder() : m_next(0) {};
+		static void		copy(char *dest, const std::string& src, size_t size);
+		std::string		slotToJSON(const Slot& slot);
+	private:
+		Slot			m_slots[FLIGHT_RECORDER_SIZE];
+		std::atomic<uint64_t>	m_next;
+		static volatile sig_atomic_t
+					m_dumpRequested;
+};
+
+#endif
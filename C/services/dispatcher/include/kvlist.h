@@ -14,6 +14,7 @@
 #include <rapidjson/document.h>
 #include <string>
 #include <vector>
+#include <functional>
 #include <reading.h>
 
 /**
@@ -35,12 +36,16 @@ class KVList {
 		Reading			*toReading(const std::string& asset);
 		void			fromReading(Reading *);
 		std::string		toString() const;
-
+		void			transform(const std::function<bool (std::string&, std::string&)>& fn);
+		bool			anyKey(const std::function<bool (const std::string&)>& fn) const;
+		void			forEach(const std::function<void (const std::string&,
+							const std::string&)>& fn) const;
+		static DatapointValue::DatapointTag
+					deduceType(const std::string& value);
 
 	private:
 		void			substitute(std::string& value, const KVList& values);
 		Datapoint		*createDatapoint(const std::string& name, const std::string& value);
-		DatapointValue::DatapointTag deduceType(const std::string& value);
 		std::vector<Datapoint *> *JSONtoDatapoints(const rapidjson::Value& json);
 		std::vector<std::pair<std::string, std::string> >
 					m_list;
@@ -0,0 +1,133 @@
+#ifndef _LATENCY_H
+#define _LATENCY_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/*
+ * The histogram buckets are log-linear, values below 32 microseconds have
+ * a bucket each, above that each power of two is split into 16 buckets.
+ * This gives a relative error of less than 7% up to the largest value.
+ */
+#define LATENCY_SUB_BUCKETS	16
+#define LATENCY_MAX_MSB		40
+#define LATENCY_BUCKETS		(32 + (LATENCY_MAX_MSB - 4) * LATENCY_SUB_BUCKETS)
+
+/*
+ * The maximum number of distinct request type and destination pairs for
+ * which latency is recorded
+ */
+#define LATENCY_TABLE_SIZE	256
+
+/**
+ * The stages of the processing of a control request
+ */
+enum LatencyStage {
+	LatencyParse,		// API receipt until the request is queued
+	LatencyQueue,		// Queued until taken by a worker
+	LatencyFilter,		// Execution of the control pipeline
+	LatencyDeliver,		// Delivery to the destination service(s)
+	LatencyTotal,		// API receipt until completion
+	LatencyStageCount
+};
+
+/**
+ * The timestamps of the stages of a control request. The timestamps are
+ * steady clock times in nanoseconds, a value of 0 means the stage was
+ * not executed.
+ */
+class RequestTimings {
+	public:
+		RequestTimings() : m_received(0), m_queued(0), m_dequeued(0),
+				m_filterStart(0), m_filterEnd(0),
+				m_deliveryStart(0), m_deliveryEnd(0),
+				m_deliveries(0), m_failures(0) {};
+		/**
+		 * Return the current steady clock time in nanoseconds
+		 */
+		static int64_t		now()
+					{
+						return std::chrono::duration_cast<std::chrono::nanoseconds>(
+							std::chrono::steady_clock::now().time_since_epoch()).count();
+					};
+		static RequestTimings	*current() { return m_current; };
+		static void		setCurrent(RequestTimings *timings) { m_current = timings; };
+		void			deliveryStarted();
+		void			deliveryEnded(bool delivered);
+		int64_t			duration(int stage, int64_t completed) const;
+	public:
+		int64_t			m_received;
+		int64_t			m_queued;
+		int64_t			m_dequeued;
+		int64_t			m_filterStart;
+		int64_t			m_filterEnd;
+		int64_t			m_deliveryStart;
+		int64_t			m_deliveryEnd;
+		unsigned int		m_deliveries;	// Successful deliveries
+		unsigned int		m_failures;	// Failed deliveries
+	private:
+		static thread_local RequestTimings
+					*m_current;
+};
+
+/**
+ * A lock free log-linear histogram of latencies in microseconds
+ */
+class LatencyHistogram {
+	public:
+		LatencyHistogram();
+		void			record(uint64_t value);
+		uint64_t		quantile(double q) const;
+		uint64_t		getCount() const { return m_count.load(std::memory_order_relaxed); };
+		uint64_t		getSum() const { return m_sum.load(std::memory_order_relaxed); };
+	private:
+		static int		bucket(uint64_t value);
+		static uint64_t		bucketValue(int bucket);
+	private:
+		std::atomic<uint64_t>	m_buckets[LATENCY_BUCKETS];
+		std::atomic<uint64_t>	m_count;
+		std::atomic<uint64_t>	m_sum;
+};
+
+/**
+ * The registry of latency histograms for each request type and destination.
+ *
+ * The histograms are held in a fixed size open addressing table. Entries
+ * are claimed with a compare and swap and never removed, hence recording
+ * a latency never takes a lock.
+ */
+class LatencyRegistry {
+	public:
+		static LatencyRegistry	*getInstance();
+		void			record(const std::string& type,
+						const std::string& destination,
+						const RequestTimings& timings);
+		std::string		toPrometheus();
+	private:
+		LatencyRegistry();
+		class Entry {
+			public:
+				Entry(const std::string& type, const std::string& destination) :
+					m_type(type), m_destination(destination) {};
+				const std::string	m_type;
+				const std::string	m_destination;
+				LatencyHistogram	m_stages[LatencyStageCount];
+		};
+		Entry			*find(const std::string& type, const std::string& destination);
+		static uint64_t		hash(const std::string& type, const std::string& destination);
+	private:
+		std::atomic<Entry *>	m_entries[LATENCY_TABLE_SIZE];
+};
+
+#endif
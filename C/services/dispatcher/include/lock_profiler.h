@@ -0,0 +1,146 @@
+#ifndef _LOCK_PROFILER_H
+#define _LOCK_PROFILER_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * The locks of the dispatcher that may be profiled. All the instances of
+ * a lock, for example the mutex of each pipeline execution context, are
+ * accounted together.
+ */
+enum LockId {
+	LockRequestQueue,
+	LockPipelines,
+	LockPipelineContexts,
+	LockExecutionContext,
+	LockIdCount
+};
+
+/**
+ * The accounting of the wait and hold times of the dispatcher locks.
+ *
+ * Profiling is disabled by default, a disabled profiler costs a single
+ * relaxed load of the enabled flag per lock operation.
+ */
+class LockProfiler {
+	public:
+		static LockProfiler	*getInstance();
+
+		/**
+		 * Return true if lock profiling is enabled
+		 */
+		static bool		enabled()
+					{
+						return m_enabled.load(std::memory_order_relaxed);
+					};
+		void			enable(bool enable);
+		void			recordWait(LockId lock, int64_t wait);
+		void			recordHold(LockId lock, int64_t hold);
+		void			recordUncontended(LockId lock);
+		std::string		toPrometheus();
+
+		/**
+		 * Return the current time used to measure the locks
+		 *
+		 * @return int64_t	The steady clock time in nanoseconds
+		 */
+		static int64_t		now()
+					{
+						return std::chrono::duration_cast<std::chrono::nanoseconds>(
+							std::chrono::steady_clock::now().time_since_epoch()).count();
+					};
+	private:
+		LockProfiler();
+		/**
+		 * The accounting for a single lock
+		 */
+		class LockStats {
+			public:
+				LockStats();
+				void			reset();
+				std::atomic<uint64_t>	m_acquired;
+				std::atomic<uint64_t>	m_contended;
+				std::atomic<uint64_t>	m_waitTotal;	// Nanoseconds
+				std::atomic<uint64_t>	m_waitMax;
+				std::atomic<uint64_t>	m_holdTotal;	// Nanoseconds
+				std::atomic<uint64_t>	m_holdMax;
+		};
+		static void		updateMax(std::atomic<uint64_t>& max, uint64_t value);
+	private:
+		LockStats		m_stats[LockIdCount];
+		static std::atomic<bool>
+					m_enabled;
+};
+
+/**
+ * A mutex that optionally accounts the time threads wait to acquire it
+ * and the time it is held for. It may be used with std::lock_guard and
+ * std::unique_lock, condition variables must be std::condition_variable_any.
+ */
+class ProfiledMutex {
+	public:
+		ProfiledMutex(LockId id) : m_id(id), m_acquired(0) {};
+		ProfiledMutex(const ProfiledMutex&) = delete;
+		ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+		/**
+		 * Acquire the mutex
+		 */
+		void		lock()
+				{
+					if (!LockProfiler::enabled())
+						m_mutex.lock();
+					else
+						profiledLock();
+				};
+
+		/**
+		 * Acquire the mutex if it is not held
+		 *
+		 * @return bool	True if the mutex was acquired
+		 */
+		bool		try_lock()
+				{
+					if (!m_mutex.try_lock())
+						return false;
+					if (LockProfiler::enabled())
+					{
+						LockProfiler::getInstance()->recordUncontended(m_id);
+						m_acquired = LockProfiler::now();
+					}
+					return true;
+				};
+
+		/**
+		 * Release the mutex
+		 */
+		void		unlock()
+				{
+					if (m_acquired)
+						profiledUnlock();
+					else
+						m_mutex.unlock();
+				};
+	private:
+		void		profiledLock();
+		void		profiledUnlock();
+	private:
+		std::mutex	m_mutex;
+		const LockId	m_id;
+		int64_t		m_acquired;	// Only accessed by the holder of the mutex
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#define METRICS_LABELS		256	// Label values that are counted individually per labelled counter
+#define METRICS_OTHER_LABEL	"other"	// The label under which further label values are counted
+
+/**
+ * The counters maintained by the dispatcher
+ */
+enum MetricCounter {
+	MetricRequestsQueued,
+	MetricRequestsDequeued,
+	MetricRequestsCompleted,
+	MetricPipelineMisses,
+	MetricDeliverySuccess,
+	MetricDeliveryFailure,
+	MetricFilterUnmatched,
+	MetricJournalAppended,
+	MetricJournalReplayed,
+	MetricJournalFull,
+	MetricCounterCount
+};
+
+/**
+ * The counters maintained by the dispatcher that are broken down by
+ * a label, such as the destination service or the pipeline name
+ */
+enum MetricLabelledCounter {
+	MetricPipelineHits,
+	MetricPipelineSkipped,
+	MetricPipelineRemoved,
+	MetricServiceSuccess,
+	MetricServiceFailure,
+	MetricSlowDestination,
+	MetricSlowPipeline,
+	MetricLabelledCount
+};
+
+/**
+ * The gauges maintained by the dispatcher
+ */
+enum MetricGauge {
+	MetricQueueDepth,
+	MetricInFlight,
+	MetricGaugeCount
+};
+
+/**
+ * The registry of the dispatcher runtime metrics.
+ *
+ * Counters are held in per-thread shards, each shard is only updated by
+ * the thread that owns it so updates require no locking or contended
+ * atomic operations. The shards are aggregated when the metrics are read.
+ * When a thread exits its shard is folded into the retired totals and
+ * freed. Gauges are global as they are incremented and decremented by different
+ * threads.
+ *
+ * The label values of the labelled counters come from the control requests,
+ * so the number of distinct values is limited. Once METRICS_LABELS values
+ * have been seen for a counter further values are counted under the
+ * METRICS_OTHER_LABEL label.
+ */
+class DispatcherMetrics {
+	public:
+		static DispatcherMetrics	*getInstance();
+		void				increment(MetricCounter counter);
+		void				increment(MetricLabelledCounter counter,
+							const std::string& label);
+		void				adjust(MetricGauge gauge, long delta);
+		uint64_t			getCounter(MetricCounter counter);
+		long				getGauge(MetricGauge gauge);
+		std::string			toPrometheus();
+		static std::string		escapeLabel(const std::string& label);
+	private:
+		DispatcherMetrics();
+		/**
+		 * The per-thread counters
+		 */
+		class Shard {
+			public:
+				Shard();
+				~Shard();
+				std::atomic<uint64_t>	m_counters[MetricCounterCount];
+				std::map<std::string, std::atomic<uint64_t> *>
+							m_labelled[MetricLabelledCount];
+				std::mutex		m_labelMutex;
+		};
+		/**
+		 * Retires the shard of a thread when the thread exits
+		 */
+		class ShardOwner {
+			public:
+				ShardOwner() : m_shard(NULL) {};
+				~ShardOwner();
+				Shard			*m_shard;
+		};
+		Shard				*getShard();
+		void				retire(Shard *shard);
+		bool				admitLabel(MetricLabelledCounter counter,
+							const std::string& label);
+	private:
+		std::mutex			m_shardsMutex;
+		std::vector<Shard *>		m_shards;
+		uint64_t			m_retired[MetricCounterCount];
+		std::map<std::string, uint64_t>	m_retiredLabelled[MetricLabelledCount];
+		std::atomic<long>		m_gauges[MetricGaugeCount];
+		std::mutex			m_labelsMutex;
+		std::set<std::string>		m_labels[MetricLabelledCount];
+		static thread_local Shard	*m_shard;
+		static thread_local ShardOwner	m_owner;
+};
+
+#endif
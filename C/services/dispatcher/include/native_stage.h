@@ -0,0 +1,131 @@
+#ifndef _NATIVE_STAGE_H
+#define _NATIVE_STAGE_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ * A set of compiled in transformation stages that may be used in a
+ * control pipeline in place of filter plugins.
+ */
+#include <string>
+#include <rapidjson/document.h>
+
+/*
+ * Native stages are declared in the control_filters table using a filter
+ * name with this prefix, followed by the stage name and an optional JSON
+ * object with the parameters of the stage, e.g.
+ *
+ *	native:scale {"datapoint" : "speed", "factor" : 2.5}
+ */
+#define NATIVE_STAGE_PREFIX	"native:"
+
+/**
+ * The base class for the native pipeline stages. A native stage operates
+ * directly upon the key/value pairs of a control request, there is no
+ * conversion to and from a reading as is required for a filter plugin.
+ *
+ * The stages work on one key/value pair at a time, this allows a set of
+ * adjacent native stages to be fused into a single pass over the
+ * key/value list of the request.
+ */
+class NativeStage {
+	public:
+		virtual ~NativeStage() {};
+		static bool		isNative(const std::string& filterName);
+		static NativeStage	*create(const std::string& filterName);
+
+		/**
+		 * Apply the stage to a single key/value pair of a control request
+		 *
+		 * @param key	The key, may be modified by the stage
+		 * @param value	The value, may be modified by the stage
+		 * @return bool	False if the key/value pair should be removed
+		 */
+		virtual bool		apply(std::string& key, std::string& value) const = 0;
+
+		/**
+		 * Return the name of the stage as it appears in the pipeline
+		 *
+		 * @return string	The name of the stage
+		 */
+		const std::string&	getName() const
+					{
+						return m_name;
+					};
+	protected:
+		NativeStage(const std::string& name, const rapidjson::Value& parameters);
+		bool			matches(const std::string& key) const;
+		bool			numeric(const std::string& value, double& result) const;
+		std::string		format(const std::string& original, double value) const;
+		bool			getParameter(const rapidjson::Value& parameters,
+						const char *name, double& value) const;
+	protected:
+		const std::string	m_name;
+		std::string		m_datapoint;	// Empty implies all datapoints
+};
+
+/**
+ * Multiply numeric values by a constant factor
+ */
+class ScaleStage : public NativeStage {
+	public:
+		ScaleStage(const std::string& name, const rapidjson::Value& parameters);
+		bool		apply(std::string& key, std::string& value) const;
+	private:
+		double		m_factor;
+};
+
+/**
+ * Add a constant offset to numeric values
+ */
+class OffsetStage : public NativeStage {
+	public:
+		OffsetStage(const std::string& name, const rapidjson::Value& parameters);
+		bool		apply(std::string& key, std::string& value) const;
+	private:
+		double		m_offset;
+};
+
+/**
+ * Limit numeric values to a given range
+ */
+class ClampStage : public NativeStage {
+	public:
+		ClampStage(const std::string& name, const rapidjson::Value& parameters);
+		bool		apply(std::string& key, std::string& value) const;
+	private:
+		bool		m_hasMin;
+		double		m_min;
+		bool		m_hasMax;
+		double		m_max;
+};
+
+/**
+ * Rename a key within the control request
+ */
+class RenameStage : public NativeStage {
+	public:
+		RenameStage(const std::string& name, const rapidjson::Value& parameters);
+		bool		apply(std::string& key, std::string& value) const;
+	private:
+		std::string	m_to;
+};
+
+/**
+ * Convert numeric values between two units of the same dimension
+ */
+class ConvertStage : public NativeStage {
+	public:
+		ConvertStage(const std::string& name, const rapidjson::Value& parameters);
+		bool		apply(std::string& key, std::string& value) const;
+	private:
+		double		m_factor;
+		double		m_offset;
+};
+
+#endif
@@ -18,43 +18,92 @@
 #include <reading_set.h>
 #include <plugin.h>
 #include <filter_plugin.h>
+#include <kvlist.h>
+#include <pipeline_trace.h>
 #include <mutex>
+#include <condition_variable>
+#include <map>
+#include <atomic>
+#include <lock_profiler.h>
+#include <filter_config.h>
 
 class ControlPipelineManager;
 class FilterPlugin;
+class NativeStage;
 class Reading;
 
 typedef void (*filterReadingSetFn)(OUTPUT_HANDLE *outHandle, READINGSET* readings);
 
+/*
+ * The datapoint added to the reading of a control request in order to
+ * correlate the output of filters that emit data asynchronously with the
+ * request that caused that output.
+ */
+#define CORRELATION_DATAPOINT	"__cid__"
+
+/*
+ * The number of times a control request is passed through the pipeline if
+ * the pipeline is reconfigured whilst waiting for asynchronous output
+ */
+#define MAX_FILTER_ATTEMPTS	3
+
 /**
  * A class that encapsulates the execution context of a control filter pipeline.
  * The context may be shared between different control flows or may be unique
  * to a flow from a given source to destination.
+ *
+ * The pipeline may contain filter plugins and native stages. Adjacent filter
+ * plugins are connected to each other and form a segment of the pipeline that
+ * is passed a reading, adjacent native stages are fused together and applied
+ * in a single pass directly to the key/value list of the control request.
+ *
+ * Filter plugins normally emit their output synchronously within the call to
+ * ingest. If a filter completion timeout is set then the context will also
+ * accept output that is emitted later by the filter, several control requests
+ * may then be in flight in the context at once. Each request is tagged with a
+ * correlation datapoint that is used to match the output to the request.
+ *
+ * The context is reference counted. The pipeline that creates the context
+ * holds the first reference and each request executing in the context holds
+ * another, the context is deleted when the last reference is released. This
+ * allows a pipeline to discard a context whilst requests are still waiting
+ * in it for asynchronous output.
  */
 class PipelineExecutionContext {
 	public:
 		PipelineExecutionContext(ManagementClient *management, const std::string& name, const std::vector<std::string>& filters);
+		PipelineExecutionContext(FilterConfigProvider *config, const std::string& name, const std::vector<std::string>& filters);
 		~PipelineExecutionContext();
 		void				setPipelineManager(ControlPipelineManager *manager) { m_pipelineManager = manager; };
 
-		Reading				*filter(Reading *reading);
+		/**
+		 * Add a reference to the context, the context will not be
+		 * deleted until the reference is released
+		 */
+		void				acquire() { m_references.fetch_add(1); };
+		void				release();
 
-						/**
-						 * Set the result of the pipeline execution
-						 *
-						 * @param result	The output of the filter pipeline
-						 */
-		void				setResult(READINGSET *result)
-						{
-							m_result = result;
-						};
+		bool				filter(KVList& values, std::string& name,
+							PipelineTrace *trace = NULL);
 		void				addFilter(const std::string& filter, int order);
 		void				removeFilter(const std::string& filter);
 		void				reorder(const std::string& filter, int order);
+		std::string			toJSON();
 	private:
 		void				rePlumbFilters();
+		void				publishState();
 		bool				loadPipeline();
 		PLUGIN_HANDLE			loadFilterPlugin(const std::string& filterName);
+		FilterPlugin			*createFilterPlugin(const std::string& categoryName);
+		void				initFilterPlugin(int index, const ConfigCategory& config);
+		bool				runPlugins(int index, KVList& values, std::string& name,
+							std::unique_lock<ProfiledMutex>& lock,
+							unsigned int timeout, PipelineTrace *trace,
+							bool& stale);
+		void				runNativeStages(int start, int end, KVList& values);
+		void				collectResults(READINGSET *readings);
+		unsigned long			getCorrelationId(Reading *reading);
+		std::string			getFilterName(FilterPlugin *plugin);
 
 		static void			passToOnwardFilter(OUTPUT_HANDLE *outHandle, READINGSET* readings);
 		static void			useFilteredData(OUTPUT_HANDLE *outHandle, READINGSET* readings);
@@ -62,12 +111,40 @@ class PipelineExecutionContext {
 	private:
 		std::string			m_name;
 		Logger				*m_logger;
-		ManagementClient		*m_management;
+		FilterConfigProvider		*m_config;
+		bool				m_ownConfig;	// The context created the configuration provider
 		std::vector<std::string>	m_filters;
-		std::vector<FilterPlugin *>	m_plugins;
-		READINGSET			*m_result;
-		std::mutex			m_mutex;
+		std::vector<FilterPlugin *>	m_plugins;	// NULL for native stages
+		std::vector<NativeStage *>	m_native;	// NULL for filter plugins
+		std::atomic<bool>		m_loaded;
+		ProfiledMutex			m_mutex;
+		unsigned long			m_generation;	// Incremented when the stages change
+		std::atomic<int>		m_references;
+		// Published for the status API, which must not take m_mutex
+		std::atomic<int>		m_pluginCount;
+		std::atomic<int>		m_nativeCount;
 		ControlPipelineManager		*m_pipelineManager;
+		/**
+		 * The result of a control request that is in flight in the pipeline
+		 */
+		class PendingResult {
+			public:
+				PendingResult() : m_result(NULL), m_complete(false) {};
+				Reading		*m_result;
+				bool		m_complete;
+		};
+		std::map<unsigned long, PendingResult *>
+						m_pending;
+		unsigned long			m_nextCorrelationId;
+		std::mutex			m_pendingMutex;
+		std::condition_variable		m_pendingCV;
+		// The request being ingested by a filter plugin on this thread
+		static thread_local PipelineTrace
+						*m_trace;
+		static thread_local PipelineExecutionContext
+						*m_ingestContext;
+		static thread_local PendingResult
+						*m_ingestResult;	// Only if the request has no correlation ID
 };
 
 #endif
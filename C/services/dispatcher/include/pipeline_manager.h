@@ -14,15 +14,25 @@
 #include <logger.h>
 #include <storage_client.h>
 #include <map>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <filter_plugin.h>
+#include <lock_profiler.h>
 
 #define PIPELINES_TABLE		"control_pipelines"
 #define PIPELINES_FILTER_TABLE	"control_filters"
 #define SOURCES_TABLE		"control_source"
 #define DESTINATIONS_TABLE	"control_destination"
 
+#define RECONCILE_RETRY_INTERVAL	5	// Seconds
+
 class ControlPipeline;
 class DispatcherService;
+class PipelineDefinition;
+class PipelineSnapshot;
 
 /**
  * Class to encapsulate the endpoint of a control pipeline
@@ -79,6 +89,20 @@ class PipelineEndpoint {
 			}
 		};
 	
+		/**
+		 * Return the name of the endpoint
+		 *
+		 * @return string	The name, empty for endpoints that have no name
+		 */
+		const std::string&	getName() const { return m_name; };
+
+		/**
+		 * Return the type of the endpoint
+		 *
+		 * @return EndpointType	The endpoint type
+		 */
+		EndpointType		getType() const { return m_type; };
+
 		/**
 		 * Match the endpoint against a candidate
 		 *
@@ -158,6 +182,11 @@ class ControlPipelineManager {
 		~ControlPipelineManager();
 		void			loadPipelines(); // From storage
 		long			loadPipeline(std::string& pName); // From storage
+		void			setSnapshot(const std::string& path);
+		bool			loadSnapshot(); // From the local snapshot
+		void			reconcile();
+		bool			reconcilePipelines();
+		void			addPipeline(ControlPipeline *pipeline);
 		ControlPipeline		*findPipeline(const PipelineEndpoint& source,
 							const PipelineEndpoint& dest); // From memory
 
@@ -170,21 +199,35 @@ class ControlPipelineManager {
 					}
 		void			setService(DispatcherService *service) { m_dispatcher = service; };
 
+		/**
+		 * Set the time to wait for filters that emit their output asynchronously
+		 *
+		 * @param timeout	The timeout in milliseconds, 0 implies synchronous filters only
+		 */
+		void			setFilterTimeout(unsigned int timeout) { m_filterTimeout = timeout; };
+
+		/**
+		 * Return the time to wait for filters that emit their output asynchronously
+		 *
+		 * @return unsigned int	The timeout in milliseconds
+		 */
+		unsigned int		getFilterTimeout() { return m_filterTimeout; };
+
 		void			registerCategory(const std::string& category, FilterPlugin *plugin);
 		void			unregisterCategory(const std::string& category, FilterPlugin *plugin);
 		void			categoryChanged(const std::string& name, const std::string& content);
 		void			rowInsert(const std::string& name, const rapidjson::Document& document);
 		void			rowUpdate(const std::string& name, const rapidjson::Document& document);
 		void			rowDelete(const std::string& name, const rapidjson::Document& document);
+		std::string		statusToJSON();
 	private:
-		void			loadLookupTables();
 		void			insertPipeline(const rapidjson::Document& document);
 		void			insertPipelineFilter(const rapidjson::Document& document);
 		void			updatePipeline(const rapidjson::Document& document);
 		void			updatePipelineFilter(const rapidjson::Document& document);
 		void			deletePipeline(const rapidjson::Document& document);
 		void			deletePipelineFilter(const rapidjson::Document& document);
-		void			loadFilters(const std::string& pipeline, int cpid, std::vector<std::string>& filters);
+		bool			loadFilters(const std::string& pipeline, int cpid, std::vector<std::string>& filters);
 		PipelineEndpoint::EndpointType
 					findType(const std::string& typeName, bool source);
 		std::string		getFromJSONWhere(const rapidjson::Document& document, const std::string& key);
@@ -199,6 +242,31 @@ class ControlPipelineManager {
 				PipelineEndpoint::EndpointType
 						m_type;
 		};
+		/**
+		 * The pipelines retired whilst holding the pipelines mutex.
+		 * The references to the pipelines are released as the object
+		 * goes out of scope, it must be declared before the lock on
+		 * the mutex so that the release happens after the unlock.
+		 */
+		class RetiredPipelines : public std::vector<ControlPipeline *> {
+			public:
+				~RetiredPipelines();
+		};
+	private:
+		void			loadLookupTables(std::map<int, EndpointLookup>& sourceTypes,
+						std::map<int, EndpointLookup>& destTypes);
+		bool			queryPipelines(std::vector<PipelineDefinition>& pipelines,
+						std::map<int, EndpointLookup>& sourceTypes,
+						std::map<int, EndpointLookup>& destTypes);
+		ControlPipeline		*createPipeline(const PipelineDefinition& definition);
+		void			getDefinitions(std::vector<PipelineDefinition>& pipelines);
+		void			saveSnapshot();
+		void			changed();
+		void			storePipeline(const std::string& name,
+						ControlPipeline *pipeline,
+						RetiredPipelines& retired);
+		void			retirePipeline(const std::string& name,
+						RetiredPipelines& retired);
 	private:
 		Logger			*m_logger;
 		std::map<std::string, ControlPipeline *>
@@ -214,7 +282,18 @@ class ControlPipelineManager {
 		DispatcherService	*m_dispatcher;
 		std::map<int, std::string>
 					m_pipelineIds;
-		std::mutex		m_pipelinesMtx;
+		ProfiledMutex		m_pipelinesMtx;
+		unsigned int		m_filterTimeout;
+		PipelineSnapshot	*m_snapshot;
+		unsigned long		m_snapshotVersion;	// Guarded by the pipelines mutex
+		std::mutex		m_snapshotMutex;	// Serialises writes of the snapshot
+		unsigned long		m_snapshotWritten;	// Version of the last snapshot written
+		std::atomic<unsigned long>
+					m_generation;	// Incremented by each change notification
+		std::thread		*m_reconcileThread;
+		bool			m_shutdown;
+		std::mutex		m_reconcileMutex;
+		std::condition_variable	m_reconcileCV;
 };
 
 #endif
@@ -0,0 +1,66 @@
+#ifndef _PIPELINE_PREDICATE_H
+#define _PIPELINE_PREDICATE_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <cstdint>
+#include <kvlist.h>
+
+/*
+ * Predicates are declared in the control_filters table using a filter
+ * name with this prefix followed by a JSON object that lists the keys
+ * and operations the pipeline applies to, e.g.
+ *
+ *	when:{"keys" : ["speed", "direction"], "operations" : ["stop"]}
+ */
+#define PREDICATE_PREFIX	"when:"
+
+/**
+ * A compiled set of conditions that a control request must satisfy in order
+ * for a control pipeline to be applied to the request. Requests that do not
+ * satisfy the predicate bypass the pipeline entirely.
+ *
+ * The keys and operation names are hashed into a 64 bit mask so that most
+ * non-matching requests are rejected without a set lookup.
+ */
+class PipelinePredicate {
+	public:
+		PipelinePredicate();
+		static bool		isPredicate(const std::string& filterName);
+		void			compile(const std::vector<std::string>& pipeline);
+		bool			matches(const KVList& values, const std::string *operation) const;
+
+		/**
+		 * Return true if there are no conditions in the predicate
+		 *
+		 * @return bool	True if the predicate matches all requests
+		 */
+		bool			isEmpty() const
+					{
+						return !m_hasKeys && !m_hasOperations;
+					};
+	private:
+		bool			add(const std::string& definition);
+		static uint64_t		bit(const std::string& name);
+	private:
+		bool			m_hasKeys;
+		uint64_t		m_keyMask;
+		std::unordered_set<std::string>
+					m_keys;
+		bool			m_hasOperations;
+		uint64_t		m_operationMask;
+		std::unordered_set<std::string>
+					m_operations;
+};
+
+#endif
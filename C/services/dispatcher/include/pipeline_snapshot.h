@@ -0,0 +1,109 @@
+#ifndef _PIPELINE_SNAPSHOT_H
+#define _PIPELINE_SNAPSHOT_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <pipeline_manager.h>
+
+#define PIPELINE_SNAPSHOT_MAGIC		0x53504446	// "FDPS"
+#define PIPELINE_SNAPSHOT_VERSION	1
+
+/**
+ * The definition of a control pipeline as held in the storage service
+ */
+class PipelineDefinition {
+	public:
+		PipelineDefinition() : m_id(0), m_enabled(false), m_exclusive(false) {};
+		bool			operator==(const PipelineDefinition& rhs) const
+					{
+						return m_id == rhs.m_id && m_name == rhs.m_name
+							&& m_source.getType() == rhs.m_source.getType()
+							&& m_source.getName() == rhs.m_source.getName()
+							&& m_dest.getType() == rhs.m_dest.getType()
+							&& m_dest.getName() == rhs.m_dest.getName()
+							&& m_enabled == rhs.m_enabled
+							&& m_exclusive == rhs.m_exclusive
+							&& m_filters == rhs.m_filters;
+					};
+		bool			operator!=(const PipelineDefinition& rhs) const
+					{
+						return !(*this == rhs);
+					};
+	public:
+		long			m_id;
+		std::string		m_name;
+		PipelineEndpoint	m_source;
+		PipelineEndpoint	m_dest;
+		bool			m_enabled;
+		bool			m_exclusive;
+		std::vector<std::string>
+					m_filters;
+};
+
+/**
+ * A compact binary snapshot of the control pipelines and their filters,
+ * written to the Fledge data directory whenever the pipelines change and
+ * read at startup so that control requests can be served before the
+ * pipelines have been read from the storage service.
+ *
+ * The snapshot has a fixed header followed by one record per pipeline,
+ * the header carries a version stamp that is the hash of the records.
+ * The stamp both validates the snapshot and allows the pipelines in
+ * storage to be compared with the snapshot without comparing each
+ * pipeline. All integers are in the native byte order, a snapshot is
+ * only read by the host that wrote it.
+ *
+ *   header	magic, version, stamp, count, length
+ *   record	id, enabled, exclusive, source type, destination type,
+ *		name, source name, destination name, filter count, filters
+ *
+ * Strings are a 32 bit length followed by the characters.
+ */
+class PipelineSnapshot {
+	public:
+		PipelineSnapshot(const std::string& path) : m_path(path), m_stamp(0) {};
+		bool			save(const std::vector<PipelineDefinition>& pipelines);
+		bool			load(std::vector<PipelineDefinition>& pipelines);
+		static uint64_t		stamp(const std::vector<PipelineDefinition>& pipelines);
+		static std::string	defaultPath(const std::string& service);
+
+		/**
+		 * Return the version stamp of the last snapshot saved or loaded
+		 *
+		 * @return uint64_t	The stamp, 0 if there is no snapshot
+		 */
+		uint64_t		getStamp() const { return m_stamp; };
+
+		/**
+		 * Return the path of the snapshot file
+		 */
+		const std::string&	getPath() const { return m_path; };
+	private:
+		class Header {
+			public:
+				uint32_t	m_magic;
+				uint32_t	m_version;
+				uint64_t	m_stamp;
+				uint32_t	m_count;
+				uint32_t	m_length;	// Length of the records
+		};
+		static void		serialize(const std::vector<PipelineDefinition>& pipelines,
+						std::string& records);
+		static uint64_t		hash(const char *data, size_t length);
+	private:
+		const std::string	m_path;
+		std::atomic<uint64_t>	m_stamp;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef _PIPELINE_TRACE_H
+#define _PIPELINE_TRACE_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <vector>
+#include <chrono>
+
+/**
+ * A trace of the execution of a control request through a control
+ * pipeline. The trace records the pipeline that was selected and the
+ * time spent in each stage of the pipeline.
+ *
+ * Filter plugins within a segment of the pipeline call each other, the
+ * time recorded for a filter plugin is the time until it passes its
+ * output to the next filter. A set of adjacent native stages is executed
+ * as a single pass and is recorded as a single entry.
+ */
+class PipelineTrace {
+	public:
+		PipelineTrace();
+		void			setPipeline(const std::string& pipeline) { m_pipeline = pipeline; };
+		const std::string&	getPipeline() const { return m_pipeline; };
+		void			setRemoved(bool removed) { m_removed = removed; };
+		bool			isRemoved() const { return m_removed; };
+		void			setSkipped(bool skipped) { m_skipped = skipped; };
+		bool			isSkipped() const { return m_skipped; };
+		void			start(const std::string& stage);
+		void			end();
+		std::string		toJSON() const;
+
+		/**
+		 * Return the number of stages recorded in the trace
+		 */
+		size_t			getStageCount() const { return m_stages.size(); };
+
+		/**
+		 * Return the name of a recorded stage
+		 *
+		 * @param stage		The index of the stage
+		 * @return string	The name of the stage
+		 */
+		const std::string&	getStageName(size_t stage) const { return m_stages[stage].m_stage; };
+
+		/**
+		 * Return the time spent in a recorded stage
+		 *
+		 * @param stage		The index of the stage
+		 * @return long		The duration of the stage in nanoseconds
+		 */
+		long			getStageDuration(size_t stage) const { return m_stages[stage].m_duration; };
+	private:
+		typedef std::chrono::steady_clock	Clock;
+		class StageTiming {
+			public:
+				StageTiming(const std::string& stage, long duration) :
+					m_stage(stage), m_duration(duration) {};
+				std::string	m_stage;
+				long		m_duration;	// Nanoseconds
+		};
+		std::string		m_pipeline;
+		bool			m_removed;
+		bool			m_skipped;
+		std::vector<StageTiming>
+					m_stages;
+		std::string		m_current;
+		bool			m_inStage;
+		Clock::time_point	m_stageStart;
+};
+
+#endif
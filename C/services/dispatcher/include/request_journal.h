@@ -0,0 +1,129 @@
+#ifndef _REQUEST_JOURNAL_H
+#define _REQUEST_JOURNAL_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+class ControlRequest;
+
+#define JOURNAL_MAGIC		0x4e524a44	// "DJRN"
+#define JOURNAL_RECORD_MAGIC	0x52434552	// "RECR"
+#define JOURNAL_WRAP_MAGIC	0x50415257	// "WRAP"
+#define JOURNAL_VERSION		1
+#define JOURNAL_SIZE		(16 * 1024 * 1024)
+#define JOURNAL_DATA_START	4096
+
+/**
+ * The durability of the requests written to the journal
+ */
+enum JournalDurability {
+	JournalOff,		// Requests are not journaled
+	JournalBuffered,	// Written to the page cache, survives a crash of the service
+	JournalGroup,		// Synced to disk before the request is accepted, syncs are shared
+	JournalSync		// Synced to disk individually before the request is accepted
+};
+
+/**
+ * A write-ahead journal of the control requests accepted by the
+ * dispatcher, so that requests that are queued or executing when the
+ * service stops are executed when it next starts.
+ *
+ * The journal is a fixed size memory mapped file used as a ring of
+ * records. A record is appended when a request is queued and marked as
+ * done when the request completes. The head of the journal, the oldest
+ * record that is not done, advances as requests complete, which
+ * truncates the journal without a write to disk. Each record carries a
+ * sequence number and a checksum, a replay follows the records from the
+ * head for as long as the sequence numbers are consecutive and the
+ * checksums match.
+ *
+ * With group durability the first request to wait for a sync performs it
+ * on behalf of all the requests appended up to that point, the others
+ * wait for that sync to complete rather than each issuing their own.
+ *
+ * Replay gives at-least-once execution, a request that completed after
+ * its done mark was last written to disk is executed again.
+ */
+class RequestJournal {
+	public:
+		RequestJournal(const std::string& path, JournalDurability durability);
+		~RequestJournal();
+		bool			open();
+		void			replay(std::vector<ControlRequest *>& requests);
+		void			reset();
+		bool			append(ControlRequest *request);
+		void			complete(uint64_t sequence);
+		void			setDurability(JournalDurability durability)
+					{
+						m_durability = durability;
+					};
+		static JournalDurability
+					parseDurability(const std::string& name);
+		static std::string	defaultPath(const std::string& service);
+		static bool		encode(ControlRequest *request, std::string& record);
+		static ControlRequest	*decode(const char *record, size_t length);
+	private:
+		class Header {
+			public:
+				uint32_t	m_magic;
+				uint32_t	m_version;
+				uint64_t	m_size;
+				uint64_t	m_head;		// Offset of the oldest record that is not done
+				uint64_t	m_headSequence;	// Sequence number of the record at the head
+		};
+		class RecordHeader {
+			public:
+				uint32_t	m_magic;
+				uint32_t	m_length;	// Length of the encoded request
+				uint64_t	m_sequence;
+				uint32_t	m_checksum;
+				uint32_t	m_done;
+		};
+		class Entry {
+			public:
+				Entry(uint64_t offset, uint64_t length) :
+					m_offset(offset), m_length(length), m_done(false) {};
+				uint64_t	m_offset;
+				uint64_t	m_length;	// Space used including the record header
+				bool		m_done;
+		};
+		uint64_t		allocate(uint64_t length);
+		void			advanceHead();
+		void			sync();
+		void			groupCommit(uint64_t sequence);
+		static uint32_t		checksum(const char *data, size_t length);
+		static uint64_t		recordLength(uint32_t length);
+	private:
+		const std::string	m_path;
+		std::atomic<JournalDurability>
+					m_durability;
+		int			m_fd;
+		char			*m_map;
+		Header			*m_header;
+		std::mutex		m_mutex;
+		std::deque<Entry>	m_entries;	// The records from the head, in sequence order
+		uint64_t		m_firstSequence;// Sequence number of the first entry
+		uint64_t		m_tail;		// Offset at which the next record is written
+		uint64_t		m_nextSequence;
+		std::mutex		m_commitMutex;
+		std::condition_variable	m_commitCV;
+		uint64_t		m_committed;	// Highest sequence number synced to disk
+		bool			m_syncing;
+		bool			m_full;
+};
+
+#endif
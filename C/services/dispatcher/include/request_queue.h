@@ -0,0 +1,58 @@
+#ifndef _REQUEST_QUEUE_H
+#define _REQUEST_QUEUE_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <queue>
+#include <map>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <lock_profiler.h>
+
+class ControlRequest;
+
+/**
+ * The queue of control requests waiting to be executed by the
+ * worker threads of the dispatcher
+ */
+class RequestQueue {
+	public:
+		RequestQueue();
+		void			push(ControlRequest *request);
+		ControlRequest		*pop();
+		void			shutdown();
+		size_t			size();
+		std::map<std::string, size_t>
+					depthByDestination();
+
+		/**
+		 * Return true if the queue has been shutdown
+		 */
+		bool			isShutdown() { return m_shutdown; };
+	private:
+		/**
+		 * A queued request with the destination it is counted against
+		 */
+		class Entry {
+			public:
+				Entry(ControlRequest *request, const std::string& destination) :
+					m_request(request), m_destination(destination) {};
+				ControlRequest	*m_request;
+				std::string	m_destination;
+		};
+		std::queue<Entry>		m_requests;
+		std::map<std::string, size_t>	m_depth;	// Queued requests per destination
+		ProfiledMutex			m_mutex;
+		std::condition_variable_any	m_cv;
+		bool				m_shutdown;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef _STATISTICS_H
+#define _STATISTICS_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <condition_variable>
+#include <storage_client.h>
+#include <logger.h>
+
+#define STATISTICS_TABLE		"statistics"
+#define STATISTICS_KEY_LENGTH		56	// The width of the key column of the statistics table
+#define DEFAULT_STATISTICS_INTERVAL	"5"	// Seconds
+#define STATISTICS_DESTINATIONS		256	// Destinations that are counted individually
+#define STATISTICS_CALLERS		64	// Callers that are counted individually
+#define STATISTICS_OTHER		"OTHER"	// The name under which further destinations or callers are counted
+
+/**
+ * The events counted in the statistics of the dispatcher
+ */
+enum ControlStatistic {
+	StatisticReceived,	// Control request received
+	StatisticDelivered,	// Control request delivered to a service
+	StatisticFailed,	// Delivery of a control request failed
+	StatisticFiltered,	// Control request removed by a control pipeline
+	StatisticCount
+};
+
+/**
+ * The totals of a caller of the dispatcher
+ */
+class CallerTotals {
+	public:
+		std::string	m_caller;
+		long		m_counts[StatisticCount];
+		uint64_t	m_workerTime;	// Microseconds
+		uint64_t	m_filterTime;	// Microseconds
+		uint64_t	m_deliveryTime;	// Microseconds
+};
+
+/**
+ * The control statistics of the dispatcher, reported to the Fledge
+ * statistics table.
+ *
+ * Each event is counted in a total for the dispatcher, a count for the
+ * destination of the request and a count for the caller that made the
+ * request. The counts are accumulated in memory and written to storage
+ * periodically by a background thread, all of the counts that have changed
+ * are written in a single batched update.
+ *
+ * The counts of the destinations and callers are held in fixed size tables
+ * that are updated without a lock. Caller names are chosen by the clients
+ * of the dispatcher, hence once a table is full any further destinations
+ * or callers are counted under a single STATISTICS_OTHER entry rather than
+ * creating new rows in the statistics table.
+ *
+ * The entries of the callers also hold the resources consumed by the
+ * requests of each caller, these are not written to the statistics table
+ * but are reported by the caller accounting.
+ */
+class ControlStatistics {
+	public:
+		ControlStatistics(StorageClient *storage);
+		~ControlStatistics();
+		void			start();
+		void			stop();
+		void			record(ControlStatistic statistic,
+						const std::string& destination,
+						const std::string& caller);
+		void			record(ControlStatistic statistic,
+						const std::string& destination);
+		void			account(const std::string& caller, uint64_t workerTime,
+						uint64_t filterTime, uint64_t deliveryTime);
+		std::vector<CallerTotals>
+					getCallers();
+		void			run();
+
+		/**
+		 * Set the interval between writes of the statistics to storage
+		 *
+		 * @param interval	The interval in seconds
+		 */
+		void			setInterval(unsigned int interval) { m_interval = interval > 0 ? interval : 1; };
+
+		/**
+		 * Set the caller of the control request being executed by
+		 * the current thread
+		 *
+		 * @param caller	The name of the caller
+		 */
+		static void		setCaller(const std::string& caller) { m_caller = caller; };
+	private:
+		/**
+		 * The scope of a count
+		 */
+		enum Scope { ScopeTotal, ScopeDestination, ScopeCaller };
+		/**
+		 * The counts of each statistic for the dispatcher, a destination
+		 * or a caller. The counts are cumulative, the writer thread keeps
+		 * the counts it has written so that only the change is written.
+		 */
+		class Counts {
+			public:
+				Counts(const std::string& name);
+				const std::string	m_name;
+				std::atomic<long>	m_counts[StatisticCount];
+				long			m_written[StatisticCount];	// Only used by the writer thread
+				std::atomic<uint64_t>	m_workerTime;	// Microseconds, callers only
+				std::atomic<uint64_t>	m_filterTime;
+				std::atomic<uint64_t>	m_deliveryTime;
+		};
+		void			total(const Counts *counts, std::vector<CallerTotals>& totals);
+		Counts			*find(std::atomic<Counts *> *table, int size,
+						const std::string& name, Counts *other);
+		void			flush();
+		std::string		getKey(ControlStatistic statistic, Scope scope,
+						const std::string& name);
+		std::string		getDescription(ControlStatistic statistic, Scope scope,
+						const std::string& name);
+		bool			createRow(const std::string& key, const std::string& description);
+	private:
+		StorageClient		*m_storage;
+		Logger			*m_logger;
+		Counts			m_total;
+		std::atomic<Counts *>	m_destinations[STATISTICS_DESTINATIONS];
+		Counts			m_otherDestination;
+		std::atomic<Counts *>	m_callers[STATISTICS_CALLERS];
+		Counts			m_otherCaller;
+		std::set<std::string>	m_created;	// Only used by the writer thread
+		std::mutex		m_mutex;
+		std::condition_variable	m_cv;
+		std::thread		*m_thread;
+		bool			m_running;
+		unsigned int		m_interval;
+		static thread_local std::string
+					m_caller;
+};
+
+#endif
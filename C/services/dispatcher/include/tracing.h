@@ -0,0 +1,56 @@
+#ifndef _TRACING_H
+#define _TRACING_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <latency.h>
+
+/*
+ * The HTTP header used to pass the trace ID of a control request to the
+ * dispatcher and on to the south service that executes the request
+ */
+#define TRACE_ID_HEADER		"Service-Trace-Id"
+#define MAX_TRACE_ID_LENGTH	64
+
+/**
+ * Generation of the trace IDs used to correlate the handling of a control
+ * request across the API call, the dispatcher and the south service, and
+ * the optional export of the timing spans of each request to a local file.
+ *
+ * Spans are written one JSON object per line, each line records the trace
+ * ID, the type, destination and caller of the request, the wall clock time
+ * the request was received and the duration of each stage in microseconds.
+ */
+class Tracing {
+	public:
+		static Tracing		*getInstance();
+		static std::string	newTraceId();
+		static bool		validTraceId(const std::string& traceId);
+		bool			setSpanFile(const std::string& path);
+		void			exportSpan(const std::string& traceId,
+						const char *type,
+						const std::string& destination,
+						const std::string& caller,
+						const RequestTimings& timings);
+	private:
+		Tracing();
+		~Tracing();
+	private:
+		std::mutex		m_mutex;
+		FILE			*m_spans;
+		std::string		m_path;
+		std::atomic<bool>	m_enabled;
+};
+
+#endif
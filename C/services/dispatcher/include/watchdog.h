@@ -0,0 +1,172 @@
+#ifndef _WATCHDOG_H
+#define _WATCHDOG_H
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <logger.h>
+
+class ControlPipeline;
+class PipelineExecutionContext;
+class DispatcherService;
+
+/**
+ * The execution state of a dispatcher worker thread. The worker records
+ * each stage of the execution of a control request as it enters and
+ * leaves the stage, stages may be nested, e.g. a script will run
+ * pipelines and deliveries for each of its steps.
+ *
+ * The state of the current worker is available via a thread local
+ * pointer so that the stages can be recorded without passing the state
+ * through the control request classes.
+ */
+class WorkerState {
+	public:
+		/**
+		 * The stages of the execution of a control request
+		 */
+		enum Stage {
+			StageExecuting,
+			StageFiltering,
+			StageDelivering
+		};
+
+		WorkerState(int id);
+		static WorkerState	*current() { return m_current; };
+		static void		setCurrent(WorkerState *state) { m_current = state; };
+		void			begin(const std::string& detail);
+		void			filtering(ControlPipeline *pipeline,
+						PipelineExecutionContext *context);
+		void			delivering(const std::string& service);
+		void			end();
+		bool			overBudget(unsigned int budget, std::string& report);
+		bool			quarantine();
+		std::string		toJSON();
+
+		/**
+		 * Return the identifier of the worker
+		 */
+		int			getId() const { return m_id; };
+
+		/**
+		 * Mark the worker as abandoned, the worker will exit once
+		 * the current request completes.
+		 */
+		void			abandon() { m_abandoned = true; };
+
+		/**
+		 * Return true if the worker has been abandoned by the watchdog
+		 */
+		bool			isAbandoned() const { return m_abandoned; };
+	private:
+		class Frame {
+			public:
+				Frame(Stage stage, const std::string& detail) :
+					m_stage(stage), m_detail(detail),
+					m_start(std::chrono::steady_clock::now()),
+					m_pipeline(NULL), m_context(NULL),
+					m_quarantined(false) {};
+				Stage			m_stage;
+				std::string		m_detail;
+				std::chrono::steady_clock::time_point
+							m_start;
+				ControlPipeline		*m_pipeline;
+				PipelineExecutionContext
+							*m_context;
+				bool			m_quarantined;
+		};
+		void			push(const Frame& frame);
+	private:
+		const int		m_id;
+		std::mutex		m_mutex;
+		std::vector<Frame>	m_frames;
+		std::atomic<bool>	m_abandoned;
+		bool			m_reported;
+		static thread_local WorkerState
+					*m_current;
+};
+
+/**
+ * A scope guard that ends the current stage of a worker when the
+ * stage goes out of scope
+ */
+class WorkerStageScope {
+	public:
+		WorkerStageScope(WorkerState *state) : m_state(state) {};
+		~WorkerStageScope()
+		{
+			if (m_state)
+				m_state->end();
+		};
+	private:
+		WorkerState		*m_state;
+};
+
+/**
+ * The execution watchdog periodically inspects the state of each of the
+ * worker threads. A worker that has been executing a control request for
+ * longer than the execution budget is reported. Optionally the pipeline
+ * context that the worker is stuck in is quarantined and the worker is
+ * replaced so that the worker pool retains its capacity.
+ */
+class ExecutionWatchdog {
+	public:
+		ExecutionWatchdog(DispatcherService *service);
+		~ExecutionWatchdog();
+		void			start();
+		void			stop();
+		void			addWorker(WorkerState *state);
+		void			removeWorker(WorkerState *state);
+		void			run();
+		std::string		workersToJSON();
+
+		/**
+		 * Set the execution budget of a control request
+		 *
+		 * @param budget	The budget in milliseconds, 0 disables the watchdog
+		 */
+		void			setBudget(unsigned int budget) { m_budget = budget; };
+
+		/**
+		 * Return the execution budget of a control request
+		 *
+		 * @return unsigned int	The budget in milliseconds
+		 */
+		unsigned int		getBudget() const { return m_budget; };
+
+		/**
+		 * Set if stuck workers should be quarantined
+		 *
+		 * @param quarantine	Quarantine stuck workers
+		 */
+		void			setQuarantine(bool quarantine) { m_quarantine = quarantine; };
+	private:
+		void			check();
+	private:
+		DispatcherService	*m_service;
+		Logger			*m_logger;
+		std::vector<WorkerState *>
+					m_workers;
+		std::mutex		m_mutex;
+		std::condition_variable	m_cv;
+		std::thread		*m_thread;
+		bool			m_running;
+		std::atomic<unsigned int>
+					m_budget;
+		std::atomic<bool>	m_quarantine;
+};
+
+#endif
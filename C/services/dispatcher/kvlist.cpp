@@ -11,6 +11,7 @@
 #include <logger.h>
 #include <stdexcept>
 #include <string_utils.h>
+#include <debug_log.h>
 
 using namespace std;
 using namespace rapidjson;
@@ -28,7 +29,7 @@ KVList::KVList(Value& value)
 			string key = kv.name.GetString();
 			if (kv.value.IsString())
 			{
-				Logger::getLogger()->debug("Parameter: %s is %s", key.c_str(), kv.value.GetString());
+				DEBUG_LOG(Logger::getLogger(), "Parameter: %s is %s", key.c_str(), kv.value.GetString());
 				m_list.push_back(pair<string, string>(key, kv.value.GetString()));
 			}
 			else
@@ -159,11 +160,58 @@ void KVList::substitute(string& value, const KVList& values)
 	}
 	rval.append(value.substr(p1));
 
-	Logger::getLogger()->debug("'%s'", value.c_str());
-	Logger::getLogger()->debug("became '%s'", rval.c_str());
+	DEBUG_LOG(Logger::getLogger(), "'%s'", value.c_str());
+	DEBUG_LOG(Logger::getLogger(), "became '%s'", rval.c_str());
 	value = rval;
 }
 
+/**
+ * Apply a transformation to each of the key/value pairs in the list in a
+ * single pass. The transformation may alter the key, the value or both.
+ * If the transformation returns false the pair is removed from the list.
+ *
+ * @param fn	The transformation to apply to each key/value pair
+ */
+void KVList::transform(const function<bool (string&, string&)>& fn)
+{
+	auto it = m_list.begin();
+	while (it != m_list.end())
+	{
+		if (fn(it->first, it->second))
+			++it;
+		else
+			it = m_list.erase(it);
+	}
+}
+
+/**
+ * Determine if any of the keys in the list satisfies a test
+ *
+ * @param fn	The test to apply to each key
+ * @return bool	True if the test is satisfied by at least one key
+ */
+bool KVList::anyKey(const function<bool (const string&)>& fn) const
+{
+	for (auto& kv : m_list)
+	{
+		if (fn(kv.first))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Call a function for each of the key/value pairs in the list, in the
+ * order they were added
+ *
+ * @param fn	The function to call with each key and value
+ */
+void KVList::forEach(const function<void (const string&, const string&)>& fn) const
+{
+	for (auto& kv : m_list)
+		fn(kv.first, kv.second);
+}
+
 /**
  * Construct a reading from a key/value list
  *
@@ -0,0 +1,309 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <latency.h>
+#include <metrics.h>
+
+using namespace std;
+
+thread_local RequestTimings *RequestTimings::m_current = NULL;
+
+/**
+ * The names of the stages as reported in the metrics
+ */
+static const char *stageNames[LatencyStageCount] = {
+	"parse", "queue", "filter", "deliver", "total"
+};
+
+/**
+ * Record the start of a delivery of the request. A request may be
+ * delivered to more than one service, the delivery stage runs from the
+ * start of the first delivery to the end of the last.
+ */
+void RequestTimings::deliveryStarted()
+{
+	if (m_deliveryStart == 0)
+		m_deliveryStart = now();
+}
+
+/**
+ * Record the end of a delivery of the request
+ *
+ * @param delivered	True if the request was delivered
+ */
+void RequestTimings::deliveryEnded(bool delivered)
+{
+	m_deliveryEnd = now();
+	if (delivered)
+		m_deliveries++;
+	else
+		m_failures++;
+}
+
+/**
+ * Return the duration of a stage of the request
+ *
+ * @param stage		The stage, one of the LatencyStage values
+ * @param completed	The time the request completed
+ * @return int64_t	The duration in microseconds or -1 if the stage was not executed
+ */
+int64_t RequestTimings::duration(int stage, int64_t completed) const
+{
+	switch (stage)
+	{
+		case LatencyParse:
+			if (m_received && m_queued)
+				return (m_queued - m_received) / 1000;
+			break;
+		case LatencyQueue:
+			if (m_queued && m_dequeued)
+				return (m_dequeued - m_queued) / 1000;
+			break;
+		case LatencyFilter:
+			if (m_filterStart && m_filterEnd)
+				return (m_filterEnd - m_filterStart) / 1000;
+			break;
+		case LatencyDeliver:
+			if (m_deliveryStart && m_deliveryEnd)
+				return (m_deliveryEnd - m_deliveryStart) / 1000;
+			break;
+		case LatencyTotal:
+			if (m_received)
+				return (completed - m_received) / 1000;
+			break;
+	}
+	return -1;
+}
+
+/**
+ * Constructor for an empty histogram
+ */
+LatencyHistogram::LatencyHistogram() : m_count(0), m_sum(0)
+{
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+		m_buckets[i] = 0;
+}
+
+/**
+ * Return the bucket for a value
+ *
+ * @param value	The value in microseconds
+ * @return int	The bucket index
+ */
+int LatencyHistogram::bucket(uint64_t value)
+{
+	if (value < 32)
+		return (int)value;
+	int msb = 63 - __builtin_clzll(value);
+	if (msb > LATENCY_MAX_MSB)
+		return LATENCY_BUCKETS - 1;
+	int sub = (int)(value >> (msb - 4)) - LATENCY_SUB_BUCKETS;
+	return 32 + (msb - 5) * LATENCY_SUB_BUCKETS + sub;
+}
+
+/**
+ * Return the value that represents a bucket, the midpoint of the bucket
+ *
+ * @param bucket	The bucket index
+ * @return uint64_t	The value in microseconds
+ */
+uint64_t LatencyHistogram::bucketValue(int bucket)
+{
+	if (bucket < 32)
+		return bucket;
+	int msb = 5 + (bucket - 32) / LATENCY_SUB_BUCKETS;
+	int sub = (bucket - 32) % LATENCY_SUB_BUCKETS;
+	uint64_t lower = (uint64_t)(LATENCY_SUB_BUCKETS + sub) << (msb - 4);
+	return lower + ((1ULL << (msb - 4)) / 2);
+}
+
+/**
+ * Record a value in the histogram
+ *
+ * @param value	The value in microseconds
+ */
+void LatencyHistogram::record(uint64_t value)
+{
+	m_buckets[bucket(value)].fetch_add(1, memory_order_relaxed);
+	m_count.fetch_add(1, memory_order_relaxed);
+	m_sum.fetch_add(value, memory_order_relaxed);
+}
+
+/**
+ * Return a quantile of the recorded values
+ *
+ * @param q		The quantile in the range 0.0 to 1.0
+ * @return uint64_t	The value at the quantile in microseconds
+ */
+uint64_t LatencyHistogram::quantile(double q) const
+{
+	uint64_t counts[LATENCY_BUCKETS];
+	uint64_t total = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		counts[i] = m_buckets[i].load(memory_order_relaxed);
+		total += counts[i];
+	}
+	if (total == 0)
+		return 0;
+	uint64_t rank = (uint64_t)(q * total);
+	if (rank >= total)
+		rank = total - 1;
+	uint64_t seen = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		seen += counts[i];
+		if (seen > rank)
+			return bucketValue(i);
+	}
+	return bucketValue(LATENCY_BUCKETS - 1);
+}
+
+/**
+ * Return the singleton latency registry
+ *
+ * @return LatencyRegistry*	The latency registry
+ */
+LatencyRegistry *LatencyRegistry::getInstance()
+{
+	static LatencyRegistry instance;
+	return &instance;
+}
+
+/**
+ * Constructor for the latency registry
+ */
+LatencyRegistry::LatencyRegistry()
+{
+	for (int i = 0; i < LATENCY_TABLE_SIZE; i++)
+	{
+		m_entries[i] = NULL;
+	}
+}
+
+/**
+ * Return the hash of a request type and destination, used to choose the
+ * first entry of the table to probe
+ *
+ * @param type		The request type
+ * @param destination	The request destination
+ * @return uint64_t	The hash
+ */
+uint64_t LatencyRegistry::hash(const string& type, const string& destination)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : type)
+	{
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	hash ^= '|';
+	hash *= 1099511628211ULL;
+	for (unsigned char c : destination)
+	{
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/**
+ * Find the entry for a request type and destination, claiming a new entry
+ * in the table if required. Entries are identified by the type and
+ * destination, the hash only selects where the probe starts.
+ *
+ * @param type		The request type
+ * @param destination	The request destination
+ * @return Entry*	The entry or NULL if the table is full
+ */
+LatencyRegistry::Entry *LatencyRegistry::find(const string& type, const string& destination)
+{
+	uint64_t key = hash(type, destination);
+	for (int probe = 0; probe < LATENCY_TABLE_SIZE; probe++)
+	{
+		atomic<Entry *>& slot = m_entries[(key + probe) % LATENCY_TABLE_SIZE];
+		Entry *entry = slot.load(memory_order_acquire);
+		if (!entry)
+		{
+			Entry *created = new Entry(type, destination);
+			if (slot.compare_exchange_strong(entry, created, memory_order_acq_rel))
+				return created;
+			// Another thread claimed the entry first
+			delete created;
+		}
+		if (entry->m_type == type && entry->m_destination == destination)
+			return entry;
+	}
+	return NULL;
+}
+
+/**
+ * Record the latencies of the stages of a completed control request
+ *
+ * @param type		The request type
+ * @param destination	The request destination
+ * @param timings	The timestamps of the request
+ */
+void LatencyRegistry::record(const string& type, const string& destination,
+				const RequestTimings& timings)
+{
+	Entry *entry = find(type, destination);
+	if (!entry)
+		return;
+
+	int64_t completed = RequestTimings::now();
+	for (int stage = 0; stage < LatencyStageCount; stage++)
+	{
+		int64_t duration = timings.duration(stage, completed);
+		if (duration >= 0)
+			entry->m_stages[stage].record(duration);
+	}
+}
+
+/**
+ * Return the p50, p99 and p999 latencies of each stage in the Prometheus
+ * text exposition format
+ *
+ * @return string	The latency metrics
+ */
+string LatencyRegistry::toPrometheus()
+{
+	static const double quantiles[] = { 0.5, 0.99, 0.999 };
+	static const char *quantileNames[] = { "0.5", "0.99", "0.999" };
+
+	string result = "# HELP dispatcher_stage_latency_microseconds Latency of the stages of control requests\n";
+	result += "# TYPE dispatcher_stage_latency_microseconds summary\n";
+	for (int slot = 0; slot < LATENCY_TABLE_SIZE; slot++)
+	{
+		Entry *entry = m_entries[slot].load(memory_order_acquire);
+		if (!entry)
+			continue;
+		for (int stage = 0; stage < LatencyStageCount; stage++)
+		{
+			const LatencyHistogram& histogram = entry->m_stages[stage];
+			if (histogram.getCount() == 0)
+				continue;
+			string labels = string("stage=\"") + stageNames[stage] + "\",type=\""
+				+ entry->m_type + "\",destination=\""
+				+ DispatcherMetrics::escapeLabel(entry->m_destination) + "\"";
+			for (int q = 0; q < 3; q++)
+			{
+				result += "dispatcher_stage_latency_microseconds{" + labels
+					+ ",quantile=\"" + quantileNames[q] + "\"} "
+					+ to_string(histogram.quantile(quantiles[q])) + "\n";
+			}
+			result += "dispatcher_stage_latency_microseconds_sum{" + labels + "} "
+				+ to_string(histogram.getSum()) + "\n";
+			result += "dispatcher_stage_latency_microseconds_count{" + labels + "} "
+				+ to_string(histogram.getCount()) + "\n";
+		}
+	}
+	return result;
+}
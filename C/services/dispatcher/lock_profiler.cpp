@@ -0,0 +1,223 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <lock_profiler.h>
+#include <cstdio>
+
+using namespace std;
+
+atomic<bool> LockProfiler::m_enabled(false);
+
+/**
+ * The names of the profiled locks as reported to Prometheus
+ */
+static const char *lockNames[LockIdCount] = {
+	"request_queue",
+	"pipelines",
+	"pipeline_contexts",
+	"execution_context"
+};
+
+/**
+ * Return the singleton lock profiler
+ *
+ * @return LockProfiler*	The lock profiler
+ */
+LockProfiler *LockProfiler::getInstance()
+{
+	static LockProfiler instance;
+	return &instance;
+}
+
+/**
+ * Constructor for the lock profiler
+ */
+LockProfiler::LockProfiler()
+{
+}
+
+/**
+ * Constructor for the accounting of a lock
+ */
+LockProfiler::LockStats::LockStats()
+{
+	reset();
+}
+
+/**
+ * Reset the accounting of a lock
+ */
+void LockProfiler::LockStats::reset()
+{
+	m_acquired = 0;
+	m_contended = 0;
+	m_waitTotal = 0;
+	m_waitMax = 0;
+	m_holdTotal = 0;
+	m_holdMax = 0;
+}
+
+/**
+ * Enable or disable lock profiling. The accounting is reset each time
+ * profiling is enabled.
+ *
+ * @param enable	Enable lock profiling
+ */
+void LockProfiler::enable(bool enable)
+{
+	if (enable && !m_enabled)
+	{
+		for (int i = 0; i < LockIdCount; i++)
+			m_stats[i].reset();
+	}
+	m_enabled = enable;
+}
+
+/**
+ * Update a maximum value if the new value is greater
+ *
+ * @param max	The maximum to update
+ * @param value	The new value
+ */
+void LockProfiler::updateMax(atomic<uint64_t>& max, uint64_t value)
+{
+	uint64_t current = max.load(memory_order_relaxed);
+	while (value > current && !max.compare_exchange_weak(current, value, memory_order_relaxed))
+		;
+}
+
+/**
+ * Record the acquisition of a lock that had to wait for the lock
+ *
+ * @param lock	The lock
+ * @param wait	The time waited in nanoseconds
+ */
+void LockProfiler::recordWait(LockId lock, int64_t wait)
+{
+	LockStats& stats = m_stats[lock];
+	stats.m_acquired.fetch_add(1, memory_order_relaxed);
+	stats.m_contended.fetch_add(1, memory_order_relaxed);
+	stats.m_waitTotal.fetch_add(wait, memory_order_relaxed);
+	updateMax(stats.m_waitMax, wait);
+}
+
+/**
+ * Record the acquisition of a lock that was immediately available
+ *
+ * @param lock	The lock
+ */
+void LockProfiler::recordUncontended(LockId lock)
+{
+	m_stats[lock].m_acquired.fetch_add(1, memory_order_relaxed);
+}
+
+/**
+ * Record the release of a lock
+ *
+ * @param lock	The lock
+ * @param hold	The time the lock was held in nanoseconds
+ */
+void LockProfiler::recordHold(LockId lock, int64_t hold)
+{
+	LockStats& stats = m_stats[lock];
+	stats.m_holdTotal.fetch_add(hold, memory_order_relaxed);
+	updateMax(stats.m_holdMax, hold);
+}
+
+/**
+ * Return the lock accounting in the Prometheus text exposition format.
+ * Nothing is returned if lock profiling is disabled.
+ *
+ * @return string	The lock metrics
+ */
+string LockProfiler::toPrometheus()
+{
+	if (!enabled())
+		return "";
+
+	static const struct {
+		const char	*name;
+		const char	*type;
+		const char	*help;
+	} metrics[] = {
+		{ "dispatcher_lock_acquired_total", "counter", "Acquisitions of the lock" },
+		{ "dispatcher_lock_contended_total", "counter", "Acquisitions of the lock that waited for another holder" },
+		{ "dispatcher_lock_wait_seconds_total", "counter", "Time spent waiting to acquire the lock" },
+		{ "dispatcher_lock_wait_max_seconds", "gauge", "Longest wait to acquire the lock" },
+		{ "dispatcher_lock_hold_seconds_total", "counter", "Time the lock has been held" },
+		{ "dispatcher_lock_hold_max_seconds", "gauge", "Longest time the lock has been held" }
+	};
+
+	string result;
+	for (size_t m = 0; m < sizeof(metrics) / sizeof(metrics[0]); m++)
+	{
+		result += string("# HELP ") + metrics[m].name + " " + metrics[m].help + "\n";
+		result += string("# TYPE ") + metrics[m].name + " " + metrics[m].type + "\n";
+		for (int i = 0; i < LockIdCount; i++)
+		{
+			const LockStats& stats = m_stats[i];
+			char value[40];
+			switch (m)
+			{
+				case 0:
+					snprintf(value, sizeof(value), "%lu", (unsigned long)stats.m_acquired.load());
+					break;
+				case 1:
+					snprintf(value, sizeof(value), "%lu", (unsigned long)stats.m_contended.load());
+					break;
+				case 2:
+					snprintf(value, sizeof(value), "%.9f", stats.m_waitTotal.load() / 1.0e9);
+					break;
+				case 3:
+					snprintf(value, sizeof(value), "%.9f", stats.m_waitMax.load() / 1.0e9);
+					break;
+				case 4:
+					snprintf(value, sizeof(value), "%.9f", stats.m_holdTotal.load() / 1.0e9);
+					break;
+				case 5:
+					snprintf(value, sizeof(value), "%.9f", stats.m_holdMax.load() / 1.0e9);
+					break;
+			}
+			result += string(metrics[m].name) + "{lock=\"" + lockNames[i] + "\"} " + value + "\n";
+		}
+	}
+	return result;
+}
+
+/**
+ * Acquire the mutex, accounting the time waited if the mutex is held
+ * by another thread
+ */
+void ProfiledMutex::profiledLock()
+{
+	LockProfiler *profiler = LockProfiler::getInstance();
+	if (m_mutex.try_lock())
+	{
+		profiler->recordUncontended(m_id);
+	}
+	else
+	{
+		int64_t start = LockProfiler::now();
+		m_mutex.lock();
+		profiler->recordWait(m_id, LockProfiler::now() - start);
+	}
+	m_acquired = LockProfiler::now();
+}
+
+/**
+ * Release the mutex, accounting the time it was held
+ */
+void ProfiledMutex::profiledUnlock()
+{
+	int64_t hold = LockProfiler::now() - m_acquired;
+	m_acquired = 0;
+	m_mutex.unlock();
+	LockProfiler::getInstance()->recordHold(m_id, hold);
+}
@@ -0,0 +1,335 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <metrics.h>
+#include <algorithm>
+
+using namespace std;
+
+thread_local DispatcherMetrics::Shard *DispatcherMetrics::m_shard = NULL;
+thread_local DispatcherMetrics::ShardOwner DispatcherMetrics::m_owner;
+
+/**
+ * The names and descriptions of the metrics as reported to Prometheus
+ */
+static const struct {
+	const char	*name;
+	const char	*help;
+} counterNames[MetricCounterCount] = {
+	{ "dispatcher_requests_queued_total", "Control requests added to the request queue" },
+	{ "dispatcher_requests_dequeued_total", "Control requests taken from the request queue by a worker" },
+	{ "dispatcher_requests_completed_total", "Control requests that have completed execution" },
+	{ "dispatcher_pipeline_misses_total", "Control requests for which no control pipeline was found" },
+	{ "dispatcher_delivery_success_total", "Control requests successfully delivered to a service" },
+	{ "dispatcher_delivery_failure_total", "Control requests that failed to be delivered to a service" },
+	{ "dispatcher_filter_unmatched_total", "Output of control filters discarded as it did not match an outstanding control request" },
+	{ "dispatcher_journal_appended_total", "Control requests written to the request journal" },
+	{ "dispatcher_journal_replayed_total", "Control requests replayed from the request journal at startup" },
+	{ "dispatcher_journal_full_total", "Control requests not journaled because the request journal was full" }
+};
+
+static const struct {
+	const char	*name;
+	const char	*label;
+	const char	*help;
+} labelledNames[MetricLabelledCount] = {
+	{ "dispatcher_pipeline_hits_total", "pipeline", "Control requests filtered by a control pipeline" },
+	{ "dispatcher_pipeline_skipped_total", "pipeline", "Control requests that did not satisfy the predicate of a control pipeline" },
+	{ "dispatcher_pipeline_removed_total", "pipeline", "Control requests removed by a control pipeline" },
+	{ "dispatcher_service_success_total", "service", "Control requests successfully delivered per service" },
+	{ "dispatcher_service_failure_total", "service", "Control requests that failed to be delivered per service" },
+	{ "dispatcher_slow_requests_total", "destination", "Control requests that exceeded the slow request threshold per destination" },
+	{ "dispatcher_slow_pipeline_requests_total", "pipeline", "Control requests that exceeded the slow request threshold per control pipeline" }
+};
+
+static const struct {
+	const char	*name;
+	const char	*help;
+} gaugeNames[MetricGaugeCount] = {
+	{ "dispatcher_queue_depth", "Control requests waiting in the request queue" },
+	{ "dispatcher_requests_in_flight", "Control requests currently being executed by the workers" }
+};
+
+/**
+ * Return the singleton metrics registry
+ *
+ * @return DispatcherMetrics*	The metrics registry
+ */
+DispatcherMetrics *DispatcherMetrics::getInstance()
+{
+	static DispatcherMetrics instance;
+	return &instance;
+}
+
+/**
+ * Constructor for the metrics registry
+ */
+DispatcherMetrics::DispatcherMetrics()
+{
+	for (int i = 0; i < MetricCounterCount; i++)
+		m_retired[i] = 0;
+	for (int i = 0; i < MetricGaugeCount; i++)
+		m_gauges[i] = 0;
+}
+
+/**
+ * Constructor for a per-thread shard of counters
+ */
+DispatcherMetrics::Shard::Shard()
+{
+	for (int i = 0; i < MetricCounterCount; i++)
+		m_counters[i] = 0;
+}
+
+/**
+ * Destructor for a per-thread shard of counters
+ */
+DispatcherMetrics::Shard::~Shard()
+{
+	for (int i = 0; i < MetricLabelledCount; i++)
+	{
+		for (auto& it : m_labelled[i])
+			delete it.second;
+	}
+}
+
+/**
+ * Destructor for the owner of the shard of a thread, called as the thread
+ * exits. The counts of the thread are retained in the retired totals.
+ */
+DispatcherMetrics::ShardOwner::~ShardOwner()
+{
+	if (m_shard)
+	{
+		DispatcherMetrics::getInstance()->retire(m_shard);
+		m_shard = NULL;
+		DispatcherMetrics::m_shard = NULL;
+	}
+}
+
+/**
+ * Return the shard for the calling thread, creating it if required. The
+ * shard is owned by a thread local owner that retires the shard when the
+ * thread exits.
+ *
+ * @return Shard*	The shard of the calling thread
+ */
+DispatcherMetrics::Shard *DispatcherMetrics::getShard()
+{
+	if (!m_shard)
+	{
+		m_shard = new Shard();
+		m_owner.m_shard = m_shard;
+		lock_guard<mutex> guard(m_shardsMutex);
+		m_shards.push_back(m_shard);
+	}
+	return m_shard;
+}
+
+/**
+ * Retire the shard of a thread that is exiting. The counts in the shard
+ * are added to the retired totals and the shard is freed.
+ *
+ * @param shard		The shard to retire
+ */
+void DispatcherMetrics::retire(Shard *shard)
+{
+	lock_guard<mutex> guard(m_shardsMutex);
+	for (int i = 0; i < MetricCounterCount; i++)
+		m_retired[i] += shard->m_counters[i].load(memory_order_relaxed);
+	for (int i = 0; i < MetricLabelledCount; i++)
+	{
+		for (auto& it : shard->m_labelled[i])
+			m_retiredLabelled[i][it.first] += it.second->load(memory_order_relaxed);
+	}
+	auto it = find(m_shards.begin(), m_shards.end(), shard);
+	if (it != m_shards.end())
+		m_shards.erase(it);
+	delete shard;
+}
+
+/**
+ * Increment a counter
+ *
+ * @param counter	The counter to increment
+ */
+void DispatcherMetrics::increment(MetricCounter counter)
+{
+	atomic<uint64_t>& value = getShard()->m_counters[counter];
+	// Only the owning thread writes to the shard, no read-modify-write is required
+	value.store(value.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/**
+ * Determine if a label value is counted individually for a labelled
+ * counter. The first METRICS_LABELS values seen across all threads are
+ * admitted, further values are not.
+ *
+ * @param counter	The labelled counter
+ * @param label		The label value
+ * @return bool		True if the label value is counted individually
+ */
+bool DispatcherMetrics::admitLabel(MetricLabelledCounter counter, const string& label)
+{
+	lock_guard<mutex> guard(m_labelsMutex);
+	set<string>& labels = m_labels[counter];
+	if (labels.find(label) != labels.end())
+		return true;
+	if (labels.size() >= METRICS_LABELS)
+		return false;
+	labels.insert(label);
+	return true;
+}
+
+/**
+ * Increment a labelled counter. A label value beyond the limit on the
+ * number of values is counted under the METRICS_OTHER_LABEL label.
+ *
+ * @param counter	The counter to increment
+ * @param label		The label value of the counter
+ */
+void DispatcherMetrics::increment(MetricLabelledCounter counter, const string& label)
+{
+	Shard *shard = getShard();
+	map<string, atomic<uint64_t> *>& counters = shard->m_labelled[counter];
+	auto it = counters.find(label);
+	if (it == counters.end())
+	{
+		string key = admitLabel(counter, label) ? label : string(METRICS_OTHER_LABEL);
+		it = counters.find(key);
+		if (it == counters.end())
+		{
+			// The map is only modified by the owning thread, readers hold the lock
+			lock_guard<mutex> guard(shard->m_labelMutex);
+			it = counters.insert(pair<string, atomic<uint64_t> *>(key, new atomic<uint64_t>(0))).first;
+		}
+	}
+	atomic<uint64_t>& value = *it->second;
+	value.store(value.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/**
+ * Adjust the value of a gauge
+ *
+ * @param gauge		The gauge to adjust
+ * @param delta		The amount to adjust the gauge by
+ */
+void DispatcherMetrics::adjust(MetricGauge gauge, long delta)
+{
+	m_gauges[gauge].fetch_add(delta, memory_order_relaxed);
+}
+
+/**
+ * Return the value of a counter aggregated across all threads
+ *
+ * @param counter	The counter to return
+ * @return uint64_t	The value of the counter
+ */
+uint64_t DispatcherMetrics::getCounter(MetricCounter counter)
+{
+	lock_guard<mutex> guard(m_shardsMutex);
+	uint64_t total = m_retired[counter];
+	for (auto& shard : m_shards)
+		total += shard->m_counters[counter].load(memory_order_relaxed);
+	return total;
+}
+
+/**
+ * Return the value of a gauge
+ *
+ * @param gauge		The gauge to return
+ * @return long		The value of the gauge
+ */
+long DispatcherMetrics::getGauge(MetricGauge gauge)
+{
+	return m_gauges[gauge].load(memory_order_relaxed);
+}
+
+/**
+ * Escape a label value for inclusion in the Prometheus text format
+ *
+ * @param label		The label value
+ * @return string	The escaped label value
+ */
+string DispatcherMetrics::escapeLabel(const string& label)
+{
+	string escaped;
+	for (char c : label)
+	{
+		if (c == '\\' || c == '"')
+		{
+			escaped += '\\';
+			escaped += c;
+		}
+		else if (c == '\n')
+		{
+			escaped += "\\n";
+		}
+		else
+		{
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+/**
+ * Return the metrics in the Prometheus text exposition format
+ *
+ * @return string	The metrics
+ */
+string DispatcherMetrics::toPrometheus()
+{
+	uint64_t counters[MetricCounterCount];
+	map<string, uint64_t> labelled[MetricLabelledCount];
+	{
+		lock_guard<mutex> guard(m_shardsMutex);
+		for (int i = 0; i < MetricCounterCount; i++)
+			counters[i] = m_retired[i];
+		for (int i = 0; i < MetricLabelledCount; i++)
+			labelled[i] = m_retiredLabelled[i];
+		for (auto& shard : m_shards)
+		{
+			for (int i = 0; i < MetricCounterCount; i++)
+				counters[i] += shard->m_counters[i].load(memory_order_relaxed);
+			lock_guard<mutex> labelGuard(shard->m_labelMutex);
+			for (int i = 0; i < MetricLabelledCount; i++)
+			{
+				for (auto& it : shard->m_labelled[i])
+					labelled[i][it.first] += it.second->load(memory_order_relaxed);
+			}
+		}
+	}
+
+	string result;
+	for (int i = 0; i < MetricCounterCount; i++)
+	{
+		result += string("# HELP ") + counterNames[i].name + " " + counterNames[i].help + "\n";
+		result += string("# TYPE ") + counterNames[i].name + " counter\n";
+		result += string(counterNames[i].name) + " " + to_string(counters[i]) + "\n";
+	}
+	for (int i = 0; i < MetricLabelledCount; i++)
+	{
+		result += string("# HELP ") + labelledNames[i].name + " " + labelledNames[i].help + "\n";
+		result += string("# TYPE ") + labelledNames[i].name + " counter\n";
+		for (auto& it : labelled[i])
+		{
+			result += string(labelledNames[i].name) + "{" + labelledNames[i].label
+				+ "=\"" + escapeLabel(it.first) + "\"} " + to_string(it.second) + "\n";
+		}
+	}
+	for (int i = 0; i < MetricGaugeCount; i++)
+	{
+		result += string("# HELP ") + gaugeNames[i].name + " " + gaugeNames[i].help + "\n";
+		result += string("# TYPE ") + gaugeNames[i].name + " gauge\n";
+		result += string(gaugeNames[i].name) + " " + to_string(getGauge((MetricGauge)i)) + "\n";
+	}
+	return result;
+}
@@ -0,0 +1,351 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <native_stage.h>
+#include <logger.h>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * The table of units supported by the unit conversion stage. Each unit
+ * is defined in terms of a dimension and the linear conversion to the
+ * base unit of that dimension, base = (value * scale) + offset.
+ */
+static struct {
+	const char	*unit;
+	const char	*dimension;
+	double		scale;
+	double		offset;
+} units[] = {
+	{ "C",		"temperature",	1.0,		0.0 },
+	{ "F",		"temperature",	5.0 / 9.0,	-160.0 / 9.0 },
+	{ "K",		"temperature",	1.0,		-273.15 },
+	{ "m",		"length",	1.0,		0.0 },
+	{ "cm",		"length",	0.01,		0.0 },
+	{ "mm",		"length",	0.001,		0.0 },
+	{ "km",		"length",	1000.0,		0.0 },
+	{ "in",		"length",	0.0254,		0.0 },
+	{ "ft",		"length",	0.3048,		0.0 },
+	{ "Pa",		"pressure",	1.0,		0.0 },
+	{ "kPa",	"pressure",	1000.0,		0.0 },
+	{ "bar",	"pressure",	100000.0,	0.0 },
+	{ "psi",	"pressure",	6894.757,	0.0 },
+	{ "m/s",	"speed",	1.0,		0.0 },
+	{ "km/h",	"speed",	1.0 / 3.6,	0.0 },
+	{ "mph",	"speed",	0.44704,	0.0 },
+	{ "W",		"power",	1.0,		0.0 },
+	{ "kW",		"power",	1000.0,		0.0 },
+	{ "hp",		"power",	745.6999,	0.0 },
+	{ "l/s",	"flow",		1.0,		0.0 },
+	{ "l/min",	"flow",		1.0 / 60.0,	0.0 },
+	{ "m3/h",	"flow",		1000.0 / 3600.0, 0.0 },
+	{ NULL,		NULL,		0.0,		0.0 }
+};
+
+/**
+ * Determine if the filter name in a pipeline refers to a native stage
+ *
+ * @param filterName	The name of the filter in the pipeline
+ * @return bool		True if the filter is a native stage
+ */
+bool NativeStage::isNative(const string& filterName)
+{
+	return filterName.compare(0, strlen(NATIVE_STAGE_PREFIX), NATIVE_STAGE_PREFIX) == 0;
+}
+
+/**
+ * Create a native stage from the filter name used to declare the stage
+ * in the pipeline. The name consists of the native prefix, the stage type
+ * and an optional JSON object with the stage parameters.
+ *
+ * @param filterName	The name of the filter in the pipeline
+ * @return NativeStage*	The new stage or NULL if the stage could not be created
+ */
+NativeStage *NativeStage::create(const string& filterName)
+{
+	Logger *logger = Logger::getLogger();
+
+	string definition = filterName.substr(strlen(NATIVE_STAGE_PREFIX));
+	size_t pos = definition.find_first_of(" \t{");
+	string type = definition.substr(0, pos);
+	Document doc;
+	if (pos != string::npos && definition.find('{', pos) != string::npos)
+	{
+		string parameters = definition.substr(definition.find('{', pos));
+		doc.Parse(parameters.c_str());
+		if (doc.HasParseError() || !doc.IsObject())
+		{
+			logger->error("The parameters of the native pipeline stage '%s' are not a valid JSON object",
+					filterName.c_str());
+			return NULL;
+		}
+	}
+	else
+	{
+		doc.Parse("{}");
+	}
+
+	try {
+		if (type.compare("scale") == 0)
+			return new ScaleStage(filterName, doc);
+		else if (type.compare("offset") == 0)
+			return new OffsetStage(filterName, doc);
+		else if (type.compare("clamp") == 0)
+			return new ClampStage(filterName, doc);
+		else if (type.compare("rename") == 0)
+			return new RenameStage(filterName, doc);
+		else if (type.compare("convert") == 0)
+			return new ConvertStage(filterName, doc);
+	} catch (exception& e) {
+		logger->error("Unable to create native pipeline stage '%s', %s",
+				filterName.c_str(), e.what());
+		return NULL;
+	}
+	logger->error("Unsupported native pipeline stage '%s'", type.c_str());
+	return NULL;
+}
+
+/**
+ * Constructor for the native stage base class
+ *
+ * @param name		The name of the stage within the pipeline
+ * @param parameters	The parameters of the stage
+ */
+NativeStage::NativeStage(const string& name, const Value& parameters) : m_name(name)
+{
+	if (parameters.HasMember("datapoint") && parameters["datapoint"].IsString())
+	{
+		m_datapoint = parameters["datapoint"].GetString();
+	}
+}
+
+/**
+ * Check if the stage should be applied to the given key
+ *
+ * @param key	The key to check
+ * @return bool	True if the stage applies to the key
+ */
+bool NativeStage::matches(const string& key) const
+{
+	return m_datapoint.empty() || m_datapoint.compare(key) == 0;
+}
+
+/**
+ * Convert a value to a double if the value is numeric
+ *
+ * @param value		The value to convert
+ * @param result	The numeric value
+ * @return bool		True if the value is numeric
+ */
+bool NativeStage::numeric(const string& value, double& result) const
+{
+	if (value.empty())
+		return false;
+	char *end;
+	result = strtod(value.c_str(), &end);
+	return *end == 0;
+}
+
+/**
+ * Format the result of a numeric transformation. Integer values remain
+ * integers if the result of the transformation is integral, other values
+ * are written with enough digits to be read back without loss.
+ *
+ * @param original	The original value of the key
+ * @param value		The transformed value
+ * @return string	The transformed value as a string
+ */
+std::string NativeStage::format(const string& original, double value) const
+{
+	char buf[40];
+	bool integer = original.find_first_of(".eE") == string::npos;
+	if (integer && value == floor(value) && fabs(value) < 9.2e18)
+	{
+		snprintf(buf, sizeof(buf), "%lld", (long long)value);
+	}
+	else
+	{
+		// Use the shortest representation that reads back as the same value
+		snprintf(buf, sizeof(buf), "%.15g", value);
+		if (strtod(buf, NULL) != value)
+			snprintf(buf, sizeof(buf), "%.17g", value);
+		if (strpbrk(buf, ".eEn") == NULL)
+			strcat(buf, ".0");
+	}
+	return string(buf);
+}
+
+/**
+ * Fetch a numeric parameter of the stage
+ *
+ * @param parameters	The stage parameters
+ * @param name		The name of the parameter
+ * @param value		The value of the parameter
+ * @return bool		True if the parameter was present
+ */
+bool NativeStage::getParameter(const Value& parameters, const char *name, double& value) const
+{
+	if (!parameters.HasMember(name))
+		return false;
+	const Value& param = parameters[name];
+	if (param.IsNumber())
+	{
+		value = param.GetDouble();
+		return true;
+	}
+	if (param.IsString() && numeric(param.GetString(), value))
+	{
+		return true;
+	}
+	throw runtime_error(string("the parameter '") + name + "' should be numeric");
+}
+
+/**
+ * Construct a scale stage, the factor parameter is required
+ */
+ScaleStage::ScaleStage(const string& name, const Value& parameters) :
+	NativeStage(name, parameters)
+{
+	if (!getParameter(parameters, "factor", m_factor))
+		throw runtime_error("a scale stage requires a factor");
+}
+
+/**
+ * Apply the scale factor to a numeric value
+ */
+bool ScaleStage::apply(string& key, string& value) const
+{
+	double v;
+	if (matches(key) && numeric(value, v))
+		value = format(value, v * m_factor);
+	return true;
+}
+
+/**
+ * Construct an offset stage, the offset parameter is required
+ */
+OffsetStage::OffsetStage(const string& name, const Value& parameters) :
+	NativeStage(name, parameters)
+{
+	if (!getParameter(parameters, "offset", m_offset))
+		throw runtime_error("an offset stage requires an offset");
+}
+
+/**
+ * Add the offset to a numeric value
+ */
+bool OffsetStage::apply(string& key, string& value) const
+{
+	double v;
+	if (matches(key) && numeric(value, v))
+		value = format(value, v + m_offset);
+	return true;
+}
+
+/**
+ * Construct a clamp stage, at least one of the min and max parameters
+ * is required
+ */
+ClampStage::ClampStage(const string& name, const Value& parameters) :
+	NativeStage(name, parameters)
+{
+	m_hasMin = getParameter(parameters, "min", m_min);
+	m_hasMax = getParameter(parameters, "max", m_max);
+	if (!m_hasMin && !m_hasMax)
+		throw runtime_error("a clamp stage requires a min or max value");
+	if (m_hasMin && m_hasMax && m_min > m_max)
+		throw runtime_error("the min value of a clamp stage is greater than the max value");
+}
+
+/**
+ * Limit a numeric value to the range of the clamp
+ */
+bool ClampStage::apply(string& key, string& value) const
+{
+	double v;
+	if (matches(key) && numeric(value, v))
+	{
+		if (m_hasMin && v < m_min)
+			value = format(value, m_min);
+		else if (m_hasMax && v > m_max)
+			value = format(value, m_max);
+	}
+	return true;
+}
+
+/**
+ * Construct a rename stage, the datapoint and to parameters are required
+ */
+RenameStage::RenameStage(const string& name, const Value& parameters) :
+	NativeStage(name, parameters)
+{
+	if (m_datapoint.empty())
+		throw runtime_error("a rename stage requires a datapoint to rename");
+	if (parameters.HasMember("to") && parameters["to"].IsString())
+		m_to = parameters["to"].GetString();
+	if (m_to.empty())
+		throw runtime_error("a rename stage requires a new name for the datapoint");
+}
+
+/**
+ * Rename the key if it matches the datapoint of the stage
+ */
+bool RenameStage::apply(string& key, string& value) const
+{
+	if (matches(key))
+		key = m_to;
+	return true;
+}
+
+/**
+ * Construct a unit conversion stage. The from and to parameters are
+ * required and must be units of the same dimension.
+ */
+ConvertStage::ConvertStage(const string& name, const Value& parameters) :
+	NativeStage(name, parameters)
+{
+	string from, to;
+	if (parameters.HasMember("from") && parameters["from"].IsString())
+		from = parameters["from"].GetString();
+	if (parameters.HasMember("to") && parameters["to"].IsString())
+		to = parameters["to"].GetString();
+	int f = -1, t = -1;
+	for (int i = 0; units[i].unit; i++)
+	{
+		if (from.compare(units[i].unit) == 0)
+			f = i;
+		if (to.compare(units[i].unit) == 0)
+			t = i;
+	}
+	if (f == -1 || t == -1)
+		throw runtime_error("a convert stage requires supported from and to units");
+	if (strcmp(units[f].dimension, units[t].dimension))
+		throw runtime_error("unable to convert " + from + " to " + to);
+
+	// Reduce the two conversions via the base unit to a single linear conversion
+	m_factor = units[f].scale / units[t].scale;
+	m_offset = (units[f].offset - units[t].offset) / units[t].scale;
+}
+
+/**
+ * Convert a numeric value between the units
+ */
+bool ConvertStage::apply(string& key, string& value) const
+{
+	double v;
+	if (matches(key) && numeric(value, v))
+		value = format(value, (v * m_factor) + m_offset);
+	return true;
+}
@@ -12,9 +12,19 @@
 #include <pipeline_manager.h>
 #include <plugin_manager.h>
 #include <filter_plugin.h>
+#include <native_stage.h>
+#include <pipeline_predicate.h>
+#include <debug_log.h>
+#include <async_logger.h>
+#include <metrics.h>
+#include <algorithm>
 
 using namespace std;
 
+thread_local PipelineTrace *PipelineExecutionContext::m_trace = NULL;
+thread_local PipelineExecutionContext *PipelineExecutionContext::m_ingestContext = NULL;
+thread_local PipelineExecutionContext::PendingResult *PipelineExecutionContext::m_ingestResult = NULL;
+
 /**
  * Constructor for pipeline exeuction context
  *
@@ -23,7 +33,23 @@ using namespace std;
  * @param filters	The list of filters to be run in the pipeline
  */
 PipelineExecutionContext::PipelineExecutionContext(ManagementClient *management, const std::string& name, const vector<string>& filters) :
-	m_management(management), m_name(name), m_filters(filters)
+	PipelineExecutionContext(new ManagementConfigProvider(management), name, filters)
+{
+	m_ownConfig = true;
+}
+
+/**
+ * Constructor for a pipeline execution context that obtains the
+ * configuration of the filters from a configuration provider. The
+ * provider is not owned by the context.
+ *
+ * @param config	The provider of the filter configuration
+ * @param name		The name of the pipeline this execution context is used for
+ * @param filters	The list of filters to be run in the pipeline
+ */
+PipelineExecutionContext::PipelineExecutionContext(FilterConfigProvider *config, const std::string& name, const vector<string>& filters) :
+	m_config(config), m_ownConfig(false), m_name(name), m_filters(filters), m_loaded(false), m_mutex(LockExecutionContext),
+	m_generation(0), m_references(1), m_pluginCount(0), m_nativeCount(0), m_pipelineManager(NULL), m_nextCorrelationId(0)
 {
 	m_logger = Logger::getLogger();
 }
@@ -34,21 +60,39 @@ PipelineExecutionContext::PipelineExecutionContext(ManagementClient *management,
  * Shutdown the filters and reclaim any resources
  *
  * Destruction requires that there are no control operations currently using
- * the context. We need to wait until we can grab the mutex before proceeding,
- * however this is not suffcient as if there are any other threads waiting on
- * the mutex they will grab this after we have destroyed the context and hence
- * fail. The layer above us, the pipeline manager takes responbsibility for this.
+ * the context. Contexts that are shared with requests are not deleted
+ * directly, the last reference to the context is released instead.
  */
 PipelineExecutionContext::~PipelineExecutionContext()
 {
-	lock_guard<mutex> guard(m_mutex);
+	lock_guard<ProfiledMutex> guard(m_mutex);
 
 	for (int i = 0; i < m_plugins.size(); i++)
 	{
-		m_plugins[i]->shutdown();
-		delete m_plugins[i];
+		if (m_plugins[i])
+		{
+			if (m_pipelineManager)
+				m_pipelineManager->unregisterCategory(m_filters[i], m_plugins[i]);
+			m_plugins[i]->shutdown();
+			delete m_plugins[i];
+		}
 	}
+	for (int i = 0; i < m_native.size(); i++)
+	{
+		delete m_native[i];
+	}
+	if (m_ownConfig)
+		delete m_config;
+}
 
+/**
+ * Release a reference to the context. The context is deleted when the last
+ * reference is released.
+ */
+void PipelineExecutionContext::release()
+{
+	if (m_references.fetch_sub(1) == 1)
+		delete this;
 }
 
 /**
@@ -58,58 +102,38 @@ bool
 PipelineExecutionContext::loadPipeline()
 {
 bool rval = true;
+bool noFilters = false;
 
-	m_logger->debug("Load Pipeline %s", m_name.c_str());
+	DEBUG_LOG(m_logger, "Load Pipeline %s", m_name.c_str());
 	try
 	{
 		for (auto& categoryName : m_filters)
 		{
-			// Get the category with values and defaults
-			ConfigCategory config = m_management->getCategory(categoryName);
-			if (config.itemExists("plugin"))
+			if (PipelinePredicate::isPredicate(categoryName))
 			{
-				string filterName = config.getValue("plugin");
-				m_logger->debug("Loading the plugin '%s' for filter %s", filterName.c_str(), categoryName.c_str());
-				PLUGIN_HANDLE filterHandle;
-				// Load filter plugin to obtain a handle that we can use to call the plugin
-				filterHandle = loadFilterPlugin(filterName);
-				if (!filterHandle)
+				// Predicates are evaluated by the pipeline, not the context
+				m_plugins.push_back(NULL);
+				m_native.push_back(NULL);
+			}
+			else if (NativeStage::isNative(categoryName))
+			{
+				NativeStage *stage = NativeStage::create(categoryName);
+				if (!stage)
 				{
-					string errMsg("Cannot load filter plugin '" + filterName + "'");
-					m_logger->error(errMsg.c_str());
 					rval = false;
 				}
-				else
+				m_plugins.push_back(NULL);
+				m_native.push_back(stage);
+			}
+			else
+			{
+				FilterPlugin *plugin = createFilterPlugin(categoryName);
+				if (!plugin)
 				{
-					PluginManager *pluginManager = PluginManager::getInstance();
-					// Get plugin default configuration
-					string filterConfig = pluginManager->getInfo(filterHandle)->config;
-
-					// Create/Update default filter category items
-					DefaultConfigCategory filterDefConfig(categoryName, filterConfig);
-					string filterDescription = "Configuration of '" + filterName;
-					filterDescription += "' filter for plugin '" + categoryName + "'";
-					filterDefConfig.setDescription(filterDescription);
-
-					if (!m_management->addCategory(filterDefConfig, true))
-					{
-						string errMsg("Cannot create/update '" + \
-							      categoryName + "' filter category");
-						m_logger->error(errMsg.c_str());
-						rval = false;
-					}
-					else
-					{
-
-						// Instantiate the FilterPlugin class
-						// in order to call plugin entry points
-						FilterPlugin *currentFilter = new FilterPlugin(filterName,
-											       filterHandle);
-
-						// Add filter to filters vector
-						m_plugins.push_back(currentFilter);
-					}
+					rval = false;
 				}
+				m_plugins.push_back(plugin);
+				m_native.push_back(NULL);
 			}
 			if (!rval)
 				break;
@@ -119,17 +143,37 @@ bool rval = true;
 	{
 		delete e;
 		m_logger->info("loadFilters: no filters configured for pipeline %s", m_name.c_str());
-		return true;
+		noFilters = true;
 	}
 	catch (exception& e)
 	{
 		m_logger->error("loadFilters: failed to handle exception for pipeline %s, %s",
 				m_name.c_str(), e.what());
-		return false;
+		rval = false;
 	}
 	catch (...)
 	{
 		m_logger->error("loadFilters: generic exception while loading %s", m_name.c_str());
+		rval = false;
+	}
+
+	if (!rval || noFilters)
+	{
+		// Cleanup the partly loaded pipeline, none of the plugins have been initialised
+		for (int i = 0; i < m_plugins.size(); i++)
+		{
+			delete m_plugins[i];
+			delete m_native[i];
+		}
+		m_plugins.clear();
+		m_native.clear();
+		if (noFilters)
+		{
+			// The pipeline is loaded, with no stages, so is not loaded again
+			m_loaded = true;
+			publishState();
+			return true;
+		}
 		return false;
 	}
 
@@ -137,27 +181,97 @@ bool rval = true;
 	// to form the actual pipeline by calling the init method of the plugin.
 	// This is passed the now merged configuration category and the next step
 	// in the pipeline.
-	int i = 0;
-	for (auto it = m_plugins.begin(); it != m_plugins.end(); ++it, ++i)
+	for (int i = 0; i < m_plugins.size(); i++)
 	{
-		FilterPlugin *plugin = *it;
-		ConfigCategory updatedCfg = m_management->getCategory(m_filters[i]);
-		if ((it + 1) != m_plugins.end())
-		{
-			plugin->init(updatedCfg, *(it + 1), filterReadingSetFn(passToOnwardFilter));
-		}
-		else
+		if (m_plugins[i])
 		{
-			plugin->init(updatedCfg, (OUTPUT_HANDLE *)this, filterReadingSetFn(useFilteredData));
+			ConfigCategory updatedCfg = m_config->getCategory(m_filters[i]);
+			initFilterPlugin(i, updatedCfg);
+			if (m_pipelineManager)
+				m_pipelineManager->registerCategory(m_filters[i], m_plugins[i]);
 		}
-		m_pipelineManager->registerCategory(m_filters[i], plugin);
 	}
+	m_loaded = true;
+	publishState();
+
+	return rval;
+}
 
-	if (!rval)
+/**
+ * Create the filter plugin for a filter in the pipeline. The plugin is
+ * loaded and the configuration category of the filter created or updated.
+ * The plugin is not initialised.
+ *
+ * @param categoryName	The name of the filter category
+ * @return FilterPlugin*	The filter plugin or NULL if the plugin could not be loaded
+ */
+FilterPlugin *
+PipelineExecutionContext::createFilterPlugin(const string& categoryName)
+{
+	// Get the category with values and defaults
+	ConfigCategory config = m_config->getCategory(categoryName);
+	if (!config.itemExists("plugin"))
 	{
-		// Cleanup possible partly loaded pipeline
+		m_logger->error("The filter %s in the pipeline %s does not define a plugin",
+				categoryName.c_str(), m_name.c_str());
+		return NULL;
+	}
+	string filterName = config.getValue("plugin");
+	DEBUG_LOG(m_logger, "Loading the plugin '%s' for filter %s", filterName.c_str(), categoryName.c_str());
+	PLUGIN_HANDLE filterHandle;
+	// Load filter plugin to obtain a handle that we can use to call the plugin
+	filterHandle = loadFilterPlugin(filterName);
+	if (!filterHandle)
+	{
+		string errMsg("Cannot load filter plugin '" + filterName + "'");
+		m_logger->error(errMsg.c_str());
+		return NULL;
+	}
+
+	PluginManager *pluginManager = PluginManager::getInstance();
+	// Get plugin default configuration
+	string filterConfig = pluginManager->getInfo(filterHandle)->config;
+
+	// Create/Update default filter category items
+	DefaultConfigCategory filterDefConfig(categoryName, filterConfig);
+	string filterDescription = "Configuration of '" + filterName;
+	filterDescription += "' filter for plugin '" + categoryName + "'";
+	filterDefConfig.setDescription(filterDescription);
+
+	if (!m_config->addCategory(filterDefConfig, true))
+	{
+		string errMsg("Cannot create/update '" + \
+			      categoryName + "' filter category");
+		m_logger->error(errMsg.c_str());
+		return NULL;
+	}
+
+	// Instantiate the FilterPlugin class
+	// in order to call plugin entry points
+	return new FilterPlugin(filterName, filterHandle);
+}
+
+/**
+ * Initialise the filter plugin at the given position in the pipeline. If
+ * the next stage of the pipeline is also a filter plugin the output of this
+ * plugin is passed to it, otherwise the output is collected as the result
+ * of the segment of filter plugins.
+ *
+ * @param index		The position of the filter plugin in the pipeline
+ * @param config	The configuration of the filter
+ */
+void
+PipelineExecutionContext::initFilterPlugin(int index, const ConfigCategory& config)
+{
+	FilterPlugin *plugin = m_plugins[index];
+	if (index + 1 < m_plugins.size() && m_plugins[index + 1])
+	{
+		plugin->init(config, m_plugins[index + 1], filterReadingSetFn(passToOnwardFilter));
+	}
+	else
+	{
+		plugin->init(config, (OUTPUT_HANDLE *)this, filterReadingSetFn(useFilteredData));
 	}
-	return rval;
 }
 
 /**
@@ -176,7 +290,7 @@ PipelineExecutionContext::loadFilterPlugin(const string& filterName)
 		// Failure
 		return NULL;
 	}
-	m_logger->debug("Loading filter plugin '%s'.", filterName.c_str());
+	DEBUG_LOG(m_logger, "Loading filter plugin '%s'.", filterName.c_str());
 
 	PluginManager* manager = PluginManager::getInstance();
 	PLUGIN_HANDLE handle;
@@ -190,55 +304,327 @@ PipelineExecutionContext::loadFilterPlugin(const string& filterName)
 
 
 /**
- * Do the actual work of filtering the control request. At this point the
- * control request has been transformed into a reading that can be sent via
- * the same set of filters used in south and north services.
+ * Do the actual work of filtering the control request. The key/value list of
+ * the control request is passed through each stage of the pipeline in turn.
+ * Native stages operate directly on the key/value list, for segments of the
+ * pipeline that consist of filter plugins the control request is transformed
+ * into a reading that can be sent via the same set of filters used in south
+ * and north services.
  *
- * @param reading	The control request transformed into a reading
- * @return Reading*	The filtered control request. This may be NULL if the filter removes the control request
+ * @param values	The key/value list of the control request
+ * @param name		The name of the control request, the asset name of the reading
+ * @param trace		An optional trace in which to record the pipeline execution
+ * @return bool		False if the filter removed the control request
  */
-Reading *PipelineExecutionContext::filter(Reading *reading)
+bool PipelineExecutionContext::filter(KVList& values, string& name, PipelineTrace *trace)
 {
 	/*
-	 * Only one execution at a time per instance as the result
-	 * will appear in the member variable m_result
+	 * Only one execution at a time per instance, the lock is released
+	 * whilst waiting for filters that emit their output asynchronously
 	 */
-	lock_guard<mutex> guard(m_mutex);
+	unique_lock<ProfiledMutex> lock(m_mutex);
 
-	if (m_plugins.size() == 0)
+	if (!m_loaded)
 		loadPipeline();
 
-	if (m_plugins.size() == 0)
+	unsigned int timeout = m_pipelineManager ? m_pipelineManager->getFilterTimeout() : 0;
+
+	// Keep the request so that it can be filtered again should the
+	// stages change whilst the lock is released
+	KVList original;
+	string originalName;
+	if (timeout)
 	{
-		m_logger->warn("Failed to load the pipeline %s, no filter is configured for the pipeline.", m_name.c_str());
-		return NULL;
+		original = values;
+		originalName = name;
+	}
+
+	for (int attempt = 1; ; attempt++)
+	{
+		if (m_plugins.size() == 0)
+		{
+			m_logger->warn("Failed to load the pipeline %s, no filter is configured for the pipeline.", m_name.c_str());
+			values.fromReading(NULL);
+			return false;
+		}
+
+		bool stale = false;
+		int i = 0;
+		while (i < m_plugins.size() && !stale)
+		{
+			if (m_native[i])
+			{
+				// Fuse all the adjacent native stages into a single pass
+				int end = i + 1;
+				while (end < m_native.size() && m_native[end])
+					end++;
+				if (trace)
+				{
+					string stages = m_filters[i];
+					for (int j = i + 1; j < end; j++)
+						stages += ", " + m_filters[j];
+					trace->start(stages);
+				}
+				runNativeStages(i, end, values);
+				if (trace)
+					trace->end();
+				i = end;
+			}
+			else if (m_plugins[i])
+			{
+				if (!runPlugins(i, values, name, lock, timeout, trace, stale))
+				{
+					if (stale)
+						break;
+					DEBUG_LOG(m_logger, "Control filter pipeline %s removed control request", m_name.c_str());
+					return false;
+				}
+				// Skip the rest of the segment of filter plugins
+				while (i < m_plugins.size() && m_plugins[i])
+					i++;
+			}
+			else
+			{
+				i++;
+			}
+		}
+		if (!stale)
+			return true;
+
+		if (attempt >= MAX_FILTER_ATTEMPTS)
+		{
+			AsyncLogger::getInstance()->error("Control filter pipeline %s was reconfigured %d times whilst filtering a control request, the request has been removed",
+					m_name.c_str(), attempt);
+			values.fromReading(NULL);
+			return false;
+		}
+		AsyncLogger::getInstance()->warn("Control filter pipeline %s was reconfigured whilst filtering a control request, the request will be filtered again",
+				m_name.c_str());
+		values = original;
+		name = originalName;
+	}
+}
+
+/**
+ * Run a set of adjacent native stages in a single pass over the key/value list
+ *
+ * @param start		The position of the first native stage in the pipeline
+ * @param end		The position after the last native stage to run
+ * @param values	The key/value list of the control request
+ */
+void PipelineExecutionContext::runNativeStages(int start, int end, KVList& values)
+{
+	values.transform([this, start, end](string& key, string& value) {
+		for (int i = start; i < end; i++)
+		{
+			if (!m_native[i]->apply(key, value))
+				return false;
+		}
+		return true;
+	});
+}
+
+/**
+ * Run a segment of connected filter plugins. The control request is converted
+ * to a reading, passed through the filter plugins and the result of the
+ * filtering converted back to the key/value list.
+ *
+ * If a filter completion timeout has been set the reading is tagged with a
+ * correlation datapoint and, if the filters do not emit the result within
+ * the call to ingest, the execution lock is released whilst waiting for
+ * the result. This allows other control requests to use the context. Should
+ * the stages of the pipeline change whilst the lock is released the result
+ * is discarded and the request marked as stale, the caller must filter the
+ * request again.
+ *
+ * @param index		The position of the first filter plugin of the segment
+ * @param values	The key/value list of the control request
+ * @param name		The name of the control request, the asset name of the reading
+ * @param lock		The execution lock held on the context
+ * @param timeout	The filter completion timeout in milliseconds
+ * @param trace		An optional trace in which to record the pipeline execution
+ * @param stale		Set if the stages of the pipeline changed
+ * @return bool		False if the filter plugins removed the control request
+ */
+bool PipelineExecutionContext::runPlugins(int index, KVList& values, string& name,
+		unique_lock<ProfiledMutex>& lock, unsigned int timeout, PipelineTrace *trace,
+		bool& stale)
+{
+	Reading *reading = values.toReading(name);
+
+	PendingResult pending;
+	unsigned long id = 0;
+	if (timeout)
+	{
+		{
+			lock_guard<mutex> guard(m_pendingMutex);
+			id = ++m_nextCorrelationId;
+			m_pending[id] = &pending;
+		}
+		DatapointValue cid(to_string(id));
+		reading->addDatapoint(new Datapoint(CORRELATION_DATAPOINT, cid));
 	}
 
 	/*
 	 * Create the reading set from the reading
 	 */
-	vector<Reading *> *vec = new vector<Reading *>();
-	vec->push_back(reading);
-	READINGSET *readingSet = new READINGSET(vec);
+	vector<Reading *> vec;
+	vec.push_back(reading);
+	READINGSET *readingSet = new READINGSET(&vec);
 
 	/*
-	 * Pass the data through the pipeline
+	 * Pass the data through the pipeline. The output emitted within the
+	 * call to ingest, on this thread, is matched to this request.
 	 */
-	m_logger->debug("Filtering control request for piepline '%s', %s", m_name.c_str(), reading->toJSON().c_str());
-	m_plugins[0]->ingest(readingSet);
+	DEBUG_LOG(m_logger, "Filtering control request for piepline '%s', %s", m_name.c_str(), reading->toJSON().c_str());
+	if (trace)
+		trace->start(m_filters[index]);
+	m_trace = trace;
+	m_ingestContext = this;
+	m_ingestResult = &pending;
+	m_plugins[index]->ingest(readingSet);
+	m_trace = NULL;
+	m_ingestContext = NULL;
+	m_ingestResult = NULL;
+
+	if (timeout)
+	{
+		unique_lock<mutex> pendingLock(m_pendingMutex);
+		if (!pending.m_complete)
+		{
+			// Allow other requests to use the context whilst we wait
+			unsigned long generation = m_generation;
+			lock.unlock();
+			m_pendingCV.wait_for(pendingLock, std::chrono::milliseconds(timeout),
+					[&pending]{ return pending.m_complete; });
+			if (!pending.m_complete)
+			{
+				AsyncLogger::getInstance()->warn("Control filter pipeline %s did not complete within %u milliseconds",
+						m_name.c_str(), timeout);
+			}
+			m_pending.erase(id);
+			pendingLock.unlock();
+			lock.lock();
+			if (m_generation != generation)
+			{
+				stale = true;
+				delete pending.m_result;
+				return false;
+			}
+		}
+		else
+		{
+			m_pending.erase(id);
+		}
+	}
+	if (trace)
+		trace->end();
+
+	Reading *result = pending.m_result;
+	if (result)
+	{
+		DEBUG_LOG(m_logger, "Result of filtering control request is %s", result->toJSON().c_str());
+	}
+	values.fromReading(result);
+	if (!result)
+	{
+		return false;
+	}
+	if (timeout)
+	{
+		values.transform([](string& key, string& value) {
+				return key.compare(CORRELATION_DATAPOINT) != 0;
+			});
+	}
+	name = result->getAssetName();
+	delete result;
+	return true;
+}
+
+/**
+ * Collect the output of the last filter plugin of a segment and match it
+ * to the control requests that are in flight in the context. The readings
+ * are matched using the correlation datapoint. A reading without the
+ * correlation datapoint, from a filter that does not copy it to its
+ * output, is matched to the request being ingested if it is emitted
+ * within the call to ingest that request.
+ * Output that does not match a request is discarded.
+ *
+ * @param readingSet	The output of the filter plugin
+ */
+void PipelineExecutionContext::collectResults(READINGSET *readingSet)
+{
+	{
+		lock_guard<mutex> guard(m_pendingMutex);
+		for (Reading *reading : readingSet->getAllReadings())
+		{
+			PendingResult *pending = NULL;
+			unsigned long id = getCorrelationId(reading);
+			if (id)
+			{
+				auto it = m_pending.find(id);
+				if (it != m_pending.end())
+					pending = it->second;
+			}
+			else if (m_ingestContext == this)
+			{
+				pending = m_ingestResult;
+			}
+
+			if (!pending || pending->m_complete)
+			{
+				DispatcherMetrics::getInstance()->increment(MetricFilterUnmatched);
+				AsyncLogger::getInstance()->warn("Control filter pipeline %s emitted a result that does not match an outstanding control request, the result has been discarded",
+						m_name.c_str());
+			}
+			else
+			{
+				pending->m_result = new Reading(*reading);
+				pending->m_complete = true;
+			}
+		}
+	}
+	m_pendingCV.notify_all();
+	delete readingSet;
+}
 
-	if (m_result && m_result->getCount() > 0)
+/**
+ * Return the correlation ID of a reading
+ *
+ * @param reading	The reading
+ * @return unsigned long	The correlation ID or 0 if the reading has no correlation ID
+ */
+unsigned long PipelineExecutionContext::getCorrelationId(Reading *reading)
+{
+	vector<Datapoint *> datapoints = reading->getReadingData();
+	for (Datapoint *dp : datapoints)
 	{
-		Reading *result = m_result->getAllReadings()[0];
-		m_result->clear();
-		m_logger->debug("Result of filtering control request is %s", result->toJSON().c_str());
-		return result;
+		if (dp->getName().compare(CORRELATION_DATAPOINT) == 0)
+		{
+			if (dp->getData().getType() == DatapointValue::T_STRING)
+				return strtoul(dp->getData().toStringValue().c_str(), NULL, 10);
+			return (unsigned long)dp->getData().toInt();
+		}
 	}
-	m_logger->info("Control filter pipeline %s removed control request", m_name.c_str());
-	return NULL;
+	return 0;
 }
 
 
+/**
+ * Return the name of a filter plugin within the pipeline
+ *
+ * @param plugin	The filter plugin
+ * @return string	The name of the filter in the pipeline
+ */
+string PipelineExecutionContext::getFilterName(FilterPlugin *plugin)
+{
+	for (int i = 0; i < m_plugins.size(); i++)
+	{
+		if (m_plugins[i] == plugin)
+			return m_filters[i];
+	}
+	return plugin->getName();
+}
 
 /**
  * Pass the current readings set to the next filter in the pipeline
@@ -256,6 +642,8 @@ void PipelineExecutionContext::passToOnwardFilter(OUTPUT_HANDLE *outHandle,
 {
 	// Get next filter in the pipeline
 	FilterPlugin *next = (FilterPlugin *)outHandle;
+	if (m_trace && m_ingestContext)
+		m_trace->start(m_ingestContext->getFilterName(next));
 	// Pass readings to next filter
 	next->ingest(readingSet);
 }
@@ -264,14 +652,9 @@ void PipelineExecutionContext::passToOnwardFilter(OUTPUT_HANDLE *outHandle,
  * Use the current input readings (they have been filtered
  * by all filters)
  *
- * The assumption is that one of two things has happened.
- *
- *	1. The filtering has all been done in place. In which case
- *	the m_data vector is in the ReadingSet passed in here.
- *
- *	2. The filtering has created new ReadingSet in which case
- *	the reading vector must be copied into m_data from the
- *	ReadingSet.
+ * This may be called within the call to ingest the control request or
+ * later, from another thread, by filters that emit their data
+ * asynchronously.
  *
  * Note:
  * This routine must be passed to last filter "plugin_init" only
@@ -285,7 +668,9 @@ void PipelineExecutionContext::useFilteredData(OUTPUT_HANDLE *outHandle,
 			     READINGSET *readingSet)
 {
 	PipelineExecutionContext *context = (PipelineExecutionContext *)outHandle;
-	context->setResult(readingSet);
+	if (m_trace && m_ingestContext == context)
+		m_trace->end();
+	context->collectResults(readingSet);
 }
 
 /**
@@ -296,87 +681,65 @@ void PipelineExecutionContext::useFilteredData(OUTPUT_HANDLE *outHandle,
  */
 void PipelineExecutionContext::addFilter(const string& filter, int order)
 {
-        FilterPlugin *currentPlugin = NULL;
-
-        // Stop ingestion while adding new filter into pipeline
-        lock_guard<mutex> guard(m_mutex);
-
-        // Add the filter into the pipeline vector
-        auto it = m_filters.begin();
-        it += (order - 1);
-        m_filters.insert(it, filter);
-
-        // Get the category with values and defaults
-        ConfigCategory config = m_management->getCategory(filter);
-        if (config.itemExists("plugin"))
-        {
-                string filterName = config.getValue("plugin");
-                m_logger->debug("Loading the plugin '%s' for filter %s", filterName.c_str(), filter.c_str());
-				PLUGIN_HANDLE filterHandle;
-                // Load filter plugin to obtain a handle that we can use to call the plugin
-                filterHandle = loadFilterPlugin(filterName);
-                if (!filterHandle)
-                {
-                        string errMsg("Cannot load filter plugin '" + filterName + "'");
-                        m_logger->error(errMsg.c_str());
-                        return;
-                }
-                else
-                {
-                        PluginManager *pluginManager = PluginManager::getInstance();
-                        // Get plugin default configuration
-                        string filterConfig = pluginManager->getInfo(filterHandle)->config;
-                        // Create/Update default filter category items
-                        DefaultConfigCategory filterDefConfig(filter, filterConfig);
-                        string filterDescription = "Configuration of '" + filterName;
-                        filterDescription += "' filter for plugin '" + filter + "'";
-                        filterDefConfig.setDescription(filterDescription);
-
-                        if (!m_management->addCategory(filterDefConfig, true))
-                        {
-                                string errMsg("Cannot create/update '" + \
-                                              filter + "' filter category");
-                                m_logger->error(errMsg.c_str());
-								return;
-                        }
-                        else
-                        {
-
-                                // Instantiate the FilterPlugin class
-                                // in order to call plugin entry points
-                                currentPlugin = new FilterPlugin(filterName, filterHandle);
-
-                                // Add filter to filters vector
-                                auto it = m_plugins.begin();
-                                it += (order - 1);
-                                m_plugins.insert(it, currentPlugin);
-                        }
-                }
-        }
-
-        if (!currentPlugin)
-        {
-                return;
-        }
-
-        // The filter has been created now we must "re-plumb" the pipeline
-        ConfigCategory updatedCfg = m_management->getCategory(filter);
-        if (order < m_plugins.size() - 1)
-                currentPlugin->init(updatedCfg, m_plugins[order + 1], filterReadingSetFn(passToOnwardFilter));
-        else
-                currentPlugin->init(updatedCfg, (OUTPUT_HANDLE *)this, filterReadingSetFn(useFilteredData));
-        m_pipelineManager->registerCategory(filter, currentPlugin);
-
-        // Make the filter before the new one send to our new filter
-        // To do this we need to call the init routine again, but under
-        // the rules of the filter API the filter must be first shutdown
-        if (m_plugins.size() > 1)
-        {
-                FilterPlugin *previous = m_plugins[m_plugins.size() - 1];
-                previous->shutdown();
-                ConfigCategory prevConfig = m_management->getCategory(m_filters[m_plugins.size() - 1]);
-                previous->init(prevConfig, currentPlugin, filterReadingSetFn(passToOnwardFilter));
-        }
+	// Stop ingestion while adding new filter into pipeline
+	lock_guard<ProfiledMutex> guard(m_mutex);
+
+	// Add the filter into the pipeline vector
+	int index = order - 1;
+	m_filters.insert(m_filters.begin() + index, filter);
+	m_generation++;
+
+	if (!m_loaded)
+	{
+		// The pipeline will be loaded with the new filter on first use
+		return;
+	}
+
+	if (PipelinePredicate::isPredicate(filter))
+	{
+		m_plugins.insert(m_plugins.begin() + index, (FilterPlugin *)NULL);
+		m_native.insert(m_native.begin() + index, (NativeStage *)NULL);
+	}
+	else if (NativeStage::isNative(filter))
+	{
+		NativeStage *stage = NativeStage::create(filter);
+		if (!stage)
+		{
+			m_filters.erase(m_filters.begin() + index);
+			return;
+		}
+		m_plugins.insert(m_plugins.begin() + index, (FilterPlugin *)NULL);
+		m_native.insert(m_native.begin() + index, stage);
+	}
+	else
+	{
+		FilterPlugin *currentPlugin = createFilterPlugin(filter);
+		if (!currentPlugin)
+		{
+			m_filters.erase(m_filters.begin() + index);
+			return;
+		}
+		m_plugins.insert(m_plugins.begin() + index, currentPlugin);
+		m_native.insert(m_native.begin() + index, (NativeStage *)NULL);
+
+		// The filter has been created now we must "re-plumb" the pipeline
+		ConfigCategory updatedCfg = m_config->getCategory(filter);
+		initFilterPlugin(index, updatedCfg);
+		if (m_pipelineManager)
+			m_pipelineManager->registerCategory(filter, currentPlugin);
+	}
+
+	// Make the filter before the new one send to the new stage
+	// To do this we need to call the init routine again, but under
+	// the rules of the filter API the filter must be first shutdown
+	if (index > 0 && m_plugins[index - 1])
+	{
+		FilterPlugin *previous = m_plugins[index - 1];
+		previous->shutdown();
+		ConfigCategory prevConfig = m_config->getCategory(m_filters[index - 1]);
+		initFilterPlugin(index - 1, prevConfig);
+	}
+	publishState();
 }
 
 /**
@@ -386,20 +749,37 @@ void PipelineExecutionContext::addFilter(const string& filter, int order)
  */
 void PipelineExecutionContext::removeFilter(const string& filter)
 {
-        // Remove filter from m_filters collection
-        auto it = std::find(m_filters.begin(), m_filters.end(), filter);
-        int index = it-m_filters.begin();
-        if (it != m_filters.end())
-        {
-                m_filters.erase(it);
-        }
-        // Unregister the filter plugin from pipeline and remove the filter plugin from m_plugins collection
-        m_plugins[index]->shutdown();
-        m_pipelineManager->unregisterCategory(filter, m_plugins[index]);
-        delete (m_plugins[index]);
-        m_plugins.erase(m_plugins.begin()+index);
-        // "re-plumb" the pipeline after deletion
-        rePlumbFilters();
+	lock_guard<ProfiledMutex> guard(m_mutex);
+
+	// Remove filter from m_filters collection
+	auto it = std::find(m_filters.begin(), m_filters.end(), filter);
+	if (it == m_filters.end())
+	{
+		return;
+	}
+	int index = it - m_filters.begin();
+	m_filters.erase(it);
+	m_generation++;
+
+	if (!m_loaded)
+	{
+		return;
+	}
+
+	// Unregister the filter plugin from pipeline and remove the filter plugin from m_plugins collection
+	if (m_plugins[index])
+	{
+		m_plugins[index]->shutdown();
+		if (m_pipelineManager)
+			m_pipelineManager->unregisterCategory(filter, m_plugins[index]);
+		delete m_plugins[index];
+	}
+	delete m_native[index];
+	m_plugins.erase(m_plugins.begin() + index);
+	m_native.erase(m_native.begin() + index);
+	// "re-plumb" the pipeline after deletion
+	rePlumbFilters();
+	publishState();
 }
 
 /**
@@ -410,21 +790,25 @@ void PipelineExecutionContext::removeFilter(const string& filter)
  */
 void PipelineExecutionContext::reorder(const std::string& filter, int order)
 {
-        for (int currentPosition = 0; currentPosition < m_filters.size(); currentPosition++)
-        {
-                if (m_filters[currentPosition].compare(filter) == 0)
-                {
-                        // reorder m_filters and m_plugins
-                        m_filters[currentPosition] = m_filters[order - 1];
-                        m_filters[order - 1] = filter;
-                        FilterPlugin *tmp = m_plugins[currentPosition];
-                        m_plugins[currentPosition] = m_plugins[order - 1];
-                        m_plugins[order - 1] = tmp;
-                        rePlumbFilters();
-                }
-
-        }
+	lock_guard<ProfiledMutex> guard(m_mutex);
 
+	for (int currentPosition = 0; currentPosition < m_filters.size(); currentPosition++)
+	{
+		if (m_filters[currentPosition].compare(filter) == 0)
+		{
+			// reorder m_filters, m_plugins and m_native
+			m_filters[currentPosition] = m_filters[order - 1];
+			m_filters[order - 1] = filter;
+			m_generation++;
+			if (m_loaded)
+			{
+				std::swap(m_plugins[currentPosition], m_plugins[order - 1]);
+				std::swap(m_native[currentPosition], m_native[order - 1]);
+				rePlumbFilters();
+			}
+			return;
+		}
+	}
 }
 
 /**
@@ -433,20 +817,50 @@ void PipelineExecutionContext::reorder(const std::string& filter, int order)
  */
 void PipelineExecutionContext::rePlumbFilters()
 {
-        // "re-plumb" the pipeline after reorder
-        int i=0;
-        for (auto it = m_plugins.begin(); it != m_plugins.end(); ++it, ++i)
-        {
-                FilterPlugin *plugin = *it;
-                ConfigCategory updatedCfg = m_management->getCategory(m_filters[i]);
-                plugin->shutdown();
-                if ((it + 1) != m_plugins.end())
-                {
-                        plugin->init(updatedCfg, *(it + 1), filterReadingSetFn(passToOnwardFilter));
-                }
-                else
-                {
-                        plugin->init(updatedCfg, (OUTPUT_HANDLE *)this, filterReadingSetFn(useFilteredData));
-                }
-        }
+	// "re-plumb" the pipeline after reorder
+	for (int i = 0; i < m_plugins.size(); i++)
+	{
+		if (m_plugins[i])
+		{
+			ConfigCategory updatedCfg = m_config->getCategory(m_filters[i]);
+			m_plugins[i]->shutdown();
+			initFilterPlugin(i, updatedCfg);
+		}
+	}
+}
+
+/**
+ * Publish the number of filter plugins and native stages loaded in the
+ * context. Called with the context mutex held whenever the loaded
+ * stages change.
+ */
+void PipelineExecutionContext::publishState()
+{
+	int plugins = 0, native = 0;
+	for (int i = 0; i < m_plugins.size(); i++)
+	{
+		if (m_plugins[i])
+			plugins++;
+		else if (m_native[i])
+			native++;
+	}
+	m_pluginCount = plugins;
+	m_nativeCount = native;
+}
+
+/**
+ * Return a JSON description of the execution context. This does not take
+ * the context mutex so that it does not wait for a request executing in
+ * the context.
+ *
+ * @return string	The JSON object describing the context
+ */
+string PipelineExecutionContext::toJSON()
+{
+	string json = "{ \"loaded\" : ";
+	json += m_loaded ? "true" : "false";
+	json += ", \"plugins\" : " + to_string(m_pluginCount);
+	json += ", \"native_stages\" : " + to_string(m_nativeCount);
+	json += " }";
+	return json;
 }
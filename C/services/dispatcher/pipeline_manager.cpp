@@ -11,8 +11,12 @@
 
 #include <pipeline_manager.h>
 #include <controlpipeline.h>
+#include <pipeline_snapshot.h>
 #include <dispatcher_service.h>
+#include <debug_log.h>
 #include <rapidjson/document.h>
+#include <chrono>
+#include <cstring>
 
 using namespace std;
 using namespace rapidjson;
@@ -23,7 +27,9 @@ using namespace rapidjson;
  * @param storage	The storage client used communicate with the soteage service
  */
 ControlPipelineManager::ControlPipelineManager(ManagementClient *mgtClient, StorageClient *storage) : 
-	m_managementClient(mgtClient), m_storage(storage)
+	m_managementClient(mgtClient), m_storage(storage), m_dispatcher(NULL),
+	m_pipelinesMtx(LockPipelines), m_filterTimeout(0), m_snapshot(NULL),
+	m_snapshotVersion(0), m_snapshotWritten(0), m_generation(0), m_reconcileThread(NULL), m_shutdown(false)
 {
 	m_logger = Logger::getLogger();
 }
@@ -33,6 +39,22 @@ ControlPipelineManager::ControlPipelineManager(ManagementClient *mgtClient, Stor
  */
 ControlPipelineManager::~ControlPipelineManager()
 {
+	if (m_reconcileThread)
+	{
+		{
+			lock_guard<mutex> guard(m_reconcileMutex);
+			m_shutdown = true;
+		}
+		m_reconcileCV.notify_all();
+		m_reconcileThread->join();
+		delete m_reconcileThread;
+	}
+	delete m_snapshot;
+	for (auto& pipeline : m_pipelines)
+	{
+		if (pipeline.second)
+			pipeline.second->release();
+	}
 }
 
 /**
@@ -43,8 +65,41 @@ ControlPipelineManager::~ControlPipelineManager()
 void
 ControlPipelineManager::loadPipelines()
 {
-	lock_guard<mutex> guard(m_pipelinesMtx);	// Prevent use of pipelines
-	loadLookupTables();
+	{
+		RetiredPipelines retired;
+		lock_guard<ProfiledMutex> guard(m_pipelinesMtx);	// Prevent use of pipelines
+		vector<PipelineDefinition> pipelines;
+		queryPipelines(pipelines, m_sourceTypes, m_destTypes);
+		for (auto& definition : pipelines)
+		{
+			storePipeline(definition.m_name, createPipeline(definition), retired);
+			m_pipelineIds[definition.m_id] = definition.m_name;
+		}
+
+		DEBUG_LOG(m_logger, "%d pipelines have been loaded", m_pipelines.size());
+	}
+	saveSnapshot();
+
+	// Register for updates to the table
+	m_dispatcher->registerTable(PIPELINES_TABLE);
+	m_dispatcher->registerTable(PIPELINES_FILTER_TABLE);
+	return;
+}
+
+/**
+ * Read the definitions of the control pipelines and the lookup tables
+ * for the endpoint types from the storage service
+ *
+ * @param pipelines	The vector to populate with the pipeline definitions
+ * @param sourceTypes	The source endpoint types to populate
+ * @param destTypes	The destination endpoint types to populate
+ * @return bool		True if the pipelines were read from storage
+ */
+bool ControlPipelineManager::queryPipelines(vector<PipelineDefinition>& pipelines,
+				map<int, EndpointLookup>& sourceTypes,
+				map<int, EndpointLookup>& destTypes)
+{
+	loadLookupTables(sourceTypes, destTypes);
 	vector<Returns *>columns;
 	columns.push_back(new Returns ("cpid"));
 	columns.push_back(new Returns ("name"));
@@ -55,64 +110,345 @@ ControlPipelineManager::loadPipelines()
 	columns.push_back(new Returns ("enabled"));
 	columns.push_back(new Returns ("execution"));
 	Query allPipelines(columns);
+	bool rval = false;
 	try {
-		ResultSet *pipelines = m_storage->queryTable(PIPELINES_TABLE, allPipelines);
-		if (pipelines->rowCount() > 0)
+		ResultSet *results = m_storage->queryTable(PIPELINES_TABLE, allPipelines);
+		if (!results)
+		{
+			m_logger->error("Failed to read the control pipelines from storage");
+			return false;
+		}
+		rval = true;
+		if (results->rowCount() > 0)
 		{
-			ResultSet::RowIterator it = pipelines->firstRow();
+			ResultSet::RowIterator it = results->firstRow();
 			do
 			{
 				ResultSet::Row *row = *it;
 				if (row)
 				{
+					PipelineDefinition definition;
 					ResultSet::ColumnValue *cpid = row->getColumn("cpid");
-					long pipelineId = cpid->getInteger();
+					definition.m_id = cpid->getInteger();
 					ResultSet::ColumnValue *name = row->getColumn("name");
-					string pname = name->getString();
+					definition.m_name = name->getString();
 
-					ControlPipeline *pipe = new ControlPipeline(this, name->getString());
-					if (!pipe)
-					{
-						m_logger->error("Failed to allocate the '%s' control pipeline",
-								pname.c_str());
-						break;
-					}
 					ResultSet::ColumnValue *cpsid = row->getColumn("stype");
-					PipelineEndpoint::EndpointType stype = m_sourceTypes[cpsid->getInteger()].m_type;
+					PipelineEndpoint::EndpointType stype = sourceTypes[cpsid->getInteger()].m_type;
 					ResultSet::ColumnValue *sname = row->getColumn("sname");
-					PipelineEndpoint source(stype, sname->getString());
+					definition.m_source = PipelineEndpoint(stype, sname->getString());
 					ResultSet::ColumnValue *cpdid = row->getColumn("dtype");
-					PipelineEndpoint::EndpointType dtype = m_destTypes[cpdid->getInteger()].m_type;
+					PipelineEndpoint::EndpointType dtype = destTypes[cpdid->getInteger()].m_type;
 					ResultSet::ColumnValue *dname = row->getColumn("dname");
-					PipelineEndpoint dest(dtype, dname->getString());
-					pipe->endpoints(source, dest);
-					vector<string> filters;
-					loadFilters(pname, cpid->getInteger(), filters);
-					pipe->setPipeline(filters);
+					definition.m_dest = PipelineEndpoint(dtype, dname->getString());
+					if (!loadFilters(definition.m_name, definition.m_id, definition.m_filters))
+						rval = false;
 					ResultSet::ColumnValue *en = row->getColumn("enabled");
-					pipe->enable(en->getString()[0] == 't');
-					m_pipelines[pname] = pipe;
-					m_pipelineIds[pipelineId] = pname;
+					definition.m_enabled = en->getString()[0] == 't';
+					ResultSet::ColumnValue *ex = row->getColumn("execution");
+					definition.m_exclusive = strcmp(ex->getString(), "Exclusive") == 0;
+					pipelines.push_back(definition);
 				}
-				if (! pipelines->isLastRow(it))
+				if (! results->isLastRow(it))
 					it++;
-			} while (! pipelines->isLastRow(it));
+			} while (! results->isLastRow(it));
 		}
-		delete pipelines;
+		delete results;
 	} catch (exception* exp) {
 		m_logger->error("Exception loading control pipelines: %s", exp->what());
+		rval = false;
 	} catch (exception& ex) {
 		m_logger->error("Exception loading control pipelines: %s", ex.what());
+		rval = false;
 	} catch (...) {
 		m_logger->error("Exception loading control pipelines");
+		rval = false;
 	}
+	return rval;
+}
 
-	m_logger->debug("%d pipelines have been loaded", m_pipelines.size());
+/**
+ * Create a control pipeline from its definition
+ *
+ * @param definition	The pipeline definition
+ * @return ControlPipeline*	The new control pipeline
+ */
+ControlPipeline *ControlPipelineManager::createPipeline(const PipelineDefinition& definition)
+{
+	ControlPipeline *pipe = new ControlPipeline(this, definition.m_name);
+	pipe->endpoints(definition.m_source, definition.m_dest);
+	pipe->setPipeline(definition.m_filters);
+	pipe->enable(definition.m_enabled);
+	pipe->exclusive(definition.m_exclusive);
+	return pipe;
+}
 
-	// Register for updates to the table
-	m_dispatcher->registerTable(PIPELINES_TABLE);
-	m_dispatcher->registerTable(PIPELINES_FILTER_TABLE);
-	return;
+/**
+ * Return the definitions of the pipelines that are loaded from storage,
+ * the caller must hold the pipelines mutex
+ *
+ * @param pipelines	The vector to populate with the pipeline definitions
+ */
+void ControlPipelineManager::getDefinitions(vector<PipelineDefinition>& pipelines)
+{
+	for (auto& id : m_pipelineIds)
+	{
+		auto it = m_pipelines.find(id.second);
+		if (it == m_pipelines.end() || !it->second)
+			continue;
+		ControlPipeline *pipe = it->second;
+		PipelineDefinition definition;
+		definition.m_id = id.first;
+		definition.m_name = id.second;
+		definition.m_source = pipe->getSource();
+		definition.m_dest = pipe->getDestination();
+		definition.m_enabled = pipe->isEnabled();
+		definition.m_exclusive = pipe->isExclusive();
+		definition.m_filters = pipe->getPipeline();
+		pipelines.push_back(definition);
+	}
+}
+
+/**
+ * Write the snapshot of the pipelines. The definitions are copied whilst
+ * holding the pipelines mutex but the snapshot is written once the mutex
+ * has been released, so that control requests are not blocked whilst the
+ * file is synced. The caller must not hold the pipelines mutex.
+ *
+ * Each copy is given a version so that a snapshot is never overwritten
+ * by an older copy written concurrently by another thread.
+ */
+void ControlPipelineManager::saveSnapshot()
+{
+	if (!m_snapshot)
+		return;
+	vector<PipelineDefinition> pipelines;
+	unsigned long version;
+	{
+		lock_guard<ProfiledMutex> guard(m_pipelinesMtx);
+		getDefinitions(pipelines);
+		version = ++m_snapshotVersion;
+	}
+	lock_guard<mutex> guard(m_snapshotMutex);
+	if (version < m_snapshotWritten)
+		return;
+	m_snapshotWritten = version;
+	m_snapshot->save(pipelines);
+}
+
+/**
+ * Store a pipeline under its name. Any other pipeline stored under the
+ * name is retired, the caller must hold the pipelines mutex.
+ *
+ * @param name		The name of the pipeline
+ * @param pipeline	The pipeline to store
+ * @param retired	The pipelines to release once the mutex is released
+ */
+void ControlPipelineManager::storePipeline(const string& name, ControlPipeline *pipeline,
+		RetiredPipelines& retired)
+{
+	ControlPipeline*& stored = m_pipelines[name];
+	if (stored && stored != pipeline)
+		retired.push_back(stored);
+	stored = pipeline;
+}
+
+/**
+ * Remove a pipeline from the pipeline manager, the caller must hold the
+ * pipelines mutex. The reference the manager holds on the pipeline is
+ * released once the mutex is released, the pipeline and its execution
+ * contexts are deleted once any requests still executing the pipeline
+ * complete.
+ *
+ * @param name		The name of the pipeline to retire
+ * @param retired	The pipelines to release once the mutex is released
+ */
+void ControlPipelineManager::retirePipeline(const string& name, RetiredPipelines& retired)
+{
+	auto it = m_pipelines.find(name);
+	if (it == m_pipelines.end())
+		return;
+	if (it->second)
+		retired.push_back(it->second);
+	m_pipelines.erase(it);
+}
+
+/**
+ * Release the references to the retired pipelines
+ */
+ControlPipelineManager::RetiredPipelines::~RetiredPipelines()
+{
+	for (auto pipeline : *this)
+		pipeline->release();
+}
+
+/**
+ * Set the path of the snapshot of the pipelines. The snapshot is written
+ * whenever the pipelines change.
+ *
+ * @param path	The path of the snapshot file
+ */
+void ControlPipelineManager::setSnapshot(const string& path)
+{
+	delete m_snapshot;
+	m_snapshot = new PipelineSnapshot(path);
+}
+
+/**
+ * Load the control pipelines from the snapshot written by a previous run
+ * of the service. This allows control requests to be served without
+ * waiting for the storage service, the pipelines must be reconciled with
+ * storage once they have been loaded.
+ *
+ * @return bool		True if the pipelines were loaded from the snapshot
+ */
+bool ControlPipelineManager::loadSnapshot()
+{
+	if (!m_snapshot)
+		return false;
+	vector<PipelineDefinition> pipelines;
+	if (!m_snapshot->load(pipelines))
+		return false;
+
+	RetiredPipelines retired;
+	lock_guard<ProfiledMutex> guard(m_pipelinesMtx);
+	for (auto& definition : pipelines)
+	{
+		storePipeline(definition.m_name, createPipeline(definition), retired);
+		m_pipelineIds[definition.m_id] = definition.m_name;
+	}
+	m_logger->info("%d control pipelines have been loaded from the snapshot %s",
+			pipelines.size(), m_snapshot->getPath().c_str());
+	return true;
+}
+
+/**
+ * Start the reconciliation of the pipelines loaded from the snapshot with
+ * those in storage. The reconciliation runs on its own thread, once it
+ * completes the requests in the request journal are replayed so that they
+ * are executed by the pipelines in storage.
+ */
+void ControlPipelineManager::reconcile()
+{
+	if (!m_reconcileThread)
+		m_reconcileThread = new thread([this]() {
+				if (reconcilePipelines() && m_dispatcher)
+					m_dispatcher->replayJournal();
+			});
+}
+
+/**
+ * Reconcile the pipelines loaded from the snapshot with those in storage.
+ *
+ * The pipelines are read from storage without holding the pipelines mutex,
+ * so that control requests continue to be served whilst storage is slow.
+ * If the storage service can not be read the read is retried. Should a
+ * change notification arrive whilst the pipelines are being read the read
+ * is repeated, as it may predate the change.
+ *
+ * If the version stamp of the pipelines in storage matches that of the
+ * snapshot nothing has changed. Otherwise pipelines that are unchanged
+ * are kept, with their execution contexts, and the others are replaced.
+ * Pipelines that are replaced or removed are retired, they are deleted
+ * once any worker still executing them has completed.
+ *
+ * @return bool		True if the pipelines were reconciled, false if the
+ *			service shut down first
+ */
+bool ControlPipelineManager::reconcilePipelines()
+{
+	bool registered = false;
+	while (true)
+	{
+		if (!registered)
+		{
+			// Register for updates to the table before reading it
+			try {
+				m_dispatcher->registerTable(PIPELINES_TABLE);
+				m_dispatcher->registerTable(PIPELINES_FILTER_TABLE);
+				registered = true;
+			} catch (exception& ex) {
+				m_logger->warn("Unable to register for control pipeline changes: %s", ex.what());
+			}
+		}
+
+		unsigned long generation = m_generation;
+		vector<PipelineDefinition> stored;
+		map<int, EndpointLookup> sourceTypes, destTypes;
+		if (registered && queryPipelines(stored, sourceTypes, destTypes))
+		{
+			bool reconciled = false;
+			{
+				RetiredPipelines retired;
+				lock_guard<ProfiledMutex> guard(m_pipelinesMtx);
+				if (generation == m_generation)
+				{
+					m_sourceTypes = sourceTypes;
+					m_destTypes = destTypes;
+					if (PipelineSnapshot::stamp(stored) == m_snapshot->getStamp())
+					{
+						m_logger->info("The control pipeline snapshot is current");
+						return true;
+					}
+
+					vector<PipelineDefinition> current;
+					getDefinitions(current);
+					map<long, const PipelineDefinition *> loaded;
+					for (auto& definition : current)
+						loaded[definition.m_id] = &definition;
+					int replaced = 0, removed = 0;
+					for (auto& definition : stored)
+					{
+						auto it = loaded.find(definition.m_id);
+						if (it != loaded.end())
+						{
+							bool same = *it->second == definition;
+							if (it->second->m_name != definition.m_name)
+								retirePipeline(it->second->m_name, retired);
+							loaded.erase(it);
+							if (same)
+								continue;
+						}
+						storePipeline(definition.m_name, createPipeline(definition), retired);
+						m_pipelineIds[definition.m_id] = definition.m_name;
+						replaced++;
+					}
+					for (auto& stale : loaded)
+					{
+						retirePipeline(stale.second->m_name, retired);
+						m_pipelineIds.erase(stale.first);
+						removed++;
+					}
+					m_logger->info("Control pipelines reconciled with storage, %d added or updated, %d removed",
+							replaced, removed);
+					reconciled = true;
+				}
+			}
+			if (reconciled)
+			{
+				// Written once the pipelines mutex has been released
+				saveSnapshot();
+				return true;
+			}
+			DEBUG_LOG(m_logger, "Control pipelines changed during reconciliation, reading them again");
+			continue;
+		}
+
+		unique_lock<mutex> lck(m_reconcileMutex);
+		if (m_reconcileCV.wait_for(lck, chrono::seconds(RECONCILE_RETRY_INTERVAL),
+					[this]{ return m_shutdown; }))
+			return false;
+	}
+}
+
+/**
+ * Called once a change to the pipelines has been actioned to rewrite the
+ * snapshot. The generation is incremented before the change is actioned
+ * so that a reconciliation in progress does not overwrite it.
+ */
+void ControlPipelineManager::changed()
+{
+	saveSnapshot();
 }
 
 /**
@@ -121,8 +457,9 @@ ControlPipelineManager::loadPipelines()
  * @param pipeline	The name of the pipeline
  * @param cpid		Control pipeline ID
  * @param filters	The array to populate with the filter names
+ * @return bool		True if the filters were read from storage
  */
-void ControlPipelineManager::loadFilters(const string& pipeline, int cpid, vector<string>& filters)
+bool ControlPipelineManager::loadFilters(const string& pipeline, int cpid, vector<string>& filters)
 {
 	vector<Returns *>columns;
 	columns.push_back(new Returns ("fname"));
@@ -132,6 +469,8 @@ void ControlPipelineManager::loadFilters(const string& pipeline, int cpid, vecto
 	allFilters.sort(orderby);
 	try {
 		ResultSet *results = m_storage->queryTable(PIPELINES_FILTER_TABLE, allFilters);
+		if (!results)
+			return false;
 		if (results->rowCount() > 0) {
 			ResultSet::RowIterator it = results->firstRow();
 			do {
@@ -146,11 +485,28 @@ void ControlPipelineManager::loadFilters(const string& pipeline, int cpid, vecto
 		delete results;
 	} catch (exception* exp) {
 		m_logger->error("Exception loading control pipeline filters for pipeline %s: %s", pipeline.c_str(), exp->what());
+		return false;
 	} catch (exception& ex) {
 		m_logger->error("Exception loading control pipeline filters for pipeline %s: %s", pipeline.c_str(), ex.what());
+		return false;
 	} catch (...) {
 		m_logger->error("Exception loading control pipeline filters for pipeline %s", pipeline.c_str());
+		return false;
 	}
+	return true;
+}
+
+/**
+ * Add a control pipeline that has been created outside of the storage
+ * service to the set of pipelines managed by the pipeline manager.
+ *
+ * @param pipeline	The control pipeline to add
+ */
+void ControlPipelineManager::addPipeline(ControlPipeline *pipeline)
+{
+	RetiredPipelines retired;
+	lock_guard<ProfiledMutex> guard(m_pipelinesMtx);
+	storePipeline(pipeline->getName(), pipeline, retired);
 }
 
 /**
@@ -160,18 +516,22 @@ void ControlPipelineManager::loadFilters(const string& pipeline, int cpid, vecto
  * @param source	The source end point to find a control pipeline for
  * @param dest		The destination end point to find a control pipeline for
  * @return ControlPipeline*	The best match control pipelien or NULL if none matched
+ *
+ * A reference is added to the pipeline that is returned, the caller must
+ * release the pipeline once it has finished with it.
  */
 ControlPipeline *
 ControlPipelineManager::findPipeline(const PipelineEndpoint& source, const PipelineEndpoint& dest)
 {
-	lock_guard<mutex> guard(m_pipelinesMtx);
+	lock_guard<ProfiledMutex> guard(m_pipelinesMtx);
 	// First of all look for a pipeline that exactly matches our source and destination
 	for (auto const& pipe : m_pipelines)
 	{
 		if (pipe.second->match(source, dest))
 		{
-			m_logger->debug("%s exactly matches pipelines for source %s to destination %s",
+			DEBUG_LOG(m_logger, "%s exactly matches pipelines for source %s to destination %s",
 				pipe.second->getName().c_str(), source.toString().c_str(), dest.toString().c_str());
+			pipe.second->acquire();
 			return pipe.second;
 		}
 	}
@@ -182,8 +542,9 @@ ControlPipelineManager::findPipeline(const PipelineEndpoint& source, const Pipel
 	{
 		if (pipe.second->match(any, dest))
 		{
-			m_logger->debug("%s matches pipelines for source (ANY) %s to destination %s",
+			DEBUG_LOG(m_logger, "%s matches pipelines for source (ANY) %s to destination %s",
 				pipe.second->getName().c_str(), source.toString().c_str(), dest.toString().c_str());
+			pipe.second->acquire();
 			return pipe.second;
 		}
 	}
@@ -193,8 +554,9 @@ ControlPipelineManager::findPipeline(const PipelineEndpoint& source, const Pipel
 	{
 		if (pipe.second->match(source, any))
 		{
-			m_logger->debug("%s matches pipelines for source %s to destination (ANY) %s",
+			DEBUG_LOG(m_logger, "%s matches pipelines for source %s to destination (ANY) %s",
 				pipe.second->getName().c_str(), source.toString().c_str(), dest.toString().c_str());
+			pipe.second->acquire();
 			return pipe.second;
 		}
 	}
@@ -204,22 +566,27 @@ ControlPipelineManager::findPipeline(const PipelineEndpoint& source, const Pipel
 	{
 		if (pipe.second->match(any, any))
 		{
-			m_logger->debug("%s matches pipelines for source %s to destination %s with generic any to any pipeline",
+			DEBUG_LOG(m_logger, "%s matches pipelines for source %s to destination %s with generic any to any pipeline",
 				pipe.second->getName().c_str(), source.toString().c_str(), dest.toString().c_str());
+			pipe.second->acquire();
 			return pipe.second;
 		}
 	}
 
 	// No pipelines matched
-	m_logger->debug("No matching pipelines for source %s to destination %s",
+	DEBUG_LOG(m_logger, "No matching pipelines for source %s to destination %s",
 			source.toString().c_str(), dest.toString().c_str());
 	return NULL;
 }
 
 /**
  * Load the lookup tables for the endpoint types
+ *
+ * @param sourceTypes	The source endpoint types to populate
+ * @param destTypes	The destination endpoint types to populate
  */
-void ControlPipelineManager::loadLookupTables()
+void ControlPipelineManager::loadLookupTables(map<int, EndpointLookup>& sourceTypes,
+				map<int, EndpointLookup>& destTypes)
 {
 	// First load the source endpoints
 	vector<Returns *>columns;
@@ -252,7 +619,7 @@ void ControlPipelineManager::loadLookupTables()
 				else if (!strcmp(name->getString(),"Script"))
 					t = PipelineEndpoint::EndpointScript;
 				EndpointLookup epl(name->getString(), description->getString(), t);
-				m_sourceTypes[cpsid->getInteger()] = epl;
+				sourceTypes[cpsid->getInteger()] = epl;
 			}
 		} while (sources->isLastRow(it++));
 		delete sources;
@@ -293,7 +660,7 @@ void ControlPipelineManager::loadLookupTables()
 					else if (!strcmp(name->getString(),"Script"))
 						t = PipelineEndpoint::EndpointScript;
 					EndpointLookup epl(name->getString(), description->getString(), t);
-					m_destTypes[cpdid->getInteger()] = epl;
+					destTypes[cpdid->getInteger()] = epl;
 				}
 			} while (dests->isLastRow(it++));
 			delete dests;
@@ -367,7 +734,8 @@ ControlPipelineManager::EndpointLookup::EndpointLookup(const ControlPipelineMana
 void ControlPipelineManager::registerCategory(const string& category, FilterPlugin *plugin)
 {
 	m_categories.insert(pair<string, FilterPlugin *>(category, plugin));
-	m_dispatcher->registerCategory(category);
+	if (m_dispatcher)
+		m_dispatcher->registerCategory(category);
 }
 
 /**
@@ -418,13 +786,16 @@ void ControlPipelineManager::categoryChanged(const string& name, const string& c
  */
 void ControlPipelineManager::rowInsert(const string& table, const Document& doc)
 {
+	m_generation++;
 	if (table.compare(PIPELINES_TABLE) == 0)
 	{
 		insertPipeline(doc);
+		changed();
 	}
 	else if (table.compare(PIPELINES_FILTER_TABLE) == 0)
 	{
 		insertPipelineFilter(doc);
+		changed();
 	}
 }
 
@@ -437,13 +808,16 @@ void ControlPipelineManager::rowInsert(const string& table, const Document& doc)
  */
 void ControlPipelineManager::rowUpdate(const string& table, const Document& doc)
 {
+	m_generation++;
 	if (table.compare(PIPELINES_TABLE) == 0)
 	{
 		updatePipeline(doc);
+		changed();
 	}
 	else if (table.compare(PIPELINES_FILTER_TABLE) == 0)
 	{
 		updatePipelineFilter(doc);
+		changed();
 	}
 }
 
@@ -456,13 +830,16 @@ void ControlPipelineManager::rowUpdate(const string& table, const Document& doc)
  */
 void ControlPipelineManager::rowDelete(const string& table, const Document& doc)
 {
+	m_generation++;
 	if (table.compare(PIPELINES_TABLE) == 0)
 	{
 		deletePipeline(doc);
+		changed();
 	}
 	else if (table.compare(PIPELINES_FILTER_TABLE) == 0)
 	{
 		deletePipelineFilter(doc);
+		changed();
 	}
 }
 
@@ -540,20 +917,22 @@ void ControlPipelineManager::insertPipeline(const Document& doc)
 			pipe->exclusive(false);
 		}
 
-		lock_guard<mutex> guard(m_pipelinesMtx);
+		RetiredPipelines retired;
+		lock_guard<ProfiledMutex> guard(m_pipelinesMtx);
 
 		// Load pipeline from storage and get cpid value
 		long pipelineId = loadPipeline(pname);
 		if (pipelineId > 0)
 		{
 			// store pipeline object
-			m_pipelines[pname] = pipe;
+			storePipeline(pname, pipe, retired);
 
 			// store pipeline id
 			m_pipelineIds[pipelineId] = pname;
 		} else {
 			m_logger->error("Failed to setup control pipeline '%s'",
 					pname.c_str());
+			pipe->release();
 		}
 	}
 }
@@ -634,7 +1013,7 @@ void ControlPipelineManager::updatePipeline(const Document& doc)
 		m_logger->error("Unable to determine ID of updated pipeline, ignoring update");
 		return;
 	}
-	lock_guard<mutex> guard(m_pipelinesMtx);
+	lock_guard<ProfiledMutex> guard(m_pipelinesMtx);
 	long cpid = strtol(value.c_str(), NULL, 10);
 
 	auto pipelineIDIterator = m_pipelineIds.find(cpid);
@@ -752,11 +1131,17 @@ void ControlPipelineManager::deletePipeline(const Document& doc)
 		return;
 	}
 	long cpid = strtol(value.c_str(), NULL, 10);
-	string pipelineName = m_pipelineIds[cpid];
-
-	m_pipelineIds.erase(cpid);
-	ControlPipeline *pipeline = m_pipelines[pipelineName];
-	m_pipelines.erase(pipelineName);
+	RetiredPipelines retired;
+	lock_guard<ProfiledMutex> guard(m_pipelinesMtx);
+	auto it = m_pipelineIds.find(cpid);
+	if (it == m_pipelineIds.end())
+	{
+		m_logger->error("Unable to find pipeline with id %d, pipeline delete ignored", cpid);
+		return;
+	}
+	string pipelineName = it->second;
+	m_pipelineIds.erase(it);
+	retirePipeline(pipelineName, retired);
 }
 
 /**
@@ -922,3 +1307,31 @@ ControlPipelineManager::loadPipeline(string& pName)
 
 	return pipelineId;
 }
+
+/**
+ * Return a JSON description of the loaded pipelines, their execution
+ * contexts and the occupancy of the lookup tables held by the manager
+ *
+ * @return string	The JSON object describing the pipelines
+ */
+string ControlPipelineManager::statusToJSON()
+{
+	lock_guard<ProfiledMutex> guard(m_pipelinesMtx);
+	string json = "{ \"pipelines\" : [ ";
+	bool first = true;
+	for (auto& it : m_pipelines)
+	{
+		if (!first)
+			json += ", ";
+		first = false;
+		json += it.second->toJSON();
+	}
+	json += " ], \"tables\" : { ";
+	json += "\"pipelines\" : " + to_string(m_pipelines.size());
+	json += ", \"pipeline_ids\" : " + to_string(m_pipelineIds.size());
+	json += ", \"source_types\" : " + to_string(m_sourceTypes.size());
+	json += ", \"destination_types\" : " + to_string(m_destTypes.size());
+	json += ", \"filter_categories\" : " + to_string(m_categories.size());
+	json += " } }";
+	return json;
+}
@@ -0,0 +1,159 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <pipeline_predicate.h>
+#include <logger.h>
+#include <rapidjson/document.h>
+#include <cstring>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * Construct an empty predicate, this matches all control requests
+ */
+PipelinePredicate::PipelinePredicate() : m_hasKeys(false), m_keyMask(0),
+	m_hasOperations(false), m_operationMask(0)
+{
+}
+
+/**
+ * Determine if a filter name in a pipeline is a predicate declaration
+ *
+ * @param filterName	The name of the filter in the pipeline
+ * @return bool		True if the entry is a predicate
+ */
+bool PipelinePredicate::isPredicate(const string& filterName)
+{
+	return filterName.compare(0, strlen(PREDICATE_PREFIX), PREDICATE_PREFIX) == 0;
+}
+
+/**
+ * Compile the predicate from the predicate entries of a pipeline. If a
+ * pipeline has more than one predicate entry the keys and operations of
+ * the entries are combined.
+ *
+ * If any predicate entry is invalid the predicate is left empty so that
+ * the pipeline continues to be applied to all requests.
+ *
+ * @param pipeline	The entries of the pipeline
+ */
+void PipelinePredicate::compile(const vector<string>& pipeline)
+{
+	m_hasKeys = false;
+	m_keyMask = 0;
+	m_keys.clear();
+	m_hasOperations = false;
+	m_operationMask = 0;
+	m_operations.clear();
+
+	for (auto& entry : pipeline)
+	{
+		if (isPredicate(entry) && !add(entry.substr(strlen(PREDICATE_PREFIX))))
+		{
+			Logger::getLogger()->error("Invalid pipeline predicate '%s', the pipeline will be applied to all control requests",
+					entry.c_str());
+			m_hasKeys = false;
+			m_keys.clear();
+			m_hasOperations = false;
+			m_operations.clear();
+			return;
+		}
+	}
+}
+
+/**
+ * Add the conditions of a single predicate entry
+ *
+ * @param definition	The JSON definition of the predicate
+ * @return bool		True if the definition was valid
+ */
+bool PipelinePredicate::add(const string& definition)
+{
+	Document doc;
+	doc.Parse(definition.c_str());
+	if (doc.HasParseError() || !doc.IsObject())
+		return false;
+
+	if (doc.HasMember("keys"))
+	{
+		if (!doc["keys"].IsArray())
+			return false;
+		for (auto& key : doc["keys"].GetArray())
+		{
+			if (!key.IsString())
+				return false;
+			m_keys.insert(key.GetString());
+			m_keyMask |= bit(key.GetString());
+		}
+		m_hasKeys = true;
+	}
+	if (doc.HasMember("operations"))
+	{
+		if (!doc["operations"].IsArray())
+			return false;
+		for (auto& operation : doc["operations"].GetArray())
+		{
+			if (!operation.IsString())
+				return false;
+			m_operations.insert(operation.GetString());
+			m_operationMask |= bit(operation.GetString());
+		}
+		m_hasOperations = true;
+	}
+	return true;
+}
+
+/**
+ * Determine if a control request satisfies the predicate.
+ *
+ * If the predicate lists keys then the request must contain at least one
+ * of the keys. If the predicate lists operations then the request must be
+ * an operation with one of the listed names, write requests never satisfy
+ * a predicate that lists operations.
+ *
+ * @param values	The key/value list of the request
+ * @param operation	The name of the operation or NULL for a write request
+ * @return bool		True if the pipeline should be applied to the request
+ */
+bool PipelinePredicate::matches(const KVList& values, const string *operation) const
+{
+	if (m_hasOperations)
+	{
+		if (!operation || (m_operationMask & bit(*operation)) == 0
+				|| m_operations.find(*operation) == m_operations.end())
+			return false;
+	}
+	if (m_hasKeys)
+	{
+		return values.anyKey([this](const string& key) {
+				return (m_keyMask & bit(key)) != 0 && m_keys.find(key) != m_keys.end();
+			});
+	}
+	return true;
+}
+
+/**
+ * Return the bit in the 64 bit mask that represents a name. The
+ * FNV-1a hash of the name is folded into the range 0 to 63.
+ *
+ * @param name		The name to hash
+ * @return uint64_t	The mask bit for the name
+ */
+uint64_t PipelinePredicate::bit(const string& name)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : name)
+	{
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	return 1ULL << ((hash ^ (hash >> 32)) & 63);
+}
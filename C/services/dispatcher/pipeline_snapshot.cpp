@@ -0,0 +1,293 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <pipeline_snapshot.h>
+#include <logger.h>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+ * Append an integer to a snapshot buffer
+ *
+ * @param buffer	The buffer
+ * @param value		The value to append
+ */
+template<class T> static void append(string& buffer, T value)
+{
+	buffer.append((const char *)&value, sizeof(T));
+}
+
+/**
+ * Append a string to a snapshot buffer
+ *
+ * @param buffer	The buffer
+ * @param value		The string to append
+ */
+static void appendString(string& buffer, const string& value)
+{
+	append<uint32_t>(buffer, value.length());
+	buffer.append(value);
+}
+
+/**
+ * A bounds checked reader of the records of a snapshot
+ */
+class SnapshotReader {
+	public:
+		SnapshotReader(const char *data, size_t length) :
+			m_data(data), m_length(length), m_offset(0), m_error(false) {};
+		template<class T> T
+			read()
+			{
+				T value = 0;
+				if (m_offset + sizeof(T) > m_length)
+				{
+					m_error = true;
+					return value;
+				}
+				memcpy(&value, m_data + m_offset, sizeof(T));
+				m_offset += sizeof(T);
+				return value;
+			};
+		string	readString()
+			{
+				uint32_t length = read<uint32_t>();
+				if (m_error || m_offset + length > m_length)
+				{
+					m_error = true;
+					return string();
+				}
+				string value(m_data + m_offset, length);
+				m_offset += length;
+				return value;
+			};
+		bool	error() const { return m_error; };
+	private:
+		const char	*m_data;
+		size_t		m_length;
+		size_t		m_offset;
+		bool		m_error;
+};
+
+/**
+ * Return the default path of the snapshot of a dispatcher service, in the
+ * Fledge data directory
+ *
+ * @param service	The name of the service
+ * @return string	The path of the snapshot file
+ */
+string PipelineSnapshot::defaultPath(const string& service)
+{
+	string dir;
+	if (getenv("FLEDGE_DATA"))
+		dir = getenv("FLEDGE_DATA");
+	else if (getenv("FLEDGE_ROOT"))
+		dir = string(getenv("FLEDGE_ROOT")) + "/data";
+	else
+		dir = "/tmp";
+	string name = service;
+	replace(name.begin(), name.end(), '/', '_');
+	replace(name.begin(), name.end(), ' ', '_');
+	return dir + "/" + name + "_pipelines.snapshot";
+}
+
+/**
+ * Return the FNV-1a hash of a block of data, a hash of 0 is reserved to
+ * mean there is no snapshot
+ *
+ * @param data		The data to hash
+ * @param length	The length of the data
+ * @return uint64_t	The hash
+ */
+uint64_t PipelineSnapshot::hash(const char *data, size_t length)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash ? hash : 1;
+}
+
+/**
+ * Serialise the pipeline definitions into the records of a snapshot. The
+ * pipelines are ordered by their ID so that the same set of pipelines
+ * always gives the same records and hence the same stamp.
+ *
+ * @param pipelines	The pipeline definitions
+ * @param records	The buffer to append the records to
+ */
+void PipelineSnapshot::serialize(const vector<PipelineDefinition>& pipelines, string& records)
+{
+	vector<const PipelineDefinition *> ordered;
+	for (auto& pipeline : pipelines)
+		ordered.push_back(&pipeline);
+	sort(ordered.begin(), ordered.end(),
+		[](const PipelineDefinition *a, const PipelineDefinition *b) {
+			return a->m_id < b->m_id;
+		});
+
+	for (auto pipeline : ordered)
+	{
+		append<int64_t>(records, pipeline->m_id);
+		append<uint8_t>(records, pipeline->m_enabled ? 1 : 0);
+		append<uint8_t>(records, pipeline->m_exclusive ? 1 : 0);
+		append<uint8_t>(records, pipeline->m_source.getType());
+		append<uint8_t>(records, pipeline->m_dest.getType());
+		appendString(records, pipeline->m_name);
+		appendString(records, pipeline->m_source.getName());
+		appendString(records, pipeline->m_dest.getName());
+		append<uint32_t>(records, pipeline->m_filters.size());
+		for (auto& filter : pipeline->m_filters)
+			appendString(records, filter);
+	}
+}
+
+/**
+ * Return the version stamp of a set of pipeline definitions
+ *
+ * @param pipelines	The pipeline definitions
+ * @return uint64_t	The stamp
+ */
+uint64_t PipelineSnapshot::stamp(const vector<PipelineDefinition>& pipelines)
+{
+	string records;
+	serialize(pipelines, records);
+	return hash(records.data(), records.length());
+}
+
+/**
+ * Write a snapshot of the pipelines. The snapshot is written to a
+ * temporary file that is then renamed so that a snapshot is never
+ * partially written. The write is skipped if the pipelines are the same
+ * as those in the last snapshot.
+ *
+ * @param pipelines	The pipeline definitions
+ * @return bool		True if the snapshot is current
+ */
+bool PipelineSnapshot::save(const vector<PipelineDefinition>& pipelines)
+{
+	string records;
+	serialize(pipelines, records);
+	Header header;
+	header.m_magic = PIPELINE_SNAPSHOT_MAGIC;
+	header.m_version = PIPELINE_SNAPSHOT_VERSION;
+	header.m_stamp = hash(records.data(), records.length());
+	header.m_count = pipelines.size();
+	header.m_length = records.length();
+	if (header.m_stamp == m_stamp)
+		return true;
+
+	string tmp = m_path + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+	{
+		Logger::getLogger()->error("Unable to create the control pipeline snapshot %s, %s",
+				tmp.c_str(), strerror(errno));
+		return false;
+	}
+	bool ok = write(fd, &header, sizeof(header)) == sizeof(header)
+		&& write(fd, records.data(), records.length()) == (ssize_t)records.length();
+	if (ok && fsync(fd) != 0)
+		ok = false;
+	if (close(fd) != 0)
+		ok = false;
+	if (!ok || rename(tmp.c_str(), m_path.c_str()) != 0)
+	{
+		Logger::getLogger()->error("Failed to write the control pipeline snapshot %s, %s",
+				m_path.c_str(), strerror(errno));
+		unlink(tmp.c_str());
+		return false;
+	}
+	m_stamp = header.m_stamp;
+	return true;
+}
+
+/**
+ * Load the pipelines from the snapshot. The snapshot is mapped rather than
+ * read and is rejected if the header or stamp do not match the records.
+ *
+ * @param pipelines	The vector to populate with the pipeline definitions
+ * @return bool		True if a valid snapshot was loaded
+ */
+bool PipelineSnapshot::load(vector<PipelineDefinition>& pipelines)
+{
+	int fd = open(m_path.c_str(), O_RDONLY);
+	if (fd == -1)
+	{
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header))
+	{
+		close(fd);
+		return false;
+	}
+	size_t size = st.st_size;
+	void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		Logger::getLogger()->error("Unable to map the control pipeline snapshot %s, %s",
+				m_path.c_str(), strerror(errno));
+		return false;
+	}
+
+	const char *data = (const char *)map;
+	Header header;
+	memcpy(&header, data, sizeof(header));
+	const char *records = data + sizeof(header);
+	bool valid = header.m_magic == PIPELINE_SNAPSHOT_MAGIC
+		&& header.m_version == PIPELINE_SNAPSHOT_VERSION
+		&& header.m_length == size - sizeof(header)
+		&& header.m_stamp == hash(records, header.m_length);
+	if (valid)
+	{
+		SnapshotReader reader(records, header.m_length);
+		for (uint32_t i = 0; i < header.m_count && !reader.error(); i++)
+		{
+			PipelineDefinition pipeline;
+			pipeline.m_id = reader.read<int64_t>();
+			pipeline.m_enabled = reader.read<uint8_t>() != 0;
+			pipeline.m_exclusive = reader.read<uint8_t>() != 0;
+			PipelineEndpoint::EndpointType stype = (PipelineEndpoint::EndpointType)reader.read<uint8_t>();
+			PipelineEndpoint::EndpointType dtype = (PipelineEndpoint::EndpointType)reader.read<uint8_t>();
+			pipeline.m_name = reader.readString();
+			pipeline.m_source = PipelineEndpoint(stype, reader.readString());
+			pipeline.m_dest = PipelineEndpoint(dtype, reader.readString());
+			uint32_t filters = reader.read<uint32_t>();
+			for (uint32_t j = 0; j < filters && !reader.error(); j++)
+				pipeline.m_filters.push_back(reader.readString());
+			pipelines.push_back(pipeline);
+		}
+		valid = !reader.error();
+	}
+	munmap(map, size);
+
+	if (!valid)
+	{
+		Logger::getLogger()->warn("The control pipeline snapshot %s is not valid and will be ignored",
+				m_path.c_str());
+		pipelines.clear();
+		return false;
+	}
+	m_stamp = header.m_stamp;
+	return true;
+}
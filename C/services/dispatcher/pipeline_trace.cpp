@@ -0,0 +1,82 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <pipeline_trace.h>
+#include <string_utils.h>
+
+using namespace std;
+
+/**
+ * Constructor for an empty pipeline trace
+ */
+PipelineTrace::PipelineTrace() : m_removed(false), m_skipped(false), m_inStage(false)
+{
+}
+
+/**
+ * Record the start of a stage of the pipeline. Any stage that is
+ * currently in progress is completed.
+ *
+ * @param stage	The name of the stage
+ */
+void PipelineTrace::start(const string& stage)
+{
+	end();
+	m_current = stage;
+	m_inStage = true;
+	m_stageStart = Clock::now();
+}
+
+/**
+ * Record the completion of the current stage of the pipeline
+ */
+void PipelineTrace::end()
+{
+	if (!m_inStage)
+		return;
+	long duration = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - m_stageStart).count();
+	m_stages.push_back(StageTiming(m_current, duration));
+	m_inStage = false;
+}
+
+/**
+ * Return the JSON representation of the trace
+ *
+ * @return string	The trace as a JSON object
+ */
+string PipelineTrace::toJSON() const
+{
+	string pipeline = m_pipeline;
+	StringEscapeQuotes(pipeline);
+	string json = "{ \"pipeline\" : ";
+	if (m_pipeline.empty())
+		json += "null";
+	else
+		json += "\"" + pipeline + "\"";
+	json += ", \"removed\" : ";
+	json += m_removed ? "true" : "false";
+	json += ", \"skipped\" : ";
+	json += m_skipped ? "true" : "false";
+	json += ", \"timings\" : [ ";
+	long total = 0;
+	bool first = true;
+	for (auto& stage : m_stages)
+	{
+		if (!first)
+			json += ", ";
+		first = false;
+		string name = stage.m_stage;
+		StringEscapeQuotes(name);
+		json += "{ \"stage\" : \"" + name + "\", \"duration\" : " + to_string(stage.m_duration / 1000) + " }";
+		total += stage.m_duration;
+	}
+	json += " ], \"total\" : " + to_string(total / 1000) + " }";
+	return json;
+}
@@ -0,0 +1,630 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <request_journal.h>
+#include <controlrequest.h>
+#include <metrics.h>
+#include <logger.h>
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * Constructor for the request journal
+ *
+ * @param path		The path of the journal file
+ * @param durability	The durability of the requests written to the journal
+ */
+RequestJournal::RequestJournal(const string& path, JournalDurability durability) :
+	m_path(path), m_durability(durability), m_fd(-1), m_map(NULL), m_header(NULL),
+	m_firstSequence(1), m_tail(JOURNAL_DATA_START), m_nextSequence(1),
+	m_committed(0), m_syncing(false), m_full(false)
+{
+}
+
+/**
+ * Destructor for the request journal. The records are left in the file
+ * for the requests that have not completed.
+ */
+RequestJournal::~RequestJournal()
+{
+	if (m_map)
+		munmap(m_map, JOURNAL_SIZE);
+	if (m_fd != -1)
+		close(m_fd);
+}
+
+/**
+ * Return the default path of the request journal of a dispatcher service,
+ * in the Fledge data directory
+ *
+ * @param service	The name of the service
+ * @return string	The path of the journal file
+ */
+string RequestJournal::defaultPath(const string& service)
+{
+	string dir;
+	if (getenv("FLEDGE_DATA"))
+		dir = getenv("FLEDGE_DATA");
+	else if (getenv("FLEDGE_ROOT"))
+		dir = string(getenv("FLEDGE_ROOT")) + "/data";
+	else
+		dir = "/tmp";
+	string name = service;
+	replace(name.begin(), name.end(), '/', '_');
+	replace(name.begin(), name.end(), ' ', '_');
+	return dir + "/" + name + "_requests.journal";
+}
+
+/**
+ * Convert the name of a durability level, as used in the configuration
+ * of the service, to the durability
+ *
+ * @param name			The name of the durability level
+ * @return JournalDurability	The durability, off if the name is not recognised
+ */
+JournalDurability RequestJournal::parseDurability(const string& name)
+{
+	if (name.compare("buffered") == 0)
+		return JournalBuffered;
+	else if (name.compare("group") == 0)
+		return JournalGroup;
+	else if (name.compare("sync") == 0)
+		return JournalSync;
+	return JournalOff;
+}
+
+/**
+ * Return the FNV-1a hash of a record, used as the checksum of the record
+ *
+ * @param data		The encoded request
+ * @param length	The length of the encoded request
+ * @return uint32_t	The checksum
+ */
+uint32_t RequestJournal::checksum(const char *data, size_t length)
+{
+	uint32_t hash = 2166136261U;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char)data[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/**
+ * Return the space used in the journal by a record, records are aligned
+ * to 8 bytes
+ *
+ * @param length	The length of the encoded request
+ * @return uint64_t	The space used by the record and its header
+ */
+uint64_t RequestJournal::recordLength(uint32_t length)
+{
+	return (sizeof(RecordHeader) + length + 7) & ~(uint64_t)7;
+}
+
+/**
+ * Open the journal file, creating it if it does not exist, and map it
+ * into memory. A journal that was written by an incompatible version is
+ * discarded.
+ *
+ * @return bool	True if the journal is open
+ */
+bool RequestJournal::open()
+{
+	m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (m_fd == -1)
+	{
+		Logger::getLogger()->error("Unable to open the control request journal %s, %s",
+				m_path.c_str(), strerror(errno));
+		return false;
+	}
+	struct stat st;
+	if (fstat(m_fd, &st) != 0 || (st.st_size != JOURNAL_SIZE && ftruncate(m_fd, JOURNAL_SIZE) != 0))
+	{
+		Logger::getLogger()->error("Unable to size the control request journal %s, %s",
+				m_path.c_str(), strerror(errno));
+		close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+	void *map = mmap(NULL, JOURNAL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (map == MAP_FAILED)
+	{
+		Logger::getLogger()->error("Unable to map the control request journal %s, %s",
+				m_path.c_str(), strerror(errno));
+		close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+	m_map = (char *)map;
+	m_header = (Header *)m_map;
+
+	if (m_header->m_magic != JOURNAL_MAGIC || m_header->m_version != JOURNAL_VERSION
+			|| m_header->m_size != JOURNAL_SIZE
+			|| m_header->m_head < JOURNAL_DATA_START || m_header->m_head >= JOURNAL_SIZE
+			|| m_header->m_headSequence == 0)
+	{
+		if (st.st_size == JOURNAL_SIZE)
+		{
+			Logger::getLogger()->warn("The control request journal %s is not valid and will be reset",
+					m_path.c_str());
+		}
+		m_header->m_magic = JOURNAL_MAGIC;
+		m_header->m_version = JOURNAL_VERSION;
+		m_header->m_size = JOURNAL_SIZE;
+		m_header->m_head = JOURNAL_DATA_START;
+		m_header->m_headSequence = 1;
+		msync(m_map, JOURNAL_DATA_START, MS_SYNC);
+	}
+	m_tail = m_header->m_head;
+	m_firstSequence = m_nextSequence = m_header->m_headSequence;
+	m_committed = m_nextSequence - 1;
+	return true;
+}
+
+/**
+ * Read the requests that were accepted but had not completed when the
+ * journal was last written. The records are followed from the head of the
+ * journal for as long as they have consecutive sequence numbers and valid
+ * checksums, the first record that does not is the end of the journal.
+ *
+ * The records of the requests remain in the journal until the requests
+ * complete. The caller is responsible for queuing and deleting the
+ * requests.
+ *
+ * @param requests	The vector to populate with the requests to replay
+ */
+void RequestJournal::replay(vector<ControlRequest *>& requests)
+{
+	if (!m_map)
+		return;
+
+	lock_guard<mutex> guard(m_mutex);
+	m_entries.clear();
+	uint64_t offset = m_header->m_head;
+	uint64_t sequence = m_header->m_headSequence;
+	uint64_t tail = offset;
+	bool wrapped = false;
+	m_firstSequence = sequence;
+	while (true)
+	{
+		RecordHeader record;
+		if (offset + sizeof(RecordHeader) <= JOURNAL_SIZE)
+			memcpy(&record, m_map + offset, sizeof(RecordHeader));
+		if (offset + sizeof(RecordHeader) > JOURNAL_SIZE || record.m_magic == JOURNAL_WRAP_MAGIC)
+		{
+			// The remainder of the journal was too small for the next record
+			if (wrapped)
+				break;
+			wrapped = true;
+			offset = JOURNAL_DATA_START;
+			continue;
+		}
+		if (record.m_magic != JOURNAL_RECORD_MAGIC || record.m_sequence != sequence
+				|| offset + recordLength(record.m_length) > JOURNAL_SIZE
+				|| record.m_checksum != checksum(m_map + offset + sizeof(RecordHeader), record.m_length))
+		{
+			break;
+		}
+		wrapped = false;
+		uint64_t length = recordLength(record.m_length);
+		m_entries.push_back(Entry(offset, length));
+		if (record.m_done)
+		{
+			m_entries.back().m_done = true;
+		}
+		else
+		{
+			ControlRequest *request = decode(m_map + offset + sizeof(RecordHeader), record.m_length);
+			if (request)
+			{
+				request->setJournalSequence(sequence);
+				requests.push_back(request);
+			}
+			else
+			{
+				Logger::getLogger()->warn("Unable to replay control request %lu from the request journal",
+						sequence);
+				m_entries.back().m_done = true;
+			}
+		}
+		offset += length;
+		tail = offset;
+		sequence++;
+	}
+	m_tail = tail;
+	m_nextSequence = sequence;
+	m_committed = sequence - 1;
+	advanceHead();
+
+	if (!requests.empty())
+	{
+		DispatcherMetrics *metrics = DispatcherMetrics::getInstance();
+		for (size_t i = 0; i < requests.size(); i++)
+			metrics->increment(MetricJournalReplayed);
+		Logger::getLogger()->info("Replaying %d control requests from the request journal",
+				requests.size());
+	}
+}
+
+/**
+ * Discard the records left in the journal without replaying them. Used
+ * when journaling is enabled whilst the service is running, the records
+ * were written before journaling was disabled and the requests they hold
+ * are stale.
+ *
+ * The sequence numbers that the discarded records may hold are skipped,
+ * so that a discarded record can never continue the sequence of the
+ * records written after the reset. The journal can not hold more records
+ * than the number skipped.
+ */
+void RequestJournal::reset()
+{
+	if (!m_map)
+		return;
+
+	lock_guard<mutex> guard(m_mutex);
+	RecordHeader record;
+	memcpy(&record, m_map + m_header->m_head, sizeof(RecordHeader));
+	if (record.m_magic == JOURNAL_RECORD_MAGIC && record.m_sequence == m_header->m_headSequence)
+	{
+		Logger::getLogger()->warn("The control requests left in the request journal %s have been discarded",
+				m_path.c_str());
+	}
+	m_entries.clear();
+	m_nextSequence = m_header->m_headSequence + JOURNAL_SIZE / sizeof(RecordHeader);
+	m_committed = m_nextSequence - 1;
+	advanceHead();
+	msync(m_map, JOURNAL_DATA_START, MS_SYNC);
+}
+
+/**
+ * Allocate space for a record at the tail of the journal, wrapping to the
+ * start of the journal if there is not space before the end. Called with
+ * the journal mutex held.
+ *
+ * @param length	The space required by the record
+ * @return uint64_t	The offset of the record, 0 if the journal is full
+ */
+uint64_t RequestJournal::allocate(uint64_t length)
+{
+	if (m_entries.empty())
+	{
+		m_tail = JOURNAL_DATA_START;
+		return m_tail + length <= JOURNAL_SIZE ? m_tail : 0;
+	}
+	uint64_t head = m_entries.front().m_offset;
+	if (m_tail > head)
+	{
+		if (m_tail + length <= JOURNAL_SIZE)
+			return m_tail;
+		if (JOURNAL_DATA_START + length >= head)
+			return 0;
+		if (m_tail + sizeof(uint32_t) <= JOURNAL_SIZE)
+		{
+			uint32_t wrap = JOURNAL_WRAP_MAGIC;
+			memcpy(m_map + m_tail, &wrap, sizeof(wrap));
+		}
+		m_tail = JOURNAL_DATA_START;
+		return m_tail;
+	}
+	return m_tail + length < head ? m_tail : 0;
+}
+
+/**
+ * Remove the completed requests from the head of the journal. The head is
+ * only moved in the mapped header, the space is reused by later records.
+ * Called with the journal mutex held.
+ */
+void RequestJournal::advanceHead()
+{
+	while (!m_entries.empty() && m_entries.front().m_done)
+	{
+		m_entries.pop_front();
+		m_firstSequence++;
+	}
+	if (m_entries.empty())
+	{
+		m_header->m_head = JOURNAL_DATA_START;
+		m_header->m_headSequence = m_nextSequence;
+		m_firstSequence = m_nextSequence;
+		m_tail = JOURNAL_DATA_START;
+	}
+	else
+	{
+		m_header->m_head = m_entries.front().m_offset;
+		m_header->m_headSequence = m_firstSequence;
+	}
+}
+
+/**
+ * Write the journal to disk
+ */
+void RequestJournal::sync()
+{
+	if (msync(m_map, JOURNAL_SIZE, MS_SYNC) != 0)
+	{
+		Logger::getLogger()->error("Failed to sync the control request journal %s, %s",
+				m_path.c_str(), strerror(errno));
+	}
+}
+
+/**
+ * Wait for the record with a given sequence number to be written to disk.
+ * If no sync is in progress the caller syncs the journal, which writes
+ * every record appended so far. Otherwise the caller waits for the sync in
+ * progress and, if that did not cover its record, the next.
+ *
+ * @param sequence	The sequence number of the record
+ */
+void RequestJournal::groupCommit(uint64_t sequence)
+{
+	unique_lock<mutex> lck(m_commitMutex);
+	while (m_committed < sequence)
+	{
+		if (m_syncing)
+		{
+			m_commitCV.wait(lck);
+			continue;
+		}
+		m_syncing = true;
+		uint64_t target;
+		{
+			lock_guard<mutex> guard(m_mutex);
+			target = m_nextSequence - 1;
+		}
+		lck.unlock();
+		sync();
+		lck.lock();
+		m_syncing = false;
+		if (target > m_committed)
+			m_committed = target;
+		m_commitCV.notify_all();
+	}
+}
+
+/**
+ * Append a record of a control request to the journal. With group or sync
+ * durability the call returns once the record has been written to disk.
+ *
+ * @param request	The control request
+ * @return bool		True if the request was journaled
+ */
+bool RequestJournal::append(ControlRequest *request)
+{
+	JournalDurability durability = m_durability.load();
+	if (!m_map || durability == JournalOff)
+		return false;
+
+	string payload;
+	if (!encode(request, payload))
+		return false;
+
+	uint64_t length = recordLength(payload.length());
+	uint64_t sequence;
+	{
+		lock_guard<mutex> guard(m_mutex);
+		uint64_t offset = allocate(length);
+		if (offset == 0)
+		{
+			if (!m_full)
+			{
+				Logger::getLogger()->warn("The control request journal is full, requests will not be journaled until earlier requests complete");
+				m_full = true;
+			}
+			DispatcherMetrics::getInstance()->increment(MetricJournalFull);
+			return false;
+		}
+		m_full = false;
+		sequence = m_nextSequence++;
+		RecordHeader record;
+		record.m_magic = JOURNAL_RECORD_MAGIC;
+		record.m_length = payload.length();
+		record.m_sequence = sequence;
+		record.m_checksum = checksum(payload.data(), payload.length());
+		record.m_done = 0;
+		memcpy(m_map + offset + sizeof(RecordHeader), payload.data(), payload.length());
+		memcpy(m_map + offset, &record, sizeof(RecordHeader));
+		if (m_entries.empty())
+		{
+			m_firstSequence = sequence;
+			m_header->m_head = offset;
+			m_header->m_headSequence = sequence;
+		}
+		m_entries.push_back(Entry(offset, length));
+		m_tail = offset + length;
+	}
+	request->setJournalSequence(sequence);
+	DispatcherMetrics::getInstance()->increment(MetricJournalAppended);
+
+	if (durability == JournalSync)
+	{
+		sync();
+	}
+	else if (durability == JournalGroup)
+	{
+		groupCommit(sequence);
+	}
+	return true;
+}
+
+/**
+ * Mark the record of a control request as done. Requests may complete in
+ * any order, the head of the journal advances past every request that has
+ * completed before the oldest request that has not.
+ *
+ * @param sequence	The journal sequence number of the request
+ */
+void RequestJournal::complete(uint64_t sequence)
+{
+	if (!m_map || sequence == 0)
+		return;
+
+	lock_guard<mutex> guard(m_mutex);
+	if (sequence < m_firstSequence || sequence - m_firstSequence >= m_entries.size())
+		return;
+	Entry& entry = m_entries[sequence - m_firstSequence];
+	entry.m_done = true;
+	((RecordHeader *)(m_map + entry.m_offset))->m_done = 1;
+	advanceHead();
+}
+
+/**
+ * Encode a control request as the JSON payload of a journal record
+ *
+ * @param request	The control request
+ * @param record	The string to populate with the payload
+ * @return bool		True if the request could be encoded
+ */
+bool RequestJournal::encode(ControlRequest *request, string& record)
+{
+	PipelineEndpoint destination = request->getDestination();
+	const KVList *values;
+	const string *operation = NULL;
+	WriteControlRequest *write = dynamic_cast<WriteControlRequest *>(request);
+	ControlOperationRequest *op = dynamic_cast<ControlOperationRequest *>(request);
+	if (write)
+	{
+		values = &write->getValues();
+	}
+	else if (op)
+	{
+		values = &op->getParameters();
+		operation = &op->getOperation();
+	}
+	else
+	{
+		return false;
+	}
+	const char *type;
+	switch (destination.getType())
+	{
+		case PipelineEndpoint::EndpointService:
+			type = "service";
+			break;
+		case PipelineEndpoint::EndpointAsset:
+			type = "asset";
+			break;
+		case PipelineEndpoint::EndpointScript:
+			type = "script";
+			break;
+		case PipelineEndpoint::EndpointBroadcast:
+			type = "broadcast";
+			break;
+		default:
+			return false;
+	}
+
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	writer.StartObject();
+	writer.Key("type");
+	writer.String(request->getRequestType());
+	writer.Key("destination");
+	writer.String(type);
+	writer.Key("name");
+	writer.String(destination.getName().c_str(), destination.getName().length());
+	if (operation)
+	{
+		writer.Key("operation");
+		writer.String(operation->c_str(), operation->length());
+	}
+	writer.Key("values");
+	writer.StartObject();
+	values->forEach([&writer](const string& key, const string& value) {
+			writer.Key(key.c_str(), key.length());
+			writer.String(value.c_str(), value.length());
+		});
+	writer.EndObject();
+	writer.Key("source");
+	writer.String(request->m_callerType.c_str(), request->m_callerType.length());
+	writer.Key("source_name");
+	writer.String(request->m_callerName.c_str(), request->m_callerName.length());
+	writer.Key("caller_type");
+	writer.String(request->m_source_type.c_str(), request->m_source_type.length());
+	writer.Key("caller_name");
+	writer.String(request->m_source_name.c_str(), request->m_source_name.length());
+	writer.Key("url");
+	writer.String(request->m_request_url.c_str(), request->m_request_url.length());
+	writer.Key("trace_id");
+	writer.String(request->getTraceId().c_str(), request->getTraceId().length());
+	writer.EndObject();
+	record.assign(buffer.GetString(), buffer.GetSize());
+	return true;
+}
+
+/**
+ * Return the value of a string member of a journal record
+ *
+ * @param doc		The journal record
+ * @param name		The name of the member
+ * @return string	The value, empty if the member is missing
+ */
+static string member(const Document& doc, const char *name)
+{
+	if (doc.HasMember(name) && doc[name].IsString())
+		return doc[name].GetString();
+	return "";
+}
+
+/**
+ * Recreate a control request from the JSON payload of a journal record
+ *
+ * @param record		The payload of the record
+ * @param length		The length of the payload
+ * @return ControlRequest*	The control request or NULL if the record is not valid
+ */
+ControlRequest *RequestJournal::decode(const char *record, size_t length)
+{
+	Document doc;
+	doc.Parse(record, length);
+	if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("values"))
+		return NULL;
+
+	string type = member(doc, "type");
+	string destination = member(doc, "destination");
+	string name = member(doc, "name");
+	ControlRequest *request = NULL;
+	try {
+		KVList values(doc["values"]);
+		if (type.compare("write") == 0)
+			request = ControlRequest::createWrite(destination, name, values);
+		else if (type.compare("operation") == 0)
+			request = ControlRequest::createOperation(destination, name, member(doc, "operation"), values);
+	} catch (runtime_error& e) {
+		return NULL;
+	}
+	if (!request)
+		return NULL;
+
+	string source = member(doc, "source");
+	string sourceName = member(doc, "source_name");
+	if (!source.empty() || !sourceName.empty())
+		request->addCaller(source, sourceName);
+	request->setSourceType(member(doc, "caller_type"));
+	request->setSourceName(member(doc, "caller_name"));
+	request->setRequestURL(member(doc, "url"));
+	request->setTraceId(member(doc, "trace_id"));
+	return request;
+}
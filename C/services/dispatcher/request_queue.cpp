@@ -0,0 +1,96 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <request_queue.h>
+#include <controlrequest.h>
+
+using namespace std;
+
+/**
+ * Constructor for an empty request queue
+ */
+RequestQueue::RequestQueue() : m_mutex(LockRequestQueue), m_shutdown(false)
+{
+}
+
+/**
+ * Add a request to the queue and wake a single waiting worker
+ *
+ * @param request	The request to add
+ */
+void RequestQueue::push(ControlRequest *request)
+{
+	string destination = request->getDestination().toString();
+	{
+		lock_guard<ProfiledMutex> guard(m_mutex);
+		m_requests.push(Entry(request, destination));
+		m_depth[destination]++;
+	}
+	m_cv.notify_one();
+}
+
+/**
+ * Return the next request, blocking until a request is available.
+ * Once the queue has been shutdown NULL is returned when the queue
+ * is empty.
+ *
+ * @return ControlRequest*	The next request or NULL
+ */
+ControlRequest *RequestQueue::pop()
+{
+	unique_lock<ProfiledMutex> lock(m_mutex);
+	while (m_requests.empty())
+	{
+		if (m_shutdown)
+			return NULL;
+		m_cv.wait(lock);
+	}
+	Entry& entry = m_requests.front();
+	ControlRequest *request = entry.m_request;
+	auto it = m_depth.find(entry.m_destination);
+	if (it != m_depth.end() && --it->second == 0)
+		m_depth.erase(it);
+	m_requests.pop();
+	return request;
+}
+
+/**
+ * Shutdown the queue, all waiting workers are woken
+ */
+void RequestQueue::shutdown()
+{
+	{
+		lock_guard<ProfiledMutex> guard(m_mutex);
+		m_shutdown = true;
+	}
+	m_cv.notify_all();
+}
+
+/**
+ * Return the number of requests in the queue
+ *
+ * @return size_t	The number of queued requests
+ */
+size_t RequestQueue::size()
+{
+	lock_guard<ProfiledMutex> guard(m_mutex);
+	return m_requests.size();
+}
+
+/**
+ * Return the number of requests in the queue for each destination
+ *
+ * @return map	The number of queued requests keyed by destination
+ */
+map<string, size_t> RequestQueue::depthByDestination()
+{
+	lock_guard<ProfiledMutex> guard(m_mutex);
+	return m_depth;
+}
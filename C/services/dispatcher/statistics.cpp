@@ -0,0 +1,437 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <statistics.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <cctype>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+using namespace std;
+
+thread_local string ControlStatistics::m_caller;
+
+/*
+ * The names used in the statistics keys and descriptions of each statistic
+ */
+static const char *statisticNames[] = { "RECEIVED", "DELIVERED", "FAILED", "FILTERED" };
+static const char *statisticDescriptions[] = {
+	"Control requests received",
+	"Control requests delivered",
+	"Control requests that failed to be delivered",
+	"Control requests removed by a control pipeline"
+};
+
+/**
+ * Constructor for the counts of a destination or caller
+ *
+ * @param name	The name of the destination or caller
+ */
+ControlStatistics::Counts::Counts(const string& name) : m_name(name),
+	m_workerTime(0), m_filterTime(0), m_deliveryTime(0)
+{
+	for (int i = 0; i < StatisticCount; i++)
+	{
+		m_counts[i] = 0;
+		m_written[i] = 0;
+	}
+}
+
+/**
+ * Constructor for the control statistics
+ *
+ * @param storage	The storage client used to write the statistics
+ */
+ControlStatistics::ControlStatistics(StorageClient *storage) : m_storage(storage),
+	m_total(""), m_otherDestination(STATISTICS_OTHER), m_otherCaller(STATISTICS_OTHER),
+	m_thread(NULL), m_running(false), m_interval(atoi(DEFAULT_STATISTICS_INTERVAL))
+{
+	m_logger = Logger::getLogger();
+	for (int i = 0; i < STATISTICS_DESTINATIONS; i++)
+		m_destinations[i] = NULL;
+	for (int i = 0; i < STATISTICS_CALLERS; i++)
+		m_callers[i] = NULL;
+}
+
+/**
+ * Destructor for the control statistics. Any counts that have not
+ * been written to storage are written.
+ */
+ControlStatistics::~ControlStatistics()
+{
+	stop();
+	for (int i = 0; i < STATISTICS_DESTINATIONS; i++)
+		delete m_destinations[i].load();
+	for (int i = 0; i < STATISTICS_CALLERS; i++)
+		delete m_callers[i].load();
+}
+
+/**
+ * Thread entry point for the statistics writer
+ *
+ * @param statistics	The statistics to write
+ */
+static void statisticsThread(ControlStatistics *statistics)
+{
+	statistics->run();
+}
+
+/**
+ * Start the thread that writes the statistics to storage
+ */
+void ControlStatistics::start()
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (m_thread)
+		return;
+	m_running = true;
+	m_thread = new thread(statisticsThread, this);
+}
+
+/**
+ * Stop the thread that writes the statistics, the final counts are
+ * written before the thread exits
+ */
+void ControlStatistics::stop()
+{
+	{
+		lock_guard<mutex> guard(m_mutex);
+		m_running = false;
+	}
+	m_cv.notify_all();
+	if (m_thread)
+	{
+		m_thread->join();
+		delete m_thread;
+		m_thread = NULL;
+	}
+}
+
+/**
+ * Find the counts of a destination or caller in a table of counts, claiming
+ * a new entry in the table if required. Entries are claimed with a compare
+ * and swap and never removed, hence no lock is required.
+ *
+ * @param table		The table of counts
+ * @param size		The number of entries in the table
+ * @param name		The name of the destination or caller
+ * @param other		The counts to use if the table is full
+ * @return Counts*	The counts of the destination or caller
+ */
+ControlStatistics::Counts *ControlStatistics::find(atomic<Counts *> *table, int size,
+		const string& name, Counts *other)
+{
+	size_t start = std::hash<string>()(name);
+	for (int probe = 0; probe < size; probe++)
+	{
+		atomic<Counts *>& slot = table[(start + probe) % size];
+		Counts *counts = slot.load(memory_order_acquire);
+		if (!counts)
+		{
+			Counts *created = new Counts(name);
+			if (slot.compare_exchange_strong(counts, created, memory_order_acq_rel))
+				return created;
+			// Another thread claimed the entry first
+			delete created;
+		}
+		if (counts->m_name == name)
+			return counts;
+	}
+	return other;
+}
+
+/**
+ * Count an event for a control request
+ *
+ * @param statistic	The event to count
+ * @param destination	The destination of the control request
+ * @param caller	The caller that made the control request
+ */
+void ControlStatistics::record(ControlStatistic statistic, const string& destination,
+		const string& caller)
+{
+	m_total.m_counts[statistic].fetch_add(1, memory_order_relaxed);
+	if (!destination.empty())
+	{
+		Counts *counts = find(m_destinations, STATISTICS_DESTINATIONS, destination, &m_otherDestination);
+		counts->m_counts[statistic].fetch_add(1, memory_order_relaxed);
+	}
+	if (!caller.empty())
+	{
+		Counts *counts = find(m_callers, STATISTICS_CALLERS, caller, &m_otherCaller);
+		counts->m_counts[statistic].fetch_add(1, memory_order_relaxed);
+	}
+}
+
+/**
+ * Count an event for the control request being executed by the
+ * calling thread
+ *
+ * @param statistic	The event to count
+ * @param destination	The destination of the control request
+ */
+void ControlStatistics::record(ControlStatistic statistic, const string& destination)
+{
+	record(statistic, destination, m_caller);
+}
+
+/**
+ * Account for the resources consumed by a completed control request
+ *
+ * @param caller	The caller that made the control request
+ * @param workerTime	The worker time consumed in microseconds
+ * @param filterTime	The control pipeline time consumed in microseconds
+ * @param deliveryTime	The delivery time consumed in microseconds
+ */
+void ControlStatistics::account(const string& caller, uint64_t workerTime,
+		uint64_t filterTime, uint64_t deliveryTime)
+{
+	if (caller.empty())
+		return;
+	Counts *counts = find(m_callers, STATISTICS_CALLERS, caller, &m_otherCaller);
+	counts->m_workerTime.fetch_add(workerTime, memory_order_relaxed);
+	counts->m_filterTime.fetch_add(filterTime, memory_order_relaxed);
+	counts->m_deliveryTime.fetch_add(deliveryTime, memory_order_relaxed);
+}
+
+/**
+ * Return the totals of each of the callers that have been counted
+ *
+ * @return vector<CallerTotals>	The totals of the callers
+ */
+vector<CallerTotals> ControlStatistics::getCallers()
+{
+	vector<CallerTotals> totals;
+	for (int i = 0; i < STATISTICS_CALLERS; i++)
+	{
+		Counts *counts = m_callers[i].load(memory_order_acquire);
+		if (counts)
+			total(counts, totals);
+	}
+	if (m_otherCaller.m_counts[StatisticReceived].load(memory_order_relaxed))
+		total(&m_otherCaller, totals);
+	return totals;
+}
+
+/**
+ * Add the totals of a caller to a vector of caller totals
+ *
+ * @param counts	The counts of the caller
+ * @param totals	The vector to add the totals to
+ */
+void ControlStatistics::total(const Counts *counts, vector<CallerTotals>& totals)
+{
+	CallerTotals t;
+	t.m_caller = counts->m_name;
+	for (int i = 0; i < StatisticCount; i++)
+		t.m_counts[i] = counts->m_counts[i].load(memory_order_relaxed);
+	t.m_workerTime = counts->m_workerTime.load(memory_order_relaxed);
+	t.m_filterTime = counts->m_filterTime.load(memory_order_relaxed);
+	t.m_deliveryTime = counts->m_deliveryTime.load(memory_order_relaxed);
+	totals.push_back(t);
+}
+
+/**
+ * The statistics writer thread. The counts are written to storage
+ * once per interval.
+ */
+void ControlStatistics::run()
+{
+	unique_lock<mutex> lock(m_mutex);
+	while (m_running)
+	{
+		m_cv.wait_for(lock, chrono::seconds(m_interval));
+		lock.unlock();
+		flush();
+		lock.lock();
+	}
+}
+
+/**
+ * Write the counts accumulated since the last write to the statistics
+ * table. All of the counts are written in a single batched update, rows
+ * are created for keys that are not yet in the statistics table.
+ */
+void ControlStatistics::flush()
+{
+	class Change {
+		public:
+			Change(Counts *counts, ControlStatistic statistic, long value) :
+				m_counts(counts), m_statistic(statistic), m_value(value) {};
+			Counts			*m_counts;
+			ControlStatistic	m_statistic;
+			long			m_value;
+	};
+	vector<pair<Counts *, Scope>> all;
+	all.push_back(make_pair(&m_total, ScopeTotal));
+	for (int i = 0; i < STATISTICS_DESTINATIONS; i++)
+	{
+		Counts *counts = m_destinations[i].load(memory_order_acquire);
+		if (counts)
+			all.push_back(make_pair(counts, ScopeDestination));
+	}
+	all.push_back(make_pair(&m_otherDestination, ScopeDestination));
+	for (int i = 0; i < STATISTICS_CALLERS; i++)
+	{
+		Counts *counts = m_callers[i].load(memory_order_acquire);
+		if (counts)
+			all.push_back(make_pair(counts, ScopeCaller));
+	}
+	all.push_back(make_pair(&m_otherCaller, ScopeCaller));
+
+	vector<pair<ExpressionValues *, Where *>> updates;
+	vector<Change> changes;
+	for (auto& entry : all)
+	{
+		Counts *counts = entry.first;
+		for (int i = 0; i < StatisticCount; i++)
+		{
+			ControlStatistic statistic = (ControlStatistic)i;
+			long value = counts->m_counts[i].load(memory_order_relaxed);
+			if (value == counts->m_written[i])
+				continue;
+			string key = getKey(statistic, entry.second, counts->m_name);
+			if (m_created.find(key) == m_created.end())
+			{
+				// The count is written with a later update if the row can not be created
+				if (!createRow(key, getDescription(statistic, entry.second, counts->m_name)))
+					continue;
+				m_created.insert(key);
+			}
+			ExpressionValues *update = new ExpressionValues;
+			update->push_back(Expression("value", "+", value - counts->m_written[i]));
+			updates.emplace_back(update, new Where("key", Equals, key));
+			changes.push_back(Change(counts, statistic, value));
+		}
+	}
+	if (updates.empty())
+		return;
+
+	bool written = false;
+	try {
+		written = m_storage->updateTable(STATISTICS_TABLE, updates) >= 0;
+	} catch (exception& e) {
+		m_logger->error("Failed to write the control statistics, %s", e.what());
+	}
+	for (auto& update : updates)
+	{
+		delete update.first;
+		delete update.second;
+	}
+	// Unwritten counts are written with the next update
+	if (written)
+	{
+		for (auto& change : changes)
+			change.m_counts->m_written[change.m_statistic] = change.m_value;
+	}
+}
+
+/**
+ * Return the statistics table key for a count. Characters other than
+ * letters, digits, '-', '_' and '.' are replaced in the names chosen by
+ * callers. Keys that are too long for the table are truncated and end
+ * with a hash of the full key so that truncated keys remain distinct.
+ *
+ * @param statistic	The statistic
+ * @param scope		The scope of the count
+ * @param name		The name of the destination or caller
+ * @return string	The key in the statistics table
+ */
+string ControlStatistics::getKey(ControlStatistic statistic, Scope scope, const string& name)
+{
+	string rval = "CONTROL-";
+	rval += statisticNames[statistic];
+	if (scope == ScopeDestination)
+		rval += "-TO-" + name;
+	else if (scope == ScopeCaller)
+		rval += "-FROM-" + name;
+	for (auto& c : rval)
+	{
+		if (isalnum(c) || c == '-' || c == '_' || c == '.')
+			c = toupper(c);
+		else
+			c = '_';
+	}
+	if (rval.length() > STATISTICS_KEY_LENGTH)
+	{
+		// FNV-1a, the key must be the same each time the dispatcher runs
+		uint32_t hash = 2166136261U;
+		for (unsigned char c : rval)
+		{
+			hash ^= c;
+			hash *= 16777619U;
+		}
+		char suffix[10];
+		snprintf(suffix, sizeof(suffix), "-%08X", hash);
+		rval.resize(STATISTICS_KEY_LENGTH - strlen(suffix));
+		rval += suffix;
+	}
+	return rval;
+}
+
+/**
+ * Return the description of a count
+ *
+ * @param statistic	The statistic
+ * @param scope		The scope of the count
+ * @param name		The name of the destination or caller
+ * @return string	The description of the statistic
+ */
+string ControlStatistics::getDescription(ControlStatistic statistic, Scope scope, const string& name)
+{
+	string rval = statisticDescriptions[statistic];
+	if (scope == ScopeDestination)
+		rval += " for " + name;
+	else if (scope == ScopeCaller)
+		rval += " from " + name;
+	else
+		rval += " by the dispatcher";
+	return rval;
+}
+
+/**
+ * Create a row in the statistics table if the key does not already exist
+ *
+ * @param key		The statistics key
+ * @param description	The description of the statistic
+ * @return bool		True if the row exists
+ */
+bool ControlStatistics::createRow(const string& key, const string& description)
+{
+	ResultSet *result = NULL;
+	bool rval = false;
+	try {
+		Query query(new Where("key", Equals, key));
+		result = m_storage->queryTable(STATISTICS_TABLE, query);
+		if (result && result->rowCount())
+		{
+			rval = true;
+		}
+		else
+		{
+			InsertValues values;
+			values.push_back(InsertValue("key", key));
+			values.push_back(InsertValue("description", description));
+			values.push_back(InsertValue("value", 0));
+			values.push_back(InsertValue("previous_value", 0));
+			rval = m_storage->insertTable(STATISTICS_TABLE, values) == 1;
+			if (!rval)
+				m_logger->error("Unable to create the statistic %s", key.c_str());
+		}
+	} catch (exception& e) {
+		m_logger->error("Unable to create the statistic %s, %s", key.c_str(), e.what());
+	}
+	delete result;
+	return rval;
+}
@@ -0,0 +1,260 @@
+/*
+ * Fledge Dispatcher service test harness.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ * A load generator that drives the /dispatch/write and /dispatch/operation
+ * entry points of the dispatcher at a fixed rate with a configurable mix of
+ * request types.
+ *
+ * The load is open loop, each request has a scheduled send time and the API
+ * latency of the request is measured from that scheduled time. A dispatcher
+ * that falls behind therefore shows the queueing delay in the latency rather
+ * than silently reducing the offered load.
+ *
+ * Every request carries a "sent_at" value with the wall clock time in
+ * microseconds at which it was sent. The mock south service uses this to
+ * measure the end to end latency through the dispatcher, the statistics of
+ * the mock south services given with --south-stats are reset at the start of
+ * the run and collected at the end.
+ *
+ * The results are written to stdout as a JSON document.
+ *
+ * Usage: dispatcher_loadgen --dispatcher <host>:<port> [--rate <requests/s>]
+ *		[--duration <s>] [--threads <n>] [--write-ratio <0.0-1.0>]
+ *		[--services <name>,<name>...] [--keys <n>] [--drain <s>]
+ *		[--south-stats <host>:<port>]...
+ */
+#include <client_http.hpp>
+#include <harness_stats.h>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+using HttpClient = SimpleWeb::Client<SimpleWeb::HTTP>;
+
+static string		dispatcher;
+static double		rate = 100.0;
+static unsigned int	duration = 10;
+static unsigned int	threads = 4;
+static double		writeRatio = 1.0;
+static vector<string>	services;
+static unsigned int	keys = 4;
+static unsigned int	drain = 2;
+static vector<string>	southStats;
+
+static LatencySamples	writeLatency;
+static LatencySamples	operationLatency;
+static atomic<long>	late(0);
+
+/**
+ * Build the payload of a write request
+ *
+ * @param service	The destination service
+ * @param sequence	The sequence number of the request
+ * @return string	The request payload
+ */
+static string writePayload(const string& service, long sequence)
+{
+	ostringstream payload;
+	payload << "{ \"destination\" : \"service\", \"name\" : \"" << service << "\", "
+		<< "\"source\" : \"API\", \"source_name\" : \"loadgen\", \"write\" : { ";
+	for (unsigned int i = 0; i < keys; i++)
+		payload << "\"key" << i << "\" : \"" << (sequence + i) % 1000 << "\", ";
+	payload << "\"sent_at\" : \"" << wallClockMicros() << "\" } }";
+	return payload.str();
+}
+
+/**
+ * Build the payload of an operation request
+ *
+ * @param service	The destination service
+ * @param sequence	The sequence number of the request
+ * @return string	The request payload
+ */
+static string operationPayload(const string& service, long sequence)
+{
+	ostringstream payload;
+	payload << "{ \"destination\" : \"service\", \"name\" : \"" << service << "\", "
+		<< "\"source\" : \"API\", \"source_name\" : \"loadgen\", \"operation\" : { \"loadgen\" : { ";
+	for (unsigned int i = 0; i < keys; i++)
+		payload << "\"param" << i << "\" : \"" << (sequence + i) % 1000 << "\", ";
+	payload << "\"sent_at\" : \"" << wallClockMicros() << "\" } } }";
+	return payload.str();
+}
+
+/**
+ * The body of a load generating thread. Each thread sends an equal share
+ * of the requests on its own connection to the dispatcher.
+ *
+ * @param id	The index of the thread
+ */
+static void loadThread(unsigned int id)
+{
+	HttpClient client(dispatcher);
+	mt19937 generator(id);
+	uniform_real_distribution<double> mix(0.0, 1.0);
+	SimpleWeb::CaseInsensitiveMultimap headers = {{"Content-Type", "application/json"}};
+
+	chrono::nanoseconds interval((long)(1e9 * threads / rate));
+	// Stagger the threads across one interval
+	auto start = chrono::steady_clock::now() + interval * id / threads;
+	auto end = start + chrono::seconds(duration);
+	vector<long> writes, operations;
+	long writeFailures = 0, operationFailures = 0;
+
+	long sequence = 0;
+	for (auto scheduled = start; scheduled < end; scheduled += interval, sequence++)
+	{
+		auto now = chrono::steady_clock::now();
+		if (now < scheduled)
+			this_thread::sleep_until(scheduled);
+		else if (now - scheduled > interval)
+			late++;
+
+		const string& service = services[(sequence * threads + id) % services.size()];
+		bool write = mix(generator) < writeRatio;
+		bool ok = false;
+		try {
+			auto res = client.request("POST", write ? "/dispatch/write" : "/dispatch/operation",
+					write ? writePayload(service, sequence) : operationPayload(service, sequence),
+					headers);
+			ok = res->status_code.compare(0, 3, "202") == 0 || res->status_code.compare(0, 3, "200") == 0;
+		} catch (exception& e) {
+			cerr << "Request failed: " << e.what() << endl;
+		}
+		long latency = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - scheduled).count();
+		if (write)
+		{
+			if (ok)
+				writes.push_back(latency);
+			else
+				writeFailures++;
+		}
+		else
+		{
+			if (ok)
+				operations.push_back(latency);
+			else
+				operationFailures++;
+		}
+	}
+	writeLatency.merge(writes, writeFailures);
+	operationLatency.merge(operations, operationFailures);
+}
+
+/**
+ * Send a request to a mock south service to fetch or reset its statistics
+ *
+ * @param address	The address and port of the mock south service
+ * @param method	GET to fetch the statistics, DELETE to reset them
+ * @return string	The response payload
+ */
+static string southRequest(const string& address, const string& method)
+{
+	try {
+		HttpClient client(address);
+		auto res = client.request(method, "/stats");
+		return res->content.string();
+	} catch (exception& e) {
+		cerr << "Unable to reach mock south service " << address << ": " << e.what() << endl;
+	}
+	return "null";
+}
+
+/**
+ * Return the value of a command line option
+ */
+static const char *option(int& i, int argc, char **argv)
+{
+	if (i + 1 >= argc)
+	{
+		cerr << "Missing value for option " << argv[i] << endl;
+		exit(1);
+	}
+	return argv[++i];
+}
+
+int main(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--dispatcher") == 0)
+			dispatcher = option(i, argc, argv);
+		else if (strcmp(argv[i], "--rate") == 0)
+			rate = atof(option(i, argc, argv));
+		else if (strcmp(argv[i], "--duration") == 0)
+			duration = atoi(option(i, argc, argv));
+		else if (strcmp(argv[i], "--threads") == 0)
+			threads = atoi(option(i, argc, argv));
+		else if (strcmp(argv[i], "--write-ratio") == 0)
+			writeRatio = atof(option(i, argc, argv));
+		else if (strcmp(argv[i], "--keys") == 0)
+			keys = atoi(option(i, argc, argv));
+		else if (strcmp(argv[i], "--drain") == 0)
+			drain = atoi(option(i, argc, argv));
+		else if (strcmp(argv[i], "--south-stats") == 0)
+			southStats.push_back(option(i, argc, argv));
+		else if (strcmp(argv[i], "--services") == 0)
+		{
+			stringstream list(option(i, argc, argv));
+			string name;
+			while (getline(list, name, ','))
+				if (!name.empty())
+					services.push_back(name);
+		}
+		else
+		{
+			dispatcher.clear();
+			break;
+		}
+	}
+	if (dispatcher.empty() || rate <= 0 || threads == 0)
+	{
+		cerr << "Usage: " << argv[0] << " --dispatcher <host>:<port> [--rate <requests/s>]"
+			<< " [--duration <s>] [--threads <n>] [--write-ratio <0.0-1.0>]"
+			<< " [--services <name>,<name>...] [--keys <n>] [--drain <s>]"
+			<< " [--south-stats <host>:<port>]..." << endl;
+		return 1;
+	}
+	if (services.empty())
+		services.push_back("south1");
+
+	for (auto& address : southStats)
+		southRequest(address, "DELETE");
+
+	auto start = chrono::steady_clock::now();
+	vector<thread> generators;
+	for (unsigned int i = 0; i < threads; i++)
+		generators.push_back(thread(loadThread, i));
+	for (auto& t : generators)
+		t.join();
+	double elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / 1000000.0;
+
+	// Allow the dispatcher to deliver the requests still in its queue
+	this_thread::sleep_for(chrono::seconds(drain));
+
+	cout << "{ \"offered_rate\" : " << rate << ", \"elapsed\" : " << elapsed
+		<< ", \"late_sends\" : " << late.load()
+		<< ", \"api\" : { \"write\" : " << writeLatency.toJSON(elapsed)
+		<< ", \"operation\" : " << operationLatency.toJSON(elapsed) << " }"
+		<< ", \"south\" : { ";
+	for (size_t i = 0; i < southStats.size(); i++)
+	{
+		if (i)
+			cout << ", ";
+		cout << "\"" << southStats[i] << "\" : " << southRequest(southStats[i], "GET");
+	}
+	cout << " } }" << endl;
+	return 0;
+}
@@ -0,0 +1,131 @@
+#ifndef _HARNESS_STATS_H
+#define _HARNESS_STATS_H
+/*
+ * Fledge Dispatcher service test harness.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ * Latency sample collection shared by the load generator and the
+ * mock south service.
+ */
+#include <vector>
+#include <string>
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+/**
+ * Return the wall clock time in microseconds. Wall clock time is used as
+ * the timestamps are compared between processes on the same host.
+ */
+static inline long wallClockMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * A thread safe collection of latency samples in microseconds
+ */
+class LatencySamples {
+	public:
+		LatencySamples() : m_failures(0) {};
+
+		/**
+		 * Add a sample
+		 *
+		 * @param micros	The latency in microseconds
+		 */
+		void		add(long micros)
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					m_samples.push_back(micros);
+				};
+
+		/**
+		 * Merge the samples of another collection
+		 *
+		 * @param samples	The samples to merge
+		 */
+		void		merge(const std::vector<long>& samples, long failures)
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					m_samples.insert(m_samples.end(), samples.begin(), samples.end());
+					m_failures += failures;
+				};
+
+		/**
+		 * Record a failure
+		 */
+		void		fail()
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					m_failures++;
+				};
+
+		/**
+		 * Discard all the samples
+		 */
+		void		reset()
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					m_samples.clear();
+					m_failures = 0;
+				};
+
+		/**
+		 * Return the samples as a JSON object with the count and
+		 * the latency percentiles
+		 *
+		 * @param elapsed	The duration of the run in seconds, 0 if not known
+		 * @return string	The JSON object
+		 */
+		std::string	toJSON(double elapsed = 0)
+				{
+					std::vector<long> sorted;
+					long failures;
+					{
+						std::lock_guard<std::mutex> guard(m_mutex);
+						sorted = m_samples;
+						failures = m_failures;
+					}
+					std::sort(sorted.begin(), sorted.end());
+					char buf[512];
+					snprintf(buf, sizeof(buf),
+						"{ \"count\" : %lu, \"failures\" : %ld, \"throughput\" : %.1f, "
+						"\"latency_us\" : { \"min\" : %ld, \"p50\" : %ld, \"p90\" : %ld, "
+						"\"p99\" : %ld, \"p999\" : %ld, \"max\" : %ld } }",
+						(unsigned long)sorted.size(), failures,
+						elapsed > 0 ? sorted.size() / elapsed : 0.0,
+						percentile(sorted, 0.0), percentile(sorted, 0.5),
+						percentile(sorted, 0.9), percentile(sorted, 0.99),
+						percentile(sorted, 0.999), percentile(sorted, 1.0));
+					return std::string(buf);
+				};
+
+		/**
+		 * Return a percentile of a sorted set of samples
+		 *
+		 * @param sorted	The sorted samples
+		 * @param q		The percentile in the range 0.0 to 1.0
+		 * @return long		The value at the percentile
+		 */
+		static long	percentile(const std::vector<long>& sorted, double q)
+				{
+					if (sorted.empty())
+						return 0;
+					size_t index = (size_t)(q * (sorted.size() - 1) + 0.5);
+					return sorted[std::min(index, sorted.size() - 1)];
+				};
+	private:
+		std::mutex		m_mutex;
+		std::vector<long>	m_samples;
+		long			m_failures;
+};
+
+#endif
@@ -0,0 +1,403 @@
+/*
+ * Fledge Dispatcher service test harness.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ * A local stand in for the Fledge core and storage services that allows the
+ * dispatcher to be started and driven by the load generator without a full
+ * Fledge installation. Only the subset of the core management API and the
+ * storage API used by the dispatcher during start up and request delivery
+ * is implemented:
+ *
+ *	- Service registration and lookup, the storage service and any south
+ *	  services given with --service resolve to the addresses given
+ *	- Configuration category creation, retrieval and child categories
+ *	- Configuration and table interest registration, audit entries and
+ *	  asset tracking, which are accepted and discarded
+ *	- Queries of the control lookup tables, all other tables are empty
+ *
+ * The dispatcher is pointed at the mock with its --port and --address
+ * options, e.g.
+ *
+ *	mock_core --port 8081 --service south1=127.0.0.1:9001
+ *	fledge.services.dispatcher --port=8081 --address=127.0.0.1 --name=Dispatcher -d
+ *
+ * Usage: mock_core [--port <port>] [--service <name>=<host>:<port>]...
+ */
+#include <server_http.hpp>
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <map>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+using namespace rapidjson;
+using HttpServer = SimpleWeb::Server<SimpleWeb::HTTP>;
+
+/**
+ * A service known to the mock core
+ */
+class MockService {
+	public:
+		MockService(const string& name, const string& type, const string& address,
+				unsigned short port, unsigned short managementPort) :
+			m_name(name), m_type(type), m_address(address),
+			m_port(port), m_managementPort(managementPort) {};
+		string		m_name;
+		string		m_type;
+		string		m_address;
+		unsigned short	m_port;
+		unsigned short	m_managementPort;
+};
+
+static HttpServer		server;
+static mutex			servicesMutex;
+static vector<MockService>	services;
+static mutex			categoriesMutex;
+static map<string, string>	categories;
+static atomic<long>		nextId(1);
+
+/*
+ * The rows of the control lookup tables, these mirror the rows created by
+ * the Fledge schema.
+ */
+static const char *sourceRows =
+	"[ { \"cpsid\" : 1, \"name\" : \"Any\", \"description\" : \"Any source.\" },"
+	"  { \"cpsid\" : 2, \"name\" : \"Service\", \"description\" : \"A named service in source of the control pipeline.\" },"
+	"  { \"cpsid\" : 3, \"name\" : \"API\", \"description\" : \"The control pipeline source is the REST API.\" },"
+	"  { \"cpsid\" : 4, \"name\" : \"Notification\", \"description\" : \"The control pipeline originated from a notification.\" },"
+	"  { \"cpsid\" : 5, \"name\" : \"Schedule\", \"description\" : \"The control request was triggered by a schedule.\" },"
+	"  { \"cpsid\" : 6, \"name\" : \"Script\", \"description\" : \"The control request has come from the named script.\" } ]";
+static const char *destinationRows =
+	"[ { \"cpdid\" : 1, \"name\" : \"Any\", \"description\" : \"Any destination.\" },"
+	"  { \"cpdid\" : 2, \"name\" : \"Service\", \"description\" : \"A name service that is responsible for the asset.\" },"
+	"  { \"cpdid\" : 3, \"name\" : \"Asset\", \"description\" : \"A name asset that is being controlled.\" },"
+	"  { \"cpdid\" : 4, \"name\" : \"Script\", \"description\" : \"A name script that will be executed.\" },"
+	"  { \"cpdid\" : 5, \"name\" : \"Broadcast\", \"description\" : \"Send the request to all south services that support control.\" } ]";
+
+/**
+ * Send a response with a JSON payload
+ *
+ * @param response	The response stream
+ * @param status	The HTTP status line
+ * @param payload	The JSON payload
+ */
+static void respond(shared_ptr<HttpServer::Response> response, const string& status, const string& payload)
+{
+	*response << "HTTP/1.1 " << status << "\r\nContent-Length: " << payload.length()
+		<< "\r\nContent-type: application/json\r\n\r\n" << payload;
+}
+
+/**
+ * Serialise a JSON value
+ */
+static string toString(const Value& value)
+{
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	value.Accept(writer);
+	return string(buffer.GetString());
+}
+
+/**
+ * Return the JSON representation of a service record
+ */
+static string toJSON(const MockService& service)
+{
+	return "{ \"id\" : \"" + service.m_name + "\", \"name\" : \"" + service.m_name
+		+ "\", \"type\" : \"" + service.m_type + "\", \"address\" : \"" + service.m_address
+		+ "\", \"service_port\" : " + to_string(service.m_port)
+		+ ", \"management_port\" : " + to_string(service.m_managementPort)
+		+ ", \"protocol\" : \"http\", \"status\" : \"running\" }";
+}
+
+/**
+ * Register a service
+ */
+static void registerService(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	Document doc;
+	string payload = request->content.string();
+	doc.Parse(payload.c_str());
+	if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("name") || !doc["name"].IsString())
+	{
+		respond(response, "400 Bad Request", "{ \"message\" : \"Malformed service registration\" }");
+		return;
+	}
+	string name = doc["name"].GetString();
+	string type = doc.HasMember("type") && doc["type"].IsString() ? doc["type"].GetString() : "";
+	string address = doc.HasMember("address") && doc["address"].IsString() ? doc["address"].GetString() : "127.0.0.1";
+	unsigned short port = doc.HasMember("service_port") && doc["service_port"].IsInt() ? doc["service_port"].GetInt() : 0;
+	unsigned short managementPort = doc.HasMember("management_port") && doc["management_port"].IsInt() ? doc["management_port"].GetInt() : 0;
+	{
+		lock_guard<mutex> guard(servicesMutex);
+		services.push_back(MockService(name, type, address, port, managementPort));
+	}
+	cerr << "Registered service " << name << " (" << type << ") at " << address << ":" << port << endl;
+	respond(response, "200 OK", "{ \"id\" : \"" + to_string(nextId++) + "\", \"bearer_token\" : \"\" }");
+}
+
+/**
+ * Unregister a service
+ */
+static void unregisterService(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	respond(response, "200 OK", "{ \"id\" : \"" + string(request->path_match[1]) + "\" }");
+}
+
+/**
+ * Find services by name or type
+ */
+static void getServices(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	string name, type;
+	auto query = request->parse_query_string();
+	for (auto& param : query)
+	{
+		if (param.first.compare("name") == 0)
+			name = param.second;
+		else if (param.first.compare("type") == 0)
+			type = param.second;
+	}
+	string payload = "{ \"services\" : [ ";
+	bool first = true;
+	// The mock itself is the storage service
+	MockService storage("Fledge Storage", "Storage", "127.0.0.1",
+			server.getLocalPort(), server.getLocalPort());
+	if ((name.empty() || name.compare(storage.m_name) == 0)
+			&& (type.empty() || type.compare(storage.m_type) == 0))
+	{
+		payload += toJSON(storage);
+		first = false;
+	}
+	{
+		lock_guard<mutex> guard(servicesMutex);
+		for (auto& service : services)
+		{
+			if ((name.empty() || name.compare(service.m_name) == 0)
+					&& (type.empty() || type.compare(service.m_type) == 0))
+			{
+				if (!first)
+					payload += ", ";
+				payload += toJSON(service);
+				first = false;
+			}
+		}
+	}
+	payload += " ] }";
+	if (first)
+		respond(response, "404 Not Found", "{ \"message\" : \"No matching service\" }");
+	else
+		respond(response, "200 OK", payload);
+}
+
+/**
+ * Create a configuration category. Items without a value take their
+ * default value, items that already exist keep their current value.
+ */
+static void createCategory(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	Document doc;
+	string payload = request->content.string();
+	doc.Parse(payload.c_str());
+	if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("key") || !doc["key"].IsString()
+			|| !doc.HasMember("value") || !doc["value"].IsObject())
+	{
+		respond(response, "400 Bad Request", "{ \"message\" : \"Malformed category\" }");
+		return;
+	}
+	string key = doc["key"].GetString();
+	Value& items = doc["value"];
+	Document::AllocatorType& allocator = doc.GetAllocator();
+
+	lock_guard<mutex> guard(categoriesMutex);
+	Document existing;
+	auto it = categories.find(key);
+	if (it != categories.end())
+		existing.Parse(it->second.c_str());
+	for (auto& item : items.GetObject())
+	{
+		if (!item.value.IsObject())
+			continue;
+		const char *name = item.name.GetString();
+		if (existing.IsObject() && existing.HasMember(name) && existing[name].IsObject()
+				&& existing[name].HasMember("value"))
+		{
+			Value value(existing[name]["value"], allocator);
+			if (item.value.HasMember("value"))
+				item.value["value"] = value;
+			else
+				item.value.AddMember("value", value, allocator);
+		}
+		else if (!item.value.HasMember("value") && item.value.HasMember("default"))
+		{
+			Value value(item.value["default"], allocator);
+			item.value.AddMember("value", value, allocator);
+		}
+	}
+	string result = toString(items);
+	categories[key] = result;
+	respond(response, "200 OK", result);
+}
+
+/**
+ * Return a configuration category
+ */
+static void getCategory(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	string key = request->path_match[1];
+	lock_guard<mutex> guard(categoriesMutex);
+	auto it = categories.find(key);
+	if (it == categories.end())
+		respond(response, "404 Not Found", "{ \"message\" : \"No such category\" }");
+	else
+		respond(response, "200 OK", it->second);
+}
+
+/**
+ * Add child categories, the hierarchy is not modelled by the mock
+ */
+static void addChildren(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	Document doc;
+	string payload = request->content.string();
+	doc.Parse(payload.c_str());
+	string children = "[]";
+	if (!doc.HasParseError() && doc.IsObject() && doc.HasMember("children"))
+		children = toString(doc["children"]);
+	respond(response, "200 OK", "{ \"children\" : " + children + " }");
+}
+
+/**
+ * Register an interest in a configuration category
+ */
+static void registerInterest(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	respond(response, "200 OK", "{ \"id\" : \"" + to_string(nextId++) + "\", \"message\" : \"Interest registered successfully\" }");
+}
+
+/**
+ * Return the asset tracking tuples, there are none
+ */
+static void getTracking(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	respond(response, "200 OK", "{ \"track\" : [] }");
+}
+
+/**
+ * Query a storage table
+ */
+static void queryTable(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	string table = request->path_match[1];
+	string rows = "[]";
+	int count = 0;
+	if (table.compare("control_source") == 0)
+	{
+		rows = sourceRows;
+		count = 6;
+	}
+	else if (table.compare("control_destination") == 0)
+	{
+		rows = destinationRows;
+		count = 5;
+	}
+	respond(response, "200 OK", "{ \"count\" : " + to_string(count) + ", \"rows\" : " + rows + " }");
+}
+
+/**
+ * Insert or update rows in a storage table, the rows are discarded
+ */
+static void modifyTable(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	respond(response, "200 OK", "{ \"response\" : \"updated\", \"rows_affected\" : 1 }");
+}
+
+/**
+ * Accept any request that is not otherwise handled
+ */
+static void accept(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	respond(response, "200 OK", "{}");
+}
+
+/**
+ * Return the value of a command line option
+ */
+static const char *option(int& i, int argc, char **argv)
+{
+	if (i + 1 >= argc)
+	{
+		cerr << "Missing value for option " << argv[i] << endl;
+		exit(1);
+	}
+	return argv[++i];
+}
+
+int main(int argc, char **argv)
+{
+	unsigned short port = 8081;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--port") == 0)
+		{
+			port = atoi(option(i, argc, argv));
+		}
+		else if (strcmp(argv[i], "--service") == 0)
+		{
+			string definition = option(i, argc, argv);
+			size_t equals = definition.find('=');
+			size_t colon = definition.rfind(':');
+			if (equals == string::npos || colon == string::npos || colon < equals)
+			{
+				cerr << "Services should be given as <name>=<host>:<port>" << endl;
+				return 1;
+			}
+			services.push_back(MockService(definition.substr(0, equals), "Southbound",
+						definition.substr(equals + 1, colon - equals - 1),
+						atoi(definition.substr(colon + 1).c_str()), 0));
+		}
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--port <port>] [--service <name>=<host>:<port>]..." << endl;
+			return 1;
+		}
+	}
+
+	server.config.port = port;
+	server.config.thread_pool_size = 4;
+	server.resource["^/fledge/service$"]["POST"] = registerService;
+	server.resource["^/fledge/service$"]["GET"] = getServices;
+	server.resource["^/fledge/service/([^/]+)$"]["DELETE"] = unregisterService;
+	server.resource["^/fledge/service/category$"]["POST"] = createCategory;
+	server.resource["^/fledge/service/category/([^/]+)$"]["GET"] = getCategory;
+	server.resource["^/fledge/service/category/([^/]+)/children$"]["POST"] = addChildren;
+	server.resource["^/fledge/interest$"]["POST"] = registerInterest;
+	server.resource["^/fledge/track"]["GET"] = getTracking;
+	server.resource["^/storage/table/([^/]+)/query$"]["PUT"] = queryTable;
+	server.resource["^/storage/table/([^/]+)$"]["POST"] = modifyTable;
+	server.resource["^/storage/table/([^/]+)$"]["PUT"] = modifyTable;
+	server.default_resource["GET"] = accept;
+	server.default_resource["POST"] = accept;
+	server.default_resource["PUT"] = accept;
+	server.default_resource["DELETE"] = accept;
+
+	thread listener([]() { server.start(); });
+	while (server.getLocalPort() == 0)
+		this_thread::sleep_for(chrono::milliseconds(10));
+	cout << "{ \"port\" : " << server.getLocalPort() << " }" << endl;
+	listener.join();
+	return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * Fledge Dispatcher service test harness.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ * A mock south service that implements the control entry points of a south
+ * service, /fledge/south/setpoint and /fledge/south/operation. The service
+ * may be configured to add latency to each call and to fail a proportion
+ * of the calls.
+ *
+ * If the control request carries a "sent_at" value, the wall clock time in
+ * microseconds at which the load generator sent the request, the end to end
+ * latency of the request is recorded. The latency statistics may be read
+ * with a GET of /stats and reset with a DELETE of /stats.
+ *
+ * Usage: mock_south [--port <port>] [--latency-ms <ms>] [--jitter-ms <ms>]
+ *		[--failure-rate <0.0-1.0>] [--threads <n>]
+ */
+#include <server_http.hpp>
+#include <rapidjson/document.h>
+#include <harness_stats.h>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+using namespace rapidjson;
+using HttpServer = SimpleWeb::Server<SimpleWeb::HTTP>;
+
+#define SENT_AT_KEY	"sent_at"
+
+static unsigned int	latencyMs = 0;
+static unsigned int	jitterMs = 0;
+static double		failureRate = 0.0;
+static LatencySamples	setpointLatency;
+static LatencySamples	operationLatency;
+static atomic<long>	setpointCalls(0);
+static atomic<long>	operationCalls(0);
+static atomic<long>	injectedFailures(0);
+static long		statsStart = wallClockMicros();
+
+/**
+ * Send a response with a JSON payload
+ *
+ * @param response	The response stream
+ * @param status	The HTTP status line
+ * @param payload	The JSON payload
+ */
+static void respond(shared_ptr<HttpServer::Response> response, const string& status, const string& payload)
+{
+	*response << "HTTP/1.1 " << status << "\r\nContent-Length: " << payload.length()
+		<< "\r\nContent-type: application/json\r\n\r\n" << payload;
+}
+
+/**
+ * Extract the send time of a request from a JSON object of key/value pairs
+ *
+ * @param object	The object that may contain the sent_at key
+ * @return long		The time the request was sent or 0 if not known
+ */
+static long sentAt(const Value& object)
+{
+	if (!object.IsObject() || !object.HasMember(SENT_AT_KEY))
+		return 0;
+	const Value& value = object[SENT_AT_KEY];
+	if (value.IsInt64())
+		return value.GetInt64();
+	if (value.IsString())
+		return strtol(value.GetString(), NULL, 10);
+	return 0;
+}
+
+/**
+ * Simulate the processing of a control request by the south plugin
+ *
+ * @return bool	False if the request should fail
+ */
+static bool simulate()
+{
+	static thread_local mt19937 generator(hash<thread::id>()(this_thread::get_id()));
+	unsigned int delay = latencyMs;
+	if (jitterMs)
+	{
+		uniform_int_distribution<unsigned int> jitter(0, jitterMs);
+		delay += jitter(generator);
+	}
+	if (delay)
+		this_thread::sleep_for(chrono::milliseconds(delay));
+	if (failureRate > 0.0)
+	{
+		uniform_real_distribution<double> chance(0.0, 1.0);
+		if (chance(generator) < failureRate)
+		{
+			injectedFailures++;
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Handle a set point write
+ */
+static void setpoint(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	setpointCalls++;
+	Document doc;
+	string payload = request->content.string();
+	doc.Parse(payload.c_str());
+	if (doc.HasParseError() || !doc.IsObject()
+			|| !doc.HasMember("values") || !doc["values"].IsObject())
+	{
+		respond(response, "400 Bad Request", "{ \"message\" : \"Malformed set point payload\" }");
+		return;
+	}
+	if (!simulate())
+	{
+		setpointLatency.fail();
+		respond(response, "500 Internal Server Error", "{ \"message\" : \"Injected failure\" }");
+		return;
+	}
+	long sent = sentAt(doc["values"]);
+	if (sent)
+		setpointLatency.add(wallClockMicros() - sent);
+	respond(response, "200 OK", "{ \"status\" : \"ok\" }");
+}
+
+/**
+ * Handle an operation
+ */
+static void operation(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	operationCalls++;
+	Document doc;
+	string payload = request->content.string();
+	doc.Parse(payload.c_str());
+	if (doc.HasParseError() || !doc.IsObject()
+			|| !doc.HasMember("operation") || !doc["operation"].IsString())
+	{
+		respond(response, "400 Bad Request", "{ \"message\" : \"Malformed operation payload\" }");
+		return;
+	}
+	if (!simulate())
+	{
+		operationLatency.fail();
+		respond(response, "500 Internal Server Error", "{ \"message\" : \"Injected failure\" }");
+		return;
+	}
+	if (doc.HasMember("parameters"))
+	{
+		long sent = sentAt(doc["parameters"]);
+		if (sent)
+			operationLatency.add(wallClockMicros() - sent);
+	}
+	respond(response, "200 OK", "{ \"status\" : \"ok\" }");
+}
+
+/**
+ * Return the end to end latency statistics
+ */
+static void getStats(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	double elapsed = (wallClockMicros() - statsStart) / 1000000.0;
+	string payload = "{ \"calls\" : { \"setpoint\" : " + to_string(setpointCalls.load())
+		+ ", \"operation\" : " + to_string(operationCalls.load())
+		+ ", \"injected_failures\" : " + to_string(injectedFailures.load()) + " }, "
+		+ "\"elapsed\" : " + to_string(elapsed) + ", "
+		+ "\"setpoint\" : " + setpointLatency.toJSON(elapsed) + ", "
+		+ "\"operation\" : " + operationLatency.toJSON(elapsed) + " }";
+	respond(response, "200 OK", payload);
+}
+
+/**
+ * Reset the latency statistics
+ */
+static void resetStats(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+	setpointLatency.reset();
+	operationLatency.reset();
+	setpointCalls = 0;
+	operationCalls = 0;
+	injectedFailures = 0;
+	statsStart = wallClockMicros();
+	respond(response, "200 OK", "{ \"status\" : \"reset\" }");
+}
+
+/**
+ * Return the value of a command line option
+ */
+static const char *option(int& i, int argc, char **argv)
+{
+	if (i + 1 >= argc)
+	{
+		cerr << "Missing value for option " << argv[i] << endl;
+		exit(1);
+	}
+	return argv[++i];
+}
+
+int main(int argc, char **argv)
+{
+	unsigned short port = 0;
+	unsigned int threads = 4;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--port") == 0)
+			port = atoi(option(i, argc, argv));
+		else if (strcmp(argv[i], "--latency-ms") == 0)
+			latencyMs = atoi(option(i, argc, argv));
+		else if (strcmp(argv[i], "--jitter-ms") == 0)
+			jitterMs = atoi(option(i, argc, argv));
+		else if (strcmp(argv[i], "--failure-rate") == 0)
+			failureRate = atof(option(i, argc, argv));
+		else if (strcmp(argv[i], "--threads") == 0)
+			threads = atoi(option(i, argc, argv));
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--port <port>] [--latency-ms <ms>]"
+				<< " [--jitter-ms <ms>] [--failure-rate <0.0-1.0>] [--threads <n>]" << endl;
+			return 1;
+		}
+	}
+
+	HttpServer server;
+	server.config.port = port;
+	server.config.thread_pool_size = threads;
+	server.resource["^/fledge/south/setpoint$"]["PUT"] = setpoint;
+	server.resource["^/fledge/south/operation$"]["PUT"] = operation;
+	server.resource["^/stats$"]["GET"] = getStats;
+	server.resource["^/stats$"]["DELETE"] = resetStats;
+
+	thread listener([&server]() { server.start(); });
+	// Wait for the server to bind so that an ephemeral port can be reported
+	while (server.getLocalPort() == 0)
+		this_thread::sleep_for(chrono::milliseconds(10));
+	cout << "{ \"port\" : " << server.getLocalPort() << " }" << endl;
+	listener.join();
+	return 0;
+}
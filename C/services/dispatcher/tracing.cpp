@@ -0,0 +1,160 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <tracing.h>
+#include <logger.h>
+#include <string_utils.h>
+#include <random>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+
+using namespace std;
+
+/**
+ * Return the singleton tracing instance
+ *
+ * @return Tracing*	The tracing instance
+ */
+Tracing *Tracing::getInstance()
+{
+	static Tracing instance;
+	return &instance;
+}
+
+/**
+ * Constructor for the tracing, span export is initially disabled
+ */
+Tracing::Tracing() : m_spans(NULL), m_enabled(false)
+{
+}
+
+/**
+ * Destructor for the tracing, close the span file
+ */
+Tracing::~Tracing()
+{
+	setSpanFile("");
+}
+
+/**
+ * Generate a new trace ID. The ID consists of a random prefix chosen when
+ * the dispatcher starts and a sequence number, giving IDs that are unique
+ * across restarts of the dispatcher without the cost of generating a
+ * random number per request.
+ *
+ * @return string	The new trace ID
+ */
+string Tracing::newTraceId()
+{
+	static const uint32_t prefix = random_device()();
+	static atomic<uint64_t> sequence(0);
+
+	char buf[40];
+	snprintf(buf, sizeof(buf), "%08x%016llx", prefix,
+			(unsigned long long)sequence.fetch_add(1, memory_order_relaxed));
+	return string(buf);
+}
+
+/**
+ * Check if a trace ID passed by a caller may be used. The ID is forwarded
+ * as an HTTP header and written to the logs, therefore only a limited set
+ * of characters is accepted.
+ *
+ * @param traceId	The trace ID to check
+ * @return bool		True if the trace ID may be used
+ */
+bool Tracing::validTraceId(const string& traceId)
+{
+	if (traceId.empty() || traceId.length() > MAX_TRACE_ID_LENGTH)
+		return false;
+	for (char c : traceId)
+	{
+		if (!isalnum((unsigned char)c) && c != '-' && c != '_' && c != '.')
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Set the file to which spans are exported. Spans are appended to the file.
+ *
+ * @param path		The path of the span file, an empty path disables span export
+ * @return bool		True if the span file is in use
+ */
+bool Tracing::setSpanFile(const string& path)
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (path.compare(m_path) == 0 && (m_spans || path.empty()))
+		return m_spans != NULL;
+	m_enabled = false;
+	if (m_spans)
+	{
+		fclose(m_spans);
+		m_spans = NULL;
+	}
+	m_path = path;
+	if (path.empty())
+		return false;
+	m_spans = fopen(path.c_str(), "a");
+	if (!m_spans)
+	{
+		Logger::getLogger()->error("Unable to open the span file %s, %s",
+				path.c_str(), strerror(errno));
+		return false;
+	}
+	m_enabled = true;
+	return true;
+}
+
+/**
+ * Export the spans of a control request that has completed
+ *
+ * @param traceId	The trace ID of the request
+ * @param type		The type of the request
+ * @param destination	The destination of the request
+ * @param caller	The caller that made the request
+ * @param timings	The timestamps of the stages of the request
+ */
+void Tracing::exportSpan(const string& traceId, const char *type, const string& destination,
+		const string& caller, const RequestTimings& timings)
+{
+	if (!m_enabled)
+		return;
+
+	// Convert the steady clock receipt time to a wall clock time
+	int64_t completed = RequestTimings::now();
+	int64_t wallClock = chrono::duration_cast<chrono::nanoseconds>(
+			chrono::system_clock::now().time_since_epoch()).count();
+	int64_t received = timings.m_received ? timings.m_received : timings.m_queued;
+	long start = (wallClock - (completed - received)) / 1000;
+
+	string dest = destination, from = caller;
+	StringEscapeQuotes(dest);
+	StringEscapeQuotes(from);
+
+	char spans[256];
+	snprintf(spans, sizeof(spans),
+		"\"parse\" : %ld, \"queue\" : %ld, \"filter\" : %ld, \"deliver\" : %ld, \"total\" : %ld",
+		timings.m_received && timings.m_queued ? (long)(timings.m_queued - timings.m_received) / 1000 : 0L,
+		timings.m_queued && timings.m_dequeued ? (long)(timings.m_dequeued - timings.m_queued) / 1000 : 0L,
+		timings.m_filterStart && timings.m_filterEnd ? (long)(timings.m_filterEnd - timings.m_filterStart) / 1000 : 0L,
+		timings.m_deliveryStart && timings.m_deliveryEnd ? (long)(timings.m_deliveryEnd - timings.m_deliveryStart) / 1000 : 0L,
+		(long)(completed - received) / 1000);
+
+	lock_guard<mutex> guard(m_mutex);
+	if (m_spans)
+	{
+		fprintf(m_spans, "{ \"trace_id\" : \"%s\", \"type\" : \"%s\", \"destination\" : \"%s\", "
+				"\"caller\" : \"%s\", \"start\" : %ld, \"spans_us\" : { %s } }\n",
+				traceId.c_str(), type, dest.c_str(), from.c_str(), start, spans);
+	}
+}
@@ -0,0 +1,373 @@
+/*
+ * Fledge Dispatcher service.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Mark Riddoch
+ *
+ */
+#include <watchdog.h>
+#include <controlpipeline.h>
+#include <pipeline_execution.h>
+#include <dispatcher_service.h>
+#include <flight_recorder.h>
+#include <string_utils.h>
+#include <algorithm>
+
+using namespace std;
+
+thread_local WorkerState *WorkerState::m_current = NULL;
+
+/**
+ * Constructor for the state of a worker thread
+ *
+ * @param id	The identifier of the worker
+ */
+WorkerState::WorkerState(int id) : m_id(id), m_abandoned(false), m_reported(false)
+{
+}
+
+/**
+ * Push a new stage onto the stack of stages of the worker
+ *
+ * @param frame	The stage to push
+ */
+void WorkerState::push(const Frame& frame)
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (m_frames.empty())
+		m_reported = false;
+	m_frames.push_back(frame);
+}
+
+/**
+ * Record the start of the execution of a control request
+ *
+ * @param detail	A description of the control request
+ */
+void WorkerState::begin(const string& detail)
+{
+	push(Frame(StageExecuting, detail));
+}
+
+/**
+ * Record the start of the execution of a control pipeline. The stage holds
+ * a reference to the pipeline and the context until the stage ends, so
+ * that the watchdog can quarantine the context.
+ *
+ * @param pipeline	The control pipeline
+ * @param context	The execution context of the pipeline
+ */
+void WorkerState::filtering(ControlPipeline *pipeline, PipelineExecutionContext *context)
+{
+	Frame frame(StageFiltering, pipeline->getName());
+	pipeline->acquire();
+	context->acquire();
+	frame.m_pipeline = pipeline;
+	frame.m_context = context;
+	push(frame);
+}
+
+/**
+ * Record the start of the delivery of a control request to a service
+ *
+ * @param service	The name of the service
+ */
+void WorkerState::delivering(const string& service)
+{
+	push(Frame(StageDelivering, service));
+}
+
+/**
+ * Record the completion of the current stage
+ */
+void WorkerState::end()
+{
+	ControlPipeline *pipeline = NULL;
+	PipelineExecutionContext *context = NULL;
+	{
+		lock_guard<mutex> guard(m_mutex);
+		if (m_frames.empty())
+			return;
+		pipeline = m_frames.back().m_pipeline;
+		context = m_frames.back().m_context;
+		m_frames.pop_back();
+	}
+	// Release outside of the lock as this may delete the context
+	if (context)
+		context->release();
+	if (pipeline)
+		pipeline->release();
+}
+
+/**
+ * Determine if the request being executed by the worker has exceeded the
+ * execution budget. A request is only reported as over budget once.
+ *
+ * @param budget	The execution budget in milliseconds
+ * @param report	A description of the stuck stage of the request
+ * @return bool		True if the request has exceeded the budget
+ */
+bool WorkerState::overBudget(unsigned int budget, string& report)
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (m_frames.empty() || m_reported)
+		return false;
+
+	auto now = chrono::steady_clock::now();
+	long elapsed = chrono::duration_cast<chrono::milliseconds>(now - m_frames.front().m_start).count();
+	if (elapsed < budget)
+		return false;
+
+	m_reported = true;
+	const Frame& stuck = m_frames.back();
+	long stageTime = chrono::duration_cast<chrono::milliseconds>(now - stuck.m_start).count();
+	report = "control request for " + m_frames.front().m_detail + " has been executing for "
+		+ to_string(elapsed) + "ms";
+	switch (stuck.m_stage)
+	{
+		case StageFiltering:
+			report += ", filtering in pipeline " + stuck.m_detail;
+			break;
+		case StageDelivering:
+			report += ", delivering to service " + stuck.m_detail;
+			break;
+		default:
+			break;
+	}
+	if (m_frames.size() > 1)
+	{
+		report += " for " + to_string(stageTime) + "ms";
+	}
+	return true;
+}
+
+/**
+ * Quarantine the pipeline context in which the worker is executing. The
+ * pipeline will create a new context for subsequent requests. The worker
+ * takes ownership of the quarantined context, the context is deleted when
+ * the worker releases it as the request returns from the context.
+ *
+ * @return bool	True if a context was quarantined
+ */
+bool WorkerState::quarantine()
+{
+	lock_guard<mutex> guard(m_mutex);
+	for (auto it = m_frames.rbegin(); it != m_frames.rend(); ++it)
+	{
+		if (it->m_stage == StageFiltering && it->m_context && !it->m_quarantined)
+		{
+			it->m_quarantined = true;
+			return it->m_pipeline->quarantine(it->m_context);
+		}
+	}
+	return false;
+}
+
+/**
+ * Return a JSON description of what the worker is currently executing.
+ * The stage is the innermost stage of the request being executed.
+ *
+ * @return string	The JSON object describing the worker
+ */
+string WorkerState::toJSON()
+{
+	string json = "{ \"id\" : " + to_string(m_id);
+	json += ", \"abandoned\" : ";
+	json += m_abandoned ? "true" : "false";
+
+	lock_guard<mutex> guard(m_mutex);
+	if (m_frames.empty())
+	{
+		json += ", \"state\" : \"idle\" }";
+		return json;
+	}
+	auto now = chrono::steady_clock::now();
+	const Frame& request = m_frames.front();
+	const Frame& current = m_frames.back();
+	string destination = request.m_detail;
+	string detail = current.m_detail;
+	StringEscapeQuotes(destination);
+	StringEscapeQuotes(detail);
+	json += ", \"state\" : \"executing\"";
+	json += ", \"destination\" : \"" + destination + "\"";
+	json += ", \"elapsed_ms\" : " + to_string(chrono::duration_cast<chrono::milliseconds>(now - request.m_start).count());
+	switch (current.m_stage)
+	{
+		case StageFiltering:
+			json += ", \"stage\" : \"filtering\", \"pipeline\" : \"" + detail + "\"";
+			break;
+		case StageDelivering:
+			json += ", \"stage\" : \"delivering\", \"service\" : \"" + detail + "\"";
+			break;
+		default:
+			json += ", \"stage\" : \"executing\"";
+			break;
+	}
+	json += ", \"stage_ms\" : " + to_string(chrono::duration_cast<chrono::milliseconds>(now - current.m_start).count());
+	json += " }";
+	return json;
+}
+
+/**
+ * Constructor for the execution watchdog
+ *
+ * @param service	The dispatcher service
+ */
+ExecutionWatchdog::ExecutionWatchdog(DispatcherService *service) : m_service(service),
+	m_thread(NULL), m_running(false), m_budget(0), m_quarantine(false)
+{
+	m_logger = Logger::getLogger();
+}
+
+/**
+ * Destructor for the execution watchdog
+ */
+ExecutionWatchdog::~ExecutionWatchdog()
+{
+	stop();
+}
+
+/**
+ * Thread entry point for the watchdog
+ *
+ * @param watchdog	The watchdog to run
+ */
+static void watchdogThread(ExecutionWatchdog *watchdog)
+{
+	watchdog->run();
+}
+
+/**
+ * Start the watchdog thread
+ */
+void ExecutionWatchdog::start()
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (m_thread)
+		return;
+	m_running = true;
+	m_thread = new thread(watchdogThread, this);
+}
+
+/**
+ * Stop the watchdog thread
+ */
+void ExecutionWatchdog::stop()
+{
+	{
+		lock_guard<mutex> guard(m_mutex);
+		m_running = false;
+	}
+	m_cv.notify_all();
+	if (m_thread)
+	{
+		m_thread->join();
+		delete m_thread;
+		m_thread = NULL;
+	}
+}
+
+/**
+ * Add a worker to those monitored by the watchdog
+ *
+ * @param state	The state of the worker
+ */
+void ExecutionWatchdog::addWorker(WorkerState *state)
+{
+	lock_guard<mutex> guard(m_mutex);
+	m_workers.push_back(state);
+}
+
+/**
+ * Remove a worker from those monitored by the watchdog
+ *
+ * @param state	The state of the worker
+ */
+void ExecutionWatchdog::removeWorker(WorkerState *state)
+{
+	lock_guard<mutex> guard(m_mutex);
+	auto it = find(m_workers.begin(), m_workers.end(), state);
+	if (it != m_workers.end())
+		m_workers.erase(it);
+}
+
+/**
+ * Return a JSON array describing what each of the workers is executing
+ *
+ * @return string	The JSON array of workers
+ */
+string ExecutionWatchdog::workersToJSON()
+{
+	lock_guard<mutex> guard(m_mutex);
+	string json = "[ ";
+	bool first = true;
+	for (auto& state : m_workers)
+	{
+		if (!first)
+			json += ", ";
+		first = false;
+		json += state->toJSON();
+	}
+	json += " ]";
+	return json;
+}
+
+/**
+ * The watchdog thread, check the workers once a second
+ */
+void ExecutionWatchdog::run()
+{
+	unique_lock<mutex> lock(m_mutex);
+	while (m_running)
+	{
+		m_cv.wait_for(lock, chrono::seconds(1));
+		if (!m_running)
+			break;
+		lock.unlock();
+		check();
+		FlightRecorder::getInstance()->checkDump();
+		lock.lock();
+	}
+}
+
+/**
+ * Check each of the workers against the execution budget
+ */
+void ExecutionWatchdog::check()
+{
+	unsigned int budget = m_budget;
+	if (budget == 0)
+		return;
+
+	int replace = 0;
+	{
+		lock_guard<mutex> guard(m_mutex);
+		for (auto& state : m_workers)
+		{
+			string report;
+			if (state->isAbandoned() || !state->overBudget(budget, report))
+				continue;
+			m_logger->error("Dispatcher worker %d has exceeded the execution budget of %u milliseconds, %s",
+					state->getId(), budget, report.c_str());
+			if (m_quarantine)
+			{
+				if (state->quarantine())
+				{
+					m_logger->warn("The pipeline context used by dispatcher worker %d has been quarantined",
+							state->getId());
+				}
+				state->abandon();
+				replace++;
+			}
+		}
+	}
+
+	// Replace the abandoned workers to maintain the capacity of the worker pool
+	for (int i = 0; i < replace; i++)
+	{
+		m_service->startWorker();
+	}
+}